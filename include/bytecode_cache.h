@@ -0,0 +1,18 @@
+#ifndef BYTECODE_CACHE_H
+#define BYTECODE_CACHE_H
+
+#include <lua.h>
+
+// Enables caching compiled chunks in `dir`, caching is disabled until then
+void bytecode_cache_init(const char *dir);
+
+// Same as luaL_loadfile, but reuses the compiled chunk if the file's mtime and
+// size haven't changed since it was cached
+int bytecode_cache_loadfile(lua_State *L, const char *path);
+
+// Replaces the Lua file searcher of `require` with the cached one
+void bytecode_cache_install_searcher(lua_State *L);
+
+void bytecode_cache_deinit();
+
+#endif // BYTECODE_CACHE_H
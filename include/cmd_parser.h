@@ -2,6 +2,7 @@
 #define CMD_PARSER_H
 
 #include "test_logs.h"
+#include "test_order.h"
 
 #include <stdbool.h>
 
@@ -12,6 +13,7 @@ typedef enum {
     CMD_HELP,
     CMD_TARGET_ADD,
     CMD_TARGET_REMOVE,
+    CMD_SERVE,
     CMD_UNKNOWN,
 } cmd_category;
 
@@ -43,6 +45,46 @@ typedef struct {
     char *custom_taf_lib_path;
 
     bool headless;
+
+    size_t jobs;
+    bool threads;
+
+    size_t concurrent;
+
+    char **targets;
+    size_t targets_amount;
+
+    size_t shard_index; // 1-based
+    size_t shard_count; // 0 if sharding is disabled
+    char *shard_history; // raw log balancing the shards, NULL if none
+
+    test_order_t order;
+
+    bool cache;
+
+    bool watch;
+
+    char *server; // socket of `taf serve` to run tests in
+
+    unsigned long test_timeout; // ms, 0 if tests have no default timeout
+
+    bool isolate;
+
+    bool progress_sampling; // count hook instead of the line hook in the TUI
+
+    bool coverage;
+
+    bool profile;
+
+    size_t tui_scrollback; // log lines kept by the TUI
+
+    bool compact; // headless output with one line per test
+
+    raw_log_format_t raw_log_format;
+
+    bool output_log_drop; // drop output log records when the writer lags
+
+    bool compress_logs;
 } cmd_test_options;
 
 typedef struct {
@@ -50,6 +92,8 @@ typedef struct {
 
     bool include_outputs;
 
+    char *test; // 1-based index or name of the only test shown, NULL if all
+
     bool internal_logging;
 } cmd_logs_info_options;
 
@@ -63,13 +107,21 @@ typedef struct {
     bool internal_logging;
 } cmd_target_remove_options;
 
+typedef struct {
+    char *socket_path;
+} cmd_serve_options;
+
 cmd_category cmd_parser_parse(int argc, char **argv);
 
+// Arguments passed to the last cmd_parser_parse call
+void cmd_parser_get_args(int *argc, char ***argv);
+
 cmd_init_options *cmd_parser_get_init_options();
 cmd_config_options *cmd_parser_get_config_options();
 cmd_test_options *cmd_parser_get_test_options();
 cmd_logs_info_options *cmd_parser_get_logs_info_options();
 cmd_target_add_options *cmd_parser_get_target_add_options();
 cmd_target_remove_options *cmd_parser_get_target_remove_options();
+cmd_serve_options *cmd_parser_get_serve_options();
 
 #endif // CMD_PARSER_H
@@ -0,0 +1,33 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include "source_cache.h"
+
+#include <stdbool.h>
+
+// Executed lines are recorded for sources for which `covered` returns true
+void coverage_init(source_filter_fn covered);
+
+// Decides whether `entry` is covered & allocates its bitmap.
+// Returns whether lines of `entry` are recorded.
+bool coverage_track(source_entry_t *entry);
+
+// Adds the source file `path` to the report, its lines count as not executed
+// unless they were recorded
+void coverage_add_file(const char *path);
+
+// Records execution of the 1-based line `line` of `entry`
+static inline void coverage_hit(source_entry_t *entry, int line) {
+    if (!entry->hits && (entry->coverage_checked || !coverage_track(entry))) {
+        return;
+    }
+    size_t i = (size_t)line - 1;
+    if (i < entry->lines_count) {
+        entry->hits[i >> 3] |= 1U << (i & 7);
+    }
+}
+
+// Writes recorded lines in lcov format to `path`
+int coverage_write(const char *path);
+
+#endif // COVERAGE_H
@@ -5,8 +5,6 @@
 #include <lua.h>
 #include <lualib.h>
 
-#define DEFER_LIST_KEY "taf.defer.list"
-
 /******************* API START ***********************/
 
 // taf:defer(defer_func: function, ...)
@@ -33,8 +31,14 @@ int l_module_taf_print(lua_State *L);
 
 // taf:test(name: string, body: function)
 // taf:test(name: string, tags: [string], body: function)
+// taf:test(name: string, options: table, body: function)
 int l_module_taf_register_test(lua_State *L);
 
+// taf:test_each(name_fmt: string, rows: [any]|string, body: function(row))
+// taf:test_each(name_fmt: string, rows: [any]|string, tags: [string],
+//               body: function(row))
+int l_module_taf_register_test_each(lua_State *L);
+
 // taf:sleep(ms: number)
 int l_module_taf_sleep(lua_State *L);
 
@@ -0,0 +1,29 @@
+#ifndef OUTPUT_LOG_H
+#define OUTPUT_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Output log is written by a background thread. Records are handed to it
+// through a lock-free single producer ring buffer, so all the functions
+// below must be called from the same thread.
+
+// Starts the writer of the output log into `file`, which is closed by
+// output_log_close(). If `drop` is set, records which don't fit into the full
+// ring are dropped instead of waiting for the writer.
+void output_log_open(FILE *file, bool drop);
+
+// Appends text formatted from `fmt`
+void output_log_printf(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+
+// Appends text formatted from `fmt`, `len` bytes of `data` & an empty line
+// as one record
+void output_log_message(const char *data, size_t len, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Writes all the records, stops the writer & closes the file
+void output_log_close();
+
+#endif // OUTPUT_LOG_H
@@ -0,0 +1,20 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <lua.h>
+
+// Starts sampling the Lua call stack of `L` at a fixed frequency. The hook
+// installed in `L` keeps being called.
+void profile_start(lua_State *L);
+
+// Stops sampling & writes the samples as folded stacks, one line per stack
+// with the name of the test as its root frame, to `path`
+int profile_stop(const char *path);
+
+// Time between these calls is recorded under the current Lua stack with
+// the frame `[tag]`, as the thread does not run Lua code meanwhile.
+// No-ops unless profiling the calling thread.
+void profile_offcpu_begin(lua_State *L, const char *tag);
+void profile_offcpu_end();
+
+#endif // PROFILE_H
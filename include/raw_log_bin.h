@@ -0,0 +1,117 @@
+#ifndef RAW_LOG_BIN_H
+#define RAW_LOG_BIN_H
+
+#include "test_logs.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary raw log:
+//
+//   header | test blocks... | string table | test index
+//
+// Test blocks are written as tests finish. Every block holds the messages of
+// the test, each followed by '\0', its output records & its tags. The string
+// table holds interned names, file paths, timestamps & tags, referenced by
+// their offset in it. Test index has an entry per test, so a single test is
+// read without touching the others. The header is written last, a log
+// without it is incomplete.
+
+#define RAW_LOG_BIN_MAGIC "TAFRAWLG"
+#define RAW_LOG_BIN_VERSION 2
+
+#define RAW_LOG_BIN_NO_STRING UINT32_MAX
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t tests_count;
+
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t index_offset;
+    uint64_t tags_offset; // uint32_t string refs
+    uint32_t tags_count;
+
+    uint32_t project_name;
+    uint32_t taf_version;
+    uint32_t os;
+    uint32_t os_version;
+    uint32_t started;
+    uint32_t finished;
+    uint32_t target;
+} raw_log_bin_header_t;
+
+typedef struct {
+    uint32_t name; // RAW_LOG_BIN_NO_STRING if the test did not run
+    uint32_t started;
+    uint32_t finished;
+    uint32_t teardown_start;
+    uint32_t status;
+
+    uint32_t tags_count;
+    uint64_t tags_offset;
+
+    // Outputs, failure reasons, teardown outputs & teardown errors follow
+    // each other starting at `outputs_offset`
+    uint64_t outputs_offset;
+    uint32_t outputs_count;
+    uint32_t failure_reasons_count;
+    uint32_t teardown_outputs_count;
+    uint32_t teardown_errors_count;
+
+    uint64_t duration_ms;
+} raw_log_bin_test_t;
+
+typedef struct {
+    uint64_t msg_offset;
+    uint32_t msg_len;
+    uint32_t file;
+    uint32_t date_time;
+    int32_t line;
+    int32_t level;
+    uint32_t reserved;
+} raw_log_bin_output_t;
+
+// Creates binary raw log `path`. Returns -1 on error.
+int raw_log_bin_create(const char *path);
+
+// Writes the block of the finished test with the 1-based `index`
+void raw_log_bin_add_test(int index, raw_log_test_t *test);
+
+// Writes the string table, test index & the header with the fields of `log`
+int raw_log_bin_finish(raw_log_t *log);
+
+// Mapped binary raw log
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    const raw_log_bin_header_t *header;
+    const raw_log_bin_test_t *tests;
+} raw_log_bin_t;
+
+// Maps binary raw log `path`, NULL if it is not a complete binary raw log
+raw_log_bin_t *raw_log_bin_open(const char *path);
+void raw_log_bin_close(raw_log_bin_t *bin);
+
+// Fills fields of the test run into `log`. Strings point into the mapping,
+// free with raw_log_bin_put_run().
+void raw_log_bin_get_run(const raw_log_bin_t *bin, raw_log_t *log);
+void raw_log_bin_put_run(raw_log_t *log);
+
+// Name of the test with the 0-based `index`, NULL if it did not run
+const char *raw_log_bin_test_name(const raw_log_bin_t *bin, size_t index);
+
+// Fills the test with the 0-based `index` into `test`, outputs other than
+// failure reasons only if `with_outputs` is set. Strings point into the
+// mapping, free with raw_log_bin_put_test(). Returns false if the test did
+// not run or its entry is corrupt.
+bool raw_log_bin_get_test(const raw_log_bin_t *bin, size_t index,
+                          raw_log_test_t *test, bool with_outputs);
+void raw_log_bin_put_test(raw_log_test_t *test);
+
+// Copies the whole log, free with taf_raw_log_free()
+raw_log_t *raw_log_bin_to_raw_log(const raw_log_bin_t *bin);
+
+#endif // RAW_LOG_BIN_H
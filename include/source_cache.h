@@ -0,0 +1,50 @@
+#ifndef SOURCE_CACHE_H
+#define SOURCE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Source file seen by the line hook
+typedef struct {
+    char *source; // copy of the chunk source, e.g. "@/path/file.lua"
+    const char *path;
+    bool skip; // internal module or hook file
+
+    // Mapped file & offsets of its lines, NULL if the file is unavailable
+    // or skipped
+    const char *data;
+    size_t size;
+    uint32_t *lines;
+    size_t lines_count;
+
+    // Bitmap of executed lines, set up by coverage_hit() on the first hit
+    uint8_t *hits;
+    bool coverage_checked;
+} source_entry_t;
+
+typedef bool (*source_filter_fn)(const char *path);
+
+// `skip` decides once per source whether its lines are skipped
+void source_cache_init(source_filter_fn skip);
+
+// Returns entry of the chunk source `source` (`ar->source` of lua_Debug).
+// Lookups are keyed by the string pointer, which Lua shares between all
+// functions of a chunk. Entries stay valid until source_cache_free().
+source_entry_t *source_cache_get(const char *source);
+
+// Creates an entry of `source` which isn't returned by source_cache_get(),
+// e.g. for a file which was never loaded
+source_entry_t *source_cache_add(const char *source);
+
+// Text of the 1-based line `line` of `entry` without the line break.
+// Returns NULL if unavailable. Safe to call from any thread.
+const char *source_cache_line(const source_entry_t *entry, int line,
+                              size_t *len);
+
+// Calls `fn` for every entry, including entries of collected chunks
+void source_cache_foreach(void (*fn)(source_entry_t *, void *), void *ud);
+
+void source_cache_free();
+
+#endif // SOURCE_CACHE_H
@@ -0,0 +1,10 @@
+#ifndef TAF_SERVE_H
+#define TAF_SERVE_H
+
+// `taf serve`: keeps the project loaded and runs tests on request
+int taf_serve();
+
+// `taf test --server <socket>`: runs tests in a running `taf serve`
+int taf_serve_request();
+
+#endif // TAF_SERVE_H
@@ -0,0 +1,73 @@
+#ifndef TAF_STATE_H
+#define TAF_STATE_H
+
+#include "modules/hooks/taf-hooks.h"
+#include "test_case.h"
+
+#include <lua.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TAF_HOOK_FN_COUNT 4
+
+typedef struct {
+    taf_hook_t *hooks;
+    size_t count;
+    size_t capacity;
+} taf_hook_list_t;
+
+// Everything which belongs to a single test runner: the Lua state itself,
+// tests and hooks registered in it and the state of the test being run.
+// Each thread running tests has its own runner state.
+typedef struct {
+    lua_State *L;
+
+    test_case_t *tests;
+    size_t tests_len;
+    size_t tests_cap;
+
+    taf_hook_list_t hooks[TAF_HOOK_FN_COUNT];
+
+    size_t current_test_index;
+    bool test_marked_failed;
+    int test_first_line;
+    int test_last_line;
+    unsigned long test_start_millis;
+
+    // Timeout of the current test, deadline is 0 if it has none
+    unsigned long test_timeout_ms;
+    unsigned long test_deadline_millis;
+    bool test_timed_out;
+    // Hook of the test Lua state replaced while the timeout is armed
+    lua_Hook test_prev_hook;
+    int test_prev_hook_mask;
+    int test_prev_hook_count;
+
+    // Registry reference to the defer queue of the current test
+    int defer_ref;
+
+    // Test logging
+    int log_test_index;
+    bool log_is_teardown;
+    bool log_silent;
+    size_t log_output_cap;
+    size_t log_teardown_output_cap;
+    size_t log_teardown_errors_cap;
+    size_t log_failure_cap;
+} taf_state_t;
+
+taf_state_t *taf_state_new();
+
+// Creates runner state sharing Lua state, tests and hooks with `parent`,
+// used for running several tests concurrently in the same Lua state
+taf_state_t *taf_state_new_shared(taf_state_t *parent);
+
+void taf_state_free(taf_state_t *state);
+
+// Runner state of the calling thread
+taf_state_t *taf_state_get();
+
+void taf_state_set(taf_state_t *state);
+
+#endif // TAF_STATE_H
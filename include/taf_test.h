@@ -3,6 +3,8 @@
 
 #include "test_case.h"
 
+#include <lua.h>
+
 void taf_test_mark_current_test_failed();
 
 void taf_mark_test_failed();
@@ -11,4 +13,14 @@ test_case_t *taf_test_get_current_test();
 
 int taf_test();
 
+// Creates Lua state with lib/, hooks/ and TAF library of the parsed project
+// loaded, before the test options are known. Returns NULL on error.
+lua_State *taf_test_prewarm();
+
+void taf_test_prewarm_free(lua_State *L);
+
+// Runs tests with the current test options in the prewarmed state, meant to
+// be called in a process forked for a single run
+int taf_test_prewarmed(lua_State *L);
+
 #endif // TAF_TEST_H
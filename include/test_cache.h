@@ -0,0 +1,35 @@
+#ifndef TEST_CACHE_H
+#define TEST_CACHE_H
+
+#include "util/files.h"
+
+#include <lua.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TEST_CACHE_DIR ".taf_cache"
+
+// Wraps `require` to record which files every Lua file requires, must be
+// called before loading the project
+void test_cache_track_requires(lua_State *L);
+
+// Returns `path` and all the files which require it, transitively
+str_array_t test_cache_get_dependents(lua_State *L, const char *path);
+
+// Makes the next `require` of the module at `path` load it again
+void test_cache_unload(lua_State *L, const char *path);
+
+// Hashes inputs of the loaded tests and looks them up in the results of the
+// previous runs
+void test_cache_load(lua_State *L);
+
+// Returns true if test with `index` passed before with the same inputs
+bool test_cache_hit(size_t index);
+
+// Saves hashes of the tests which passed in the current run
+void test_cache_save();
+
+void test_cache_free();
+
+#endif // TEST_CACHE_H
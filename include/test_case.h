@@ -1,6 +1,7 @@
 #ifndef TESTS_H
 #define TESTS_H
 
+#include <stdbool.h>
 #include <unistd.h>
 
 #include <lauxlib.h>
@@ -11,15 +12,26 @@ typedef struct {
 } test_tags_t;
 
 typedef struct {
-    const char *name; /* test name             */
-    test_tags_t tags; /* test tags */
-    int ref;          /* reference to Lua fn   */
+    const char *name;      /* test name             */
+    test_tags_t tags;      /* test tags */
+    int ref;               /* reference to Lua fn   */
+    const char *file;      /* source file, NULL if unknown */
+    unsigned long timeout; /* ms, 0 if not set for the test */
+    int row;               /* row of taf.test_each, 0 for plain tests */
+    int rows_ref;          /* reference to rows of taf.test_each */
+    size_t *users;         /* cases sharing ref & rows_ref, or NULL */
 } test_case_t;
 
 void test_case_enqueue(test_case_t *tc);
 
 test_case_t *test_case_get_all(size_t *amount);
 
+// Removes tests which are not marked in `keep`, preserving the order
+void test_case_retain(lua_State *L, const bool *keep);
+
+// Reorders tests so that the i-th test is the `order[i]`-th one before
+void test_case_reorder(const size_t *order);
+
 void test_case_free_all(lua_State *L);
 
 #endif // TESTS_H
@@ -0,0 +1,29 @@
+#ifndef TEST_EACH_H
+#define TEST_EACH_H
+
+#include "test_case.h"
+
+#include <lua.h>
+
+#include <stddef.h>
+
+// Registers a test case for every row of the rows at `rows_index`, which
+// are either an array or a path of a CSV, JSON or JSON Lines file. Files are
+// scanned row by row and only row offsets are kept, rows are read again
+// right before their case runs. Case names are `name_fmt` with `${key}`
+// replaced by row fields and `${#}` by the row number, a Lua error is raised
+// if two rows get the same name. All the cases share one reference of the
+// body & the rows.
+// Returns amount of registered cases.
+size_t test_each_register(lua_State *L, const char *name_fmt, int rows_index,
+                          int body_index, test_tags_t tags,
+                          unsigned long timeout);
+
+// Replaces the body of the test case `tc` on top of the stack with a
+// function calling it with the row of the case
+void test_each_wrap_body(lua_State *L, test_case_t *tc);
+
+// Path of the file with rows of the test case `tc`, NULL if it has none
+const char *test_each_rows_file(lua_State *L, test_case_t *tc);
+
+#endif // TEST_EACH_H
@@ -0,0 +1,42 @@
+#ifndef TEST_HISTORY_H
+#define TEST_HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Amount of the most recent test runs taken into account
+#define TEST_HISTORY_MAX_RUNS 10
+
+typedef struct {
+    char *name;
+    double duration; // average duration in seconds
+    size_t runs;     // amount of runs with this test
+    bool last_failed;
+} test_history_entry_t;
+
+typedef struct {
+    test_history_entry_t *entries;
+    size_t count;
+    size_t cap;
+
+    // Open addressing hash map of names, slots hold entry index + 1
+    size_t *slots;
+    size_t slots_cap;
+} test_history_t;
+
+// Loads history of the current project & target from the raw logs in its
+// logs directory. The summary is cached in the logs directory and only
+// rebuilt when the recent raw logs change.
+// Never returns NULL, history is empty if no logs found.
+test_history_t *test_history_load();
+
+// Loads history from the single raw log `path` of any format. Returns NULL
+// if it cannot be read.
+test_history_t *test_history_from_file(const char *path);
+
+test_history_entry_t *test_history_find(test_history_t *history,
+                                        const char *name);
+
+void test_history_free(test_history_t *history);
+
+#endif // TEST_HISTORY_H
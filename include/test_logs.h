@@ -5,6 +5,13 @@
 
 #include <json.h>
 
+#include <stdbool.h>
+#ifdef __APPLE__
+#include <sys/syslimits.h>
+#else
+#include <limits.h>
+#endif // __APPLE__
+
 typedef enum {
     TAF_LOG_LEVEL_CRITICAL = 0,
     TAF_LOG_LEVEL_ERROR = 1,
@@ -14,6 +21,12 @@ typedef enum {
     TAF_LOG_LEVEL_TRACE = 5,
 } taf_log_level;
 
+typedef enum {
+    RAW_LOG_FORMAT_JSON = 0, // single document written at the end of the run
+    RAW_LOG_FORMAT_JSONL,    // JSON Lines records appended during the run
+    RAW_LOG_FORMAT_BINARY,   // indexed binary log, see raw_log_bin.h
+} raw_log_format_t;
+
 typedef struct {
     char *file;
     int line;
@@ -29,7 +42,10 @@ typedef struct {
     char *finished;
     char *teardown_start;
     char *status;
+    // Duration of the test body measured by its runner, 0 if unknown
+    unsigned long duration_ms;
 
+    // Share strings with `outputs` in the raw log of the running test run
     raw_log_test_output_t *failure_reasons;
     size_t failure_reasons_count;
 
@@ -67,8 +83,33 @@ int hooks_context_push(lua_State *L);
 taf_log_level taf_log_level_from_str(const char *str);
 const char *taf_log_level_to_str(taf_log_level level);
 
+// Returns -1 if the format is unknown
+raw_log_format_t taf_raw_log_format_from_str(const char *str);
+
+// Suffix of the raw log files of `format`, e.g. "_raw.json"
+const char *taf_raw_log_format_suffix(raw_log_format_t format);
+
 json_object *taf_raw_log_to_json(raw_log_t *log);
+// `obj` is either a raw log document or an array of JSON Lines records
 raw_log_t *taf_json_to_raw_log(json_object *obj);
+void taf_raw_log_free(raw_log_t *log);
+
+// Reads raw log file of any format, returns NULL if it cannot be parsed
+raw_log_t *taf_raw_log_from_file(const char *path);
+
+// Finds the newest of the 'latest' raw log symlinks in `logs_dir`.
+// Returns false if there is none.
+bool taf_raw_log_get_latest(const char *logs_dir, char buf[PATH_MAX]);
+
+json_object *taf_raw_log_test_to_json(raw_log_test_t *test);
+bool taf_json_to_raw_log_test(json_object *obj, raw_log_test_t *test);
+
+// Logs directory of the current project & target
+void taf_log_get_logs_dir(char buf[PATH_MAX]);
+
+// Path of the file of the current run with `suffix` appended to the name of
+// its logs, e.g. "_profile.folded". Returns false if logs are disabled.
+bool taf_log_get_run_file_path(char buf[PATH_MAX], const char *suffix);
 
 void taf_log_tests_create(int amount);
 
@@ -90,4 +131,18 @@ void taf_log_defer_queue_finished();
 
 void taf_log_defer_failed(const char *trace, const char *file, int line);
 
+void taf_log_tests_set_silent(bool silent);
+
+raw_log_test_t *taf_log_get_test(int index);
+
+// Frees outputs of the test with `index` once it is in the raw log, keeping
+// its name, times & status
+void taf_log_test_release(int index);
+
+void taf_log_test_report(int index);
+
+// Takes test with `index` from JSON `obj` sent by a worker & reports it.
+// Returns false if `obj` is not a test.
+bool taf_log_test_merge(int index, json_object *obj);
+
 #endif // TEST_LOGS_H
@@ -0,0 +1,22 @@
+#ifndef TEST_ORDER_H
+#define TEST_ORDER_H
+
+#include "test_case.h"
+#include "test_history.h"
+
+#include <stddef.h>
+
+typedef enum {
+    TEST_ORDER_DEFAULT = 0, // file load order
+    TEST_ORDER_FAILED_FIRST,
+    TEST_ORDER_LONGEST_FIRST,
+} test_order_t;
+
+// Returns -1 if the order is unknown
+test_order_t test_order_from_str(const char *str);
+
+// Fills `order` with the indices of `tests` in the order they should run
+void test_order_sort(test_history_t *history, test_case_t *tests,
+                     size_t amount, test_order_t test_order, size_t *order);
+
+#endif // TEST_ORDER_H
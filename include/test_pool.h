@@ -0,0 +1,27 @@
+#ifndef TEST_POOL_H
+#define TEST_POOL_H
+
+#include <lua.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef bool (*test_pool_run_fn)(lua_State *L, size_t index);
+
+typedef lua_State *(*test_pool_state_new_fn)();
+typedef void (*test_pool_state_free_fn)(lua_State *L);
+
+// Runs all registered tests in `jobs` forked worker processes. If `isolate`
+// is set, every test runs in its own process forked from `L`.
+// Returns amount of passed tests.
+size_t test_pool_run(lua_State *L, size_t jobs, bool isolate,
+                     test_pool_run_fn run_test);
+
+// Runs all registered tests in `jobs` worker threads, each with its own
+// runner state and Lua state created with `state_new`.
+// Returns amount of passed tests.
+size_t test_pool_run_threads(size_t jobs, test_pool_run_fn run_test,
+                             test_pool_state_new_fn state_new,
+                             test_pool_state_free_fn state_free);
+
+#endif // TEST_POOL_H
@@ -0,0 +1,30 @@
+#ifndef TEST_SCHEDULER_H
+#define TEST_SCHEDULER_H
+
+#include <lua.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Runs all registered tests as coroutines in the single Lua state, up to
+// `concurrency` at a time. `test_body` is a coroutine body which receives
+// test index as its only argument.
+// Returns amount of passed tests.
+size_t test_scheduler_run(lua_State *L, size_t concurrency,
+                          lua_CFunction test_body);
+
+// Whether `L` is a test coroutine which may yield to the scheduler
+bool test_scheduler_can_yield(lua_State *L);
+
+// Yields to the scheduler for `ms` milliseconds. Must be returned from a C
+// function, `k` is called on resume just like with lua_yieldk.
+int test_scheduler_sleep(lua_State *L, unsigned long ms, lua_KContext ctx,
+                         lua_KFunction k);
+
+// Yields to the scheduler until `fd` is ready for `events` (see poll(2)) or
+// `timeout_ms` passed. Negative `timeout_ms` means no timeout.
+int test_scheduler_wait_fd(lua_State *L, int fd, short events,
+                           long timeout_ms, lua_KContext ctx,
+                           lua_KFunction k);
+
+#endif // TEST_SCHEDULER_H
@@ -0,0 +1,18 @@
+#ifndef TEST_SHARD_H
+#define TEST_SHARD_H
+
+#include "test_case.h"
+#include "test_history.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Marks tests belonging to the shard `index` (1-based) out of `count` shards
+// in `keep`. Shards are balanced by the test durations in `history`, which
+// must be the same on every machine, tests are distributed by their name
+// hash if `history` is NULL or empty.
+// `keep` must be able to hold `amount` values.
+void test_shard_select(test_history_t *history, test_case_t *tests,
+                       size_t amount, size_t index, size_t count, bool *keep);
+
+#endif // TEST_SHARD_H
@@ -0,0 +1,19 @@
+#ifndef TEST_TARGETS_H
+#define TEST_TARGETS_H
+
+#include <stddef.h>
+
+typedef struct {
+    size_t total;
+    size_t passed;
+} test_run_result_t;
+
+// Runs currently selected target, returns exit code
+typedef int (*test_targets_run_fn)(test_run_result_t *result);
+
+// Runs every target in its own process in parallel, prints combined summary.
+// Returns exit code.
+int test_targets_run(char **targets, size_t amount,
+                     test_targets_run_fn run_target);
+
+#endif // TEST_TARGETS_H
@@ -0,0 +1,28 @@
+#ifndef TEST_TIMEOUT_H
+#define TEST_TIMEOUT_H
+
+#include <lua.h>
+
+#include <stdbool.h>
+
+// Arms timeout of `ms` milliseconds for the test which is about to run in
+// `L` by the current runner, does nothing if `ms` is 0. Once the deadline
+// passes, the test is interrupted with an error from a count hook and the
+// thread running it is signalled to interrupt blocking system calls.
+void test_timeout_arm(lua_State *L, unsigned long ms);
+
+// Disarms the timeout of the current test and restores the hook of `L`.
+// Returns true if the test has timed out.
+bool test_timeout_disarm(lua_State *L);
+
+// Raises timeout error if the current test is past its deadline
+void test_timeout_check(lua_State *L);
+
+// Milliseconds left for the current test, -1 if it has no timeout
+long test_timeout_remaining_ms();
+
+// Clamps `timeout_ms` of a blocking call (0 meaning no timeout) to the time
+// left for the current test. Never returns 0 if the test has a timeout.
+int test_timeout_clamp(int timeout_ms);
+
+#endif // TEST_TIMEOUT_H
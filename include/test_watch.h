@@ -0,0 +1,20 @@
+#ifndef TEST_WATCH_H
+#define TEST_WATCH_H
+
+#include "util/files.h"
+
+typedef struct test_watch test_watch_t;
+
+// Returns NULL if watching is not supported or failed
+test_watch_t *test_watch_new();
+
+// Watches `dir` and all its subdirectories, returns 0 on success
+int test_watch_add(test_watch_t *watch, const char *dir);
+
+// Blocks until Lua files change, returns paths of the changed files.
+// Returns empty array on error.
+str_array_t test_watch_wait(test_watch_t *watch);
+
+void test_watch_free(test_watch_t *watch);
+
+#endif // TEST_WATCH_H
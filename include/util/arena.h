@@ -0,0 +1,31 @@
+#ifndef UTIL_ARENA_H
+#define UTIL_ARENA_H
+
+#include <stddef.h>
+
+typedef struct arena_chunk arena_chunk_t;
+
+// Bump allocator freeing everything at once. Zero initialized arena is empty.
+typedef struct {
+    arena_chunk_t *chunks; // current chunk first
+    size_t chunk_size;
+
+    // Open addressing set of interned strings
+    char **interned;
+    size_t interned_cap;
+    size_t interned_count;
+} arena_t;
+
+void *arena_alloc(arena_t *arena, size_t size);
+
+char *arena_strndup(arena_t *arena, const char *s, size_t len);
+
+char *arena_strdup(arena_t *arena, const char *s);
+
+// Returns the copy of `s` in `arena`, the same one for equal strings
+char *arena_intern(arena_t *arena, const char *s);
+
+// Frees all the memory of `arena` & makes it empty
+void arena_free(arena_t *arena);
+
+#endif // UTIL_ARENA_H
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <sys/types.h>
 
 #define MKDIR_MODE 0700
 
@@ -23,6 +24,15 @@ typedef struct {
 
 str_array_t list_lua_recursive(const char *root);
 
+// Appends a copy of `s`, returns 0 on success
+int str_array_push(str_array_t *a, const char *s);
+
 void free_str_array(str_array_t *a);
 
+// Writes whole buffer to `fd`, returns 0 on success
+int fd_write_full(int fd, const void *buf, size_t len);
+
+// Reads `len` bytes from `fd`, returns less only on EOF
+ssize_t fd_read_full(int fd, void *buf, size_t len);
+
 #endif // UTIL_FILES_H
@@ -0,0 +1,18 @@
+#ifndef UTIL_GZIP_H
+#define UTIL_GZIP_H
+
+#include <stdio.h>
+
+#define GZIP_SUFFIX ".gz"
+
+// Creates gzip file `path`, everything written to the returned stream is
+// compressed. Data is compressed in blocks of 1 MiB, each one written as a
+// separate gzip member, so fflush() doesn't hurt the compression ratio and
+// the file is complete only after fclose(). Returns NULL on error.
+FILE *gzip_fopen_write(const char *path);
+
+// Opens `path` for reading, decompressing it if it is a gzip file. Returns
+// NULL on error.
+FILE *gzip_fopen_read(const char *path);
+
+#endif // UTIL_GZIP_H
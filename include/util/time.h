@@ -1,10 +1,9 @@
 #ifndef UTIL_TIME_H
 #define UTIL_TIME_H
 
-void reset_millis(void);
-unsigned long millis_since_start(void);
 void reset_taf_start_millis(void);
 unsigned long millis_since_taf_start(void);
+unsigned long millis_monotonic(void);
 
 #define TS_LEN 18 // "MM.DD.YY-HH:mm:ss" + '\0'
 
@@ -43,15 +43,33 @@ M.millis = function()
 	return tm:millis()
 end
 
+--- @class test_options
+--- @field tags [string]? tags of the test
+--- @field timeout integer? milliseconds after which the test fails
+
 --- Register new test
 ---
 --- @param test_name string name of the test
---- @param tags_or_body [string]|function either array of test tags or test body
---- @param body function|nil body of the test if previous argument is tags
+--- @param tags_or_body [string]|test_options|function array of test tags, test options or test body
+--- @param body function|nil body of the test if previous argument is tags or options
 M.test = function(test_name, tags_or_body, body)
 	tm:test(test_name, tags_or_body, body)
 end
 
+--- Register test for every row of the data
+---
+--- Rows are either an array or a path to `.csv`, `.json` (array) or `.jsonl`
+--- file relative to the test file. Files are read row by row when needed.
+--- Rows of CSV file are tables keyed by the header of the file.
+---
+--- @param name_fmt string name of the tests, `${key}` is replaced with the field of the row, `${#}` with the row number, names must be unique
+--- @param rows [any]|string rows or path to the file with rows
+--- @param tags_or_body [string]|test_options|function(row: any) array of test tags, test options or test body
+--- @param body function(row: any)|nil body of the test if previous argument is tags or options
+M.test_each = function(name_fmt, rows, tags_or_body, body)
+	tm:test_each(name_fmt, rows, tags_or_body, body)
+end
+
 --- @param defer_func function function executed on defer
 --- @param ... any arguments to pass to the function
 M.defer = function(defer_func, ...)
@@ -40,16 +40,16 @@ end
 
 --- @param opts run_opts
 --- @param timeout integer? timeout in milliseconds. keep nil for indefinite waiting
---- @param sleepinterval integer? interval in milliseconds between checking for timeout. Default: 20
+--- @param sleepinterval integer? interval in milliseconds between checking on the process. Default: 20
 ---
 --- @return run_result result
 M.run = function(opts, timeout, sleepinterval)
 	local handle = M.spawn(opts)
 	local status = nil
+	local interval = sleepinterval or 20
 	if timeout then
 		local start = tm:millis()
 		local deadline = start + timeout
-		local interval = sleepinterval or 20
 		while status == nil do
 			if tm:millis() >= deadline then
 				error("timeout")
@@ -58,7 +58,9 @@ M.run = function(opts, timeout, sleepinterval)
 			status = handle:wait()
 		end
 	else
+		status = handle:wait()
 		while status == nil do
+			tm:sleep(interval)
 			status = handle:wait()
 		end
 	end
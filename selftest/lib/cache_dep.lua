@@ -0,0 +1,8 @@
+--- Required by the bootstrap cache tests, editing it invalidates their cache
+local M = {}
+
+M.value = function()
+	return "cache dependency"
+end
+
+return M
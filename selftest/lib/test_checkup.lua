@@ -130,4 +130,41 @@ M.check_output = function(test, output, expected_message, expected_level, contai
 	return nil, output
 end
 
+--- @param test test_t
+--- @param field string
+--- @param expected [output_t]?
+--- @param actual [output_t]?
+local check_same_outputs = function(test, field, expected, actual)
+	expected = expected or {}
+	actual = actual or {}
+	util.error_if(
+		#actual ~= #expected,
+		test,
+		("test.%s has %d entries, expected %d"):format(field, #actual, #expected)
+	)
+	for i = 1, math.min(#expected, #actual) do
+		local e, a = expected[i], actual[i]
+		util.error_if(
+			a.file ~= e.file or a.line ~= e.line or a.level ~= e.level or a.msg ~= e.msg,
+			test,
+			("test.%s[%d] is '%s', expected '%s'"):format(field, i, a.msg, e.msg)
+		)
+	end
+end
+
+--- Checks that `actual` has the same result & outputs as `expected` of another run
+--- @param expected test_t
+--- @param actual test_t?
+M.check_same_test = function(expected, actual)
+	M.check_test(actual, expected.name, expected.status)
+	if actual == nil or actual.name ~= expected.name then
+		return
+	end
+	util.test_tags(actual, expected.tags)
+	check_same_outputs(actual, "output", expected.output, actual.output)
+	check_same_outputs(actual, "failure_reasons", expected.failure_reasons, actual.failure_reasons)
+	check_same_outputs(actual, "teardown_output", expected.teardown_output, actual.teardown_output)
+	check_same_outputs(actual, "teardown_errors", expected.teardown_errors, actual.teardown_errors)
+end
+
 return M
@@ -75,18 +75,28 @@ end
 --- @field tests [test_t]
 
 --- @param args [string]
---- @return log_obj_t
-M.load_log = function(args)
+--- @return string stdout
+M.run_taf = function(args)
 	local proc_handle = proc.spawn({
 		exe = "taf",
 		args = args,
 	})
+	local out = {}
 	while proc_handle:wait() == nil do
-		proc_handle:read() -- flush stdout to not hang on large buffers
+		out[#out + 1] = proc_handle:read() -- flush stdout to not hang on large buffers
 	end
+	out[#out + 1] = proc_handle:read()
 	proc_handle:kill()
+	return table.concat(out)
+end
 
-	local log_file = io.open("logs/bootstrap/test_run_latest_raw.json", "r")
+--- @param args [string]
+--- @param log_path string? JSON raw log to load, the latest one by default
+--- @return log_obj_t
+M.load_log = function(args, log_path)
+	M.run_taf(args)
+
+	local log_file = io.open(log_path or "logs/bootstrap/test_run_latest_raw.json", "r")
 
 	assert(log_file)
 
@@ -117,4 +127,13 @@ M.load_log = function(args)
 	return log_obj
 end
 
+--- Output of `taf logs info` of the raw log `log_path` with outputs, timestamps
+--- are replaced, so logs of different runs can be compared
+--- @param log_path string
+--- @return string
+M.logs_info = function(log_path)
+	local info = M.run_taf({ "logs", "info", log_path, "-o" })
+	return (info:gsub("%d%d%.%d%d%.%d%d%-%d%d:%d%d:%d%d", "<time>"))
+end
+
 return M
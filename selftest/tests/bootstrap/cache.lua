@@ -0,0 +1,13 @@
+local taf = require("taf")
+
+local dep = require("cache_dep")
+
+-- Files of these tests are edited by the selftest to invalidate their cache
+
+taf.test("Test cache", { "module-taf", "cache" }, function()
+	taf.log_info(dep.value())
+end)
+
+taf.test_each("Test cache row ${value}", "data/cache.csv", { "module-taf", "cache" }, function(row)
+	taf.log_info(row.value)
+end)
@@ -87,6 +87,14 @@ taf.test("Test Lua's 'print' is forwarded to logging with INFO log level", { "mo
 	taf.print("Testing logging")
 end)
 
+taf.test("Test logging large messages", { "module-taf", "large-log" }, function()
+	for i = 1, 3 do
+		taf.log_info(("x"):rep(100000 * i))
+		taf.log_info("small " .. i)
+	end
+	taf.log_error(("e"):rep(50000))
+end)
+
 taf.test("Test taf.sleep", { "module-taf", "utils" }, function()
 	taf.sleep(1000)
 end)
@@ -143,3 +151,38 @@ taf.test("Test taf.get_active_test_tags", { "module-taf", "utils", "some-other-t
 		taf.log_info(value)
 	end
 end)
+
+taf.test("Test timeout of a busy loop", { tags = { "module-taf", "timeout" }, timeout = 100 }, function()
+	taf.defer(function(status)
+		taf.log_info("timeout defer " .. status)
+	end)
+	while true do
+	end
+end)
+
+taf.test("Test timeout of taf.sleep", { tags = { "module-taf", "timeout" }, timeout = 100 }, function()
+	taf.sleep(10000)
+end)
+
+taf.test("Test timeout caught by pcall", { tags = { "module-taf", "timeout" }, timeout = 100 }, function()
+	pcall(function()
+		while true do
+		end
+	end)
+end)
+
+taf.test("Test finishing before timeout", { tags = { "module-taf", "timeout" }, timeout = 1000 }, function()
+	taf.sleep(10)
+end)
+
+taf.test_each("Test taf.test_each row ${#}: ${1} + ${2}", { { 1, 2 }, { 2, 3 } }, { "module-taf", "test_each" }, function(row)
+	taf.log_info(row[1] + row[2])
+end)
+
+taf.test_each("Test taf.test_each CSV user ${user}", "data/test_each.csv", { "module-taf", "test_each" }, function(row)
+	taf.log_info(row.user .. " " .. row.role)
+end)
+
+taf.test_each("Test taf.test_each JSON square of ${input}", "data/test_each.json", { "module-taf", "test_each" }, function(row)
+	assert(row.input * row.input == row.expected)
+end)
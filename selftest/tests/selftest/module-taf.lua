@@ -101,6 +101,29 @@ taf.test("Test module-taf (logging)", { "module-taf", "logging" }, function()
 	end
 end)
 
+taf.test("Test module-taf (large-log)", { "module-taf", "large-log" }, function()
+	local log_obj = util.load_log({ "test", "bootstrap", "-t", "large-log", "-e" })
+
+	assert(log_obj.tests ~= nil)
+	assert(#log_obj.tests == 1, "Expected 1 test, got " .. #log_obj.tests)
+
+	local test = log_obj.tests[1]
+	check.check_test(test, "Test logging large messages", "failed")
+	util.test_tags(test, { "module-taf", "large-log" })
+	util.error_if(#test.output ~= 7, test, "Outputs not match")
+	util.error_if(#test.failure_reasons ~= 1, test, "Outputs not match")
+	if #test.output == 7 then
+		for i = 1, 3 do
+			util.error_if(test.output[i * 2 - 1].msg ~= ("x"):rep(100000 * i), test, "Large message not match")
+			check.check_output(test, test.output[i * 2], "small " .. i, "INFO")
+		end
+		util.error_if(test.output[7].msg ~= ("e"):rep(50000), test, "Large message not match")
+	end
+	if #test.failure_reasons == 1 then
+		util.error_if(test.failure_reasons[1].msg ~= ("e"):rep(50000), test, "Failure reason not match")
+	end
+end)
+
 taf.test("Test module-taf (utils)", { "module-taf", "utils" }, function()
 	local log_obj = util.load_log({ "test", "bootstrap", "-t", "utils,other-tag,some-other-tag", "-e" })
 
@@ -168,3 +191,397 @@ taf.test("Test module-taf (utils)", { "module-taf", "utils" }, function()
 	check.check_output(test, test.output[1], "utils", "INFO")
 	check.check_output(test, test.output[2], "some-other-tag", "INFO")
 end)
+
+taf.test("Test module-taf (timeout)", { "module-taf", "timeout" }, function()
+	local log_obj = util.load_log({ "test", "bootstrap", "-t", "timeout", "-e" })
+
+	assert(log_obj.tests ~= nil)
+	assert(#log_obj.tests == 4, "Expected 4 tests, got " .. #log_obj.tests)
+
+	local test = log_obj.tests[1]
+	check.check_test(test, "Test timeout of a busy loop", "failed")
+	util.test_tags(test, { "module-taf", "timeout" })
+	util.error_if(#test.failure_reasons ~= 1, test, "Outputs not match")
+	if #test.failure_reasons == 1 then
+		check.check_output(test, test.failure_reasons[1], "Test timed out after 100 ms", "CRITICAL", true)
+		util.error_if(
+			test.failure_reasons[1].msg:find("stack traceback:") == nil,
+			test,
+			"Unable to find traceback"
+		)
+	end
+	util.error_if(#test.teardown_output ~= 1, test, "Outputs not match")
+	check.check_output(test, test.teardown_output[1], "timeout defer failed", "INFO")
+
+	test = log_obj.tests[2]
+	check.check_test(test, "Test timeout of taf.sleep", "failed")
+	util.test_tags(test, { "module-taf", "timeout" })
+	util.error_if(#test.failure_reasons ~= 1, test, "Outputs not match")
+	if #test.failure_reasons == 1 then
+		check.check_output(test, test.failure_reasons[1], "Test timed out after 100 ms", "CRITICAL", true)
+	end
+
+	test = log_obj.tests[3]
+	check.check_test(test, "Test timeout caught by pcall", "failed")
+	util.test_tags(test, { "module-taf", "timeout" })
+	util.error_if(#test.failure_reasons ~= 1, test, "Outputs not match")
+	if #test.failure_reasons == 1 then
+		check.check_output(test, test.failure_reasons[1], "Test timed out after 100 ms", "CRITICAL", true)
+	end
+
+	test = log_obj.tests[4]
+	check.check_test(test, "Test finishing before timeout", "passed")
+	util.test_tags(test, { "module-taf", "timeout" })
+end)
+
+taf.test("Test module-taf (test_each)", { "module-taf", "test_each" }, function()
+	local log_obj = util.load_log({ "test", "bootstrap", "-t", "test_each", "-e" })
+
+	assert(log_obj.tests ~= nil)
+	assert(#log_obj.tests == 6, "Expected 6 tests, got " .. #log_obj.tests)
+
+	local test = log_obj.tests[1]
+	check.check_test(test, "Test taf.test_each row 1: 1 + 2", "passed")
+	util.test_tags(test, { "module-taf", "test_each" })
+	util.error_if(#test.output ~= 1, test, "Outputs not match")
+	check.check_output(test, test.output[1], "3", "INFO")
+
+	test = log_obj.tests[2]
+	check.check_test(test, "Test taf.test_each row 2: 2 + 3", "passed")
+	util.error_if(#test.output ~= 1, test, "Outputs not match")
+	check.check_output(test, test.output[1], "5", "INFO")
+
+	test = log_obj.tests[3]
+	check.check_test(test, "Test taf.test_each CSV user alice", "passed")
+	util.error_if(#test.output ~= 1, test, "Outputs not match")
+	check.check_output(test, test.output[1], "alice admin", "INFO")
+
+	test = log_obj.tests[4]
+	check.check_test(test, "Test taf.test_each CSV user bob, jr", "passed")
+	util.error_if(#test.output ~= 1, test, "Outputs not match")
+	check.check_output(test, test.output[1], "bob, jr viewer", "INFO")
+
+	test = log_obj.tests[5]
+	check.check_test(test, "Test taf.test_each JSON square of 2", "passed")
+
+	test = log_obj.tests[6]
+	check.check_test(test, "Test taf.test_each JSON square of 3", "passed")
+end)
+
+taf.test("Test module-taf (parallel)", { "module-taf", "parallel" }, function()
+	local serial = util.load_log({ "test", "bootstrap", "-t", "logging", "-e" })
+
+	local runs = {
+		{ "-j", "2" },
+		{ "-j", "2", "--threads" },
+		{ "--isolate" },
+		{ "-c", "2" },
+	}
+	for _, opts in ipairs(runs) do
+		local args = { "test", "bootstrap", "-t", "logging", "-e" }
+		for _, opt in ipairs(opts) do
+			args[#args + 1] = opt
+		end
+		local log_obj = util.load_log(args)
+
+		local run = table.concat(opts, " ")
+		assert(log_obj.tests ~= nil)
+		assert(
+			#log_obj.tests == #serial.tests,
+			("'%s': expected %d tests, got %d"):format(run, #serial.tests, #log_obj.tests)
+		)
+		for i, test in ipairs(serial.tests) do
+			check.check_same_test(test, log_obj.tests[i])
+		end
+	end
+end)
+
+taf.test("Test module-taf (log formats)", { "module-taf", "log-formats" }, function()
+	local args = { "test", "bootstrap", "-t", "logging", "-e" }
+	util.load_log(args)
+	local expected = util.logs_info("logs/bootstrap/test_run_latest_raw.json")
+	assert(expected:find("Test [1]", nil, true), "Unable to read the JSON raw log")
+
+	local formats = {
+		{ opts = { "--raw-log-format", "jsonl" }, file = "test_run_latest_raw.jsonl" },
+		{ opts = { "--raw-log-format", "binary" }, file = "test_run_latest_raw.bin" },
+		{ opts = { "--compress-logs" }, file = "test_run_latest_raw.json.gz" },
+		{ opts = { "--raw-log-format", "jsonl", "--compress-logs" }, file = "test_run_latest_raw.jsonl.gz" },
+	}
+	for _, format in ipairs(formats) do
+		local path = "logs/bootstrap/" .. format.file
+		-- Don't read the log of a previous run
+		os.remove(path)
+
+		local run_args = { table.unpack(args) }
+		for _, opt in ipairs(format.opts) do
+			run_args[#run_args + 1] = opt
+		end
+		util.run_taf(run_args)
+
+		if path:sub(-3) == ".gz" then
+			local file = io.open(path, "rb")
+			assert(file, ("'%s' not found"):format(path))
+			local magic = file:read(2)
+			file:close()
+			assert(magic == "\31\139", ("'%s' is not gzip compressed"):format(path))
+		end
+
+		local info = util.logs_info(path)
+		assert(info == expected, ("'%s' differs from the JSON raw log:\n%s"):format(path, info))
+	end
+end)
+
+taf.test("Test module-taf (cache)", { "module-taf", "cache" }, function()
+	local args = { "test", "bootstrap", "-t", "cache", "-e", "--cache" }
+	local names = { "Test cache", "Test cache row 1", "Test cache row 2" }
+	local cache_msg = "Unchanged since it passed, result reused from cache."
+
+	--- @param step string
+	--- @param cached { [string]: boolean } tests expected to be reported from cache
+	local function check_cached(step, cached)
+		local log_obj = util.load_log(args)
+		assert(log_obj.tests ~= nil)
+		assert(#log_obj.tests == #names, ("%s: expected %d tests, got %d"):format(step, #names, #log_obj.tests))
+		for i, name in ipairs(names) do
+			local test = log_obj.tests[i]
+			check.check_test(test, name, "passed")
+			local is_cached = test.output[1] ~= nil and test.output[1].msg == cache_msg
+			util.error_if(
+				is_cached ~= (cached[name] == true),
+				test,
+				("%s: expected to be %s"):format(step, cached[name] and "cached" or "run")
+			)
+		end
+	end
+
+	--- Edits `path` & runs the tests twice: the edit invalidates `invalidated`
+	--- tests and restoring the file invalidates them again
+	--- @param path string
+	--- @param edit fun(content: string): string
+	--- @param invalidated [string]
+	local function check_edit(path, edit, invalidated)
+		local file = io.open(path, "r")
+		assert(file, ("'%s' not found"):format(path))
+		local content = file:read("a")
+		file:close()
+
+		local function write(str)
+			local f = io.open(path, "w")
+			assert(f)
+			f:write(str)
+			f:close()
+		end
+		taf.defer(write, content)
+
+		local cached = {}
+		for _, name in ipairs(names) do
+			cached[name] = true
+		end
+		for _, name in ipairs(invalidated) do
+			cached[name] = false
+		end
+
+		write(edit(content))
+		check_cached("edited " .. path, cached)
+		write(content)
+		check_cached("restored " .. path, cached)
+	end
+
+	-- Start from an empty cache
+	os.remove(".taf_cache/results/bootstrap.json")
+	check_cached("first run", {})
+	local all = {}
+	for _, name in ipairs(names) do
+		all[name] = true
+	end
+	check_cached("second run", all)
+
+	local function add_comment(content)
+		return content .. "\n-- edited by the cache selftest\n"
+	end
+	check_edit("tests/bootstrap/cache.lua", add_comment, names)
+	check_edit("lib/cache_dep.lua", add_comment, names)
+	check_edit("hooks/hooks.lua", add_comment, names)
+	check_edit("tests/bootstrap/data/cache.csv", function(content)
+		return (content:gsub("second", "edited"))
+	end, { "Test cache row 1", "Test cache row 2" })
+end)
+
+taf.test("Test module-taf (shard)", { "module-taf", "shard" }, function()
+	local args = { "test", "bootstrap", "-t", "logging", "-e" }
+	local full = util.load_log(args)
+	assert(full.tests ~= nil and #full.tests > 0)
+
+	-- The latest raw log is replaced by the shard runs
+	local latest_path = "logs/bootstrap/test_run_latest_raw.json"
+	local history_path = "logs/shard_history_raw.json"
+	local src = io.open(latest_path, "r")
+	assert(src)
+	local dst = io.open(history_path, "w")
+	assert(dst)
+	dst:write(src:read("a"))
+	src:close()
+	dst:close()
+	taf.defer(os.remove, history_path)
+
+	local shard_count = 3
+	for _, history in ipairs({ {}, { "--shard-history", history_path } }) do
+		local run = #history == 0 and "by name" or "by history"
+		local seen = {}
+		for i = 1, shard_count do
+			local run_args = { table.unpack(args) }
+			run_args[#run_args + 1] = "--shard"
+			run_args[#run_args + 1] = ("%d/%d"):format(i, shard_count)
+			for _, opt in ipairs(history) do
+				run_args[#run_args + 1] = opt
+			end
+			-- A shard may get no tests, then no log is written
+			os.remove(latest_path)
+			util.run_taf(run_args)
+			local file = io.open(latest_path, "r")
+			local tests = {}
+			if file then
+				tests = taf.json.deserialize(file:read("a")).tests or {}
+				file:close()
+			end
+			for _, test in ipairs(tests) do
+				assert(not seen[test.name], ("%s: '%s' is in more than one shard"):format(run, test.name))
+				seen[test.name] = true
+			end
+		end
+		for _, test in ipairs(full.tests) do
+			assert(seen[test.name], ("%s: '%s' is in no shard"):format(run, test.name))
+		end
+	end
+end)
+
+taf.test("Test module-taf (serve)", { "module-taf", "serve" }, function()
+	local socket = "logs/selftest_serve.sock"
+	local daemon = taf.proc.spawn({ exe = "taf", args = { "serve", "--socket", socket } })
+	taf.defer(function()
+		daemon:kill()
+	end)
+
+	--- Runs the tests with `tag` in the daemon, once it listens
+	--- @param tag string
+	--- @return run_result
+	local function request(tag)
+		local args = { "test", "bootstrap", "-t", tag, "-e", "--server", socket }
+		for _ = 1, 100 do
+			local result = taf.proc.run({ exe = "taf", args = { table.unpack(args) } }, 60000)
+			if not result.stderr:find("Unable to connect", 1, true) then
+				return result
+			end
+			taf.sleep(100)
+		end
+		error("taf serve did not start listening on " .. socket)
+	end
+
+	local passed = request("common")
+	assert(passed.exitcode == 0, ("Expected exit code 0, got %s:\n%s"):format(passed.exitcode, passed.stderr))
+	assert(passed.stdout:find("Test common TAF test", 1, true), "Test output is missing:\n" .. passed.stdout)
+	assert(not passed.stdout:find("taf-exit", 1, true), "Exit code trailer is printed:\n" .. passed.stdout)
+
+	local failed = request("logging")
+	assert(failed.exitcode == 1, ("Expected exit code 1, got %s:\n%s"):format(failed.exitcode, failed.stderr))
+	assert(not failed.stdout:find("taf-exit", 1, true), "Exit code trailer is printed:\n" .. failed.stdout)
+end)
+
+taf.test("Test module-taf (compact)", { "module-taf", "compact" }, function()
+	local result = taf.proc.run({
+		exe = "taf",
+		args = { "test", "bootstrap", "-t", "common,logging", "--compact" },
+	}, 60000)
+	assert(result.exitcode == 1, ("Expected exit code 1, got %s"):format(result.exitcode))
+
+	local log_file = io.open("logs/bootstrap/test_run_latest_raw.json", "r")
+	assert(log_file)
+	local log_obj = taf.json.deserialize(log_file:read("a"))
+	log_file:close()
+	assert(log_obj.tests ~= nil and #log_obj.tests == 14, "Expected 14 tests")
+
+	-- One line per test, failure reasons follow the line of a failed test
+	local header = "TAF v" .. log_obj.taf_version .. " started project 'selftest' (target 'bootstrap').\n"
+	local passed = {}
+	local failed = {}
+	for _, test in ipairs(log_obj.tests) do
+		if test.status == "passed" then
+			passed[#passed + 1] = ("%s PASSED '%s'\n"):format(test.finished, test.name)
+		else
+			failed[#failed + 1] = ("%s FAILED '%s'\n"):format(test.finished, test.name)
+			for _, reason in ipairs(test.failure_reasons) do
+				failed[#failed + 1] = ("    [%s] (%s:%d): %s\n"):format(reason.level, reason.file, reason.line, reason.msg)
+			end
+		end
+	end
+	local summary = ("\nTAF Test Run Finished.\n\nTotal: %d, Passed: %d, Failed: %d\n"):format(
+		#log_obj.tests,
+		#passed,
+		#log_obj.tests - #passed
+	)
+
+	local expected_stdout = header .. table.concat(passed) .. summary
+	local expected_stderr = table.concat(failed)
+	assert(
+		result.stdout == expected_stdout,
+		("stdout is:\n%s\nexpected:\n%s"):format(result.stdout, expected_stdout)
+	)
+	assert(
+		result.stderr == expected_stderr,
+		("stderr is:\n%s\nexpected:\n%s"):format(result.stderr, expected_stderr)
+	)
+end)
+
+taf.test("Test module-taf (targets)", { "module-taf", "targets" }, function()
+	--- @param args [string]
+	--- @param expected_exitcode integer
+	--- @param targets [string] targets expected to print output
+	--- @param summary [string] expected lines of the combined summary
+	local function check_targets(args, expected_exitcode, targets, summary)
+		local run = table.concat(args, " ")
+		local result = taf.proc.run({ exe = "taf", args = args }, 60000)
+		assert(
+			result.exitcode == expected_exitcode,
+			("'%s': expected exit code %d, got %s"):format(run, expected_exitcode, result.exitcode)
+		)
+
+		local output, rest = result.stdout:match("^(.-)\nTAF Targets Run Finished%.\n\n(.*)$")
+		assert(output, ("'%s': summary is missing:\n%s"):format(run, result.stdout))
+
+		-- Everything after the header is printed by the targets
+		local seen = {}
+		local header = true
+		for line in output:gmatch("([^\n]*)\n?") do
+			if header then
+				header = line ~= "-----------"
+			elseif line ~= "" then
+				local target = line:match("^%[([^%]]+)%] ")
+				assert(target, ("'%s': line without target prefix: '%s'"):format(run, line))
+				seen[target] = true
+			end
+		end
+		for _, target in ipairs(targets) do
+			assert(seen[target], ("'%s': no output of target '%s'"):format(run, target))
+		end
+
+		local expected = table.concat(summary, "\n") .. "\n"
+		assert(rest == expected, ("'%s': summary is:\n%s\nexpected:\n%s"):format(run, rest, expected))
+	end
+
+	check_targets({ "test", "--targets", "bootstrap", "-t", "common,some-other-tag" }, 0, { "bootstrap" }, {
+		"Target 'bootstrap': PASSED, Total: 2, Passed: 2, Failed: 0",
+		"-----------",
+		"Targets: 1, Passed: 1, Failed: 0",
+		"Total: 2, Passed: 2, Failed: 0",
+	})
+
+	-- Only bootstrap has tests with this tag
+	check_targets({ "test", "--targets", "all", "-t", "some-other-tag" }, 1, { "bootstrap", "selftest" }, {
+		"Target 'bootstrap': PASSED, Total: 1, Passed: 1, Failed: 0",
+		"Target 'selftest': FAILED, Total: 0, Passed: 0, Failed: 0",
+		"-----------",
+		"Targets: 2, Passed: 1, Failed: 1",
+		"Total: 1, Passed: 1, Failed: 0",
+	})
+end)
@@ -0,0 +1,231 @@
+#include "bytecode_cache.h"
+
+#include "internal_logging.h"
+
+#include "util/files.h"
+
+#include <lauxlib.h>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <sys/syslimits.h>
+#else
+#include <limits.h>
+#endif // __APPLE__
+
+#define BYTECODE_CACHE_MAGIC "TAFLUAC"
+#define BYTECODE_CACHE_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t lua_version;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t size;
+    uint64_t path_len; // source path follows the header, then the bytecode
+} cache_header_t;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} dump_buffer_t;
+
+static char *cache_dir = NULL;
+
+void bytecode_cache_init(const char *dir) {
+    LOG("Bytecode cache directory: %s", dir);
+    free(cache_dir);
+    cache_dir = strdup(dir);
+}
+
+void bytecode_cache_deinit() {
+    free(cache_dir);
+    cache_dir = NULL;
+}
+
+static void fill_header(cache_header_t *header, const char *path,
+                        struct stat *sb) {
+    memset(header, 0, sizeof *header);
+    memcpy(header->magic, BYTECODE_CACHE_MAGIC, sizeof header->magic);
+    header->version = BYTECODE_CACHE_VERSION;
+    header->lua_version = LUA_VERSION_NUM;
+    header->mtime_sec = sb->st_mtime;
+#ifdef __APPLE__
+    header->mtime_nsec = sb->st_mtimespec.tv_nsec;
+#else
+    header->mtime_nsec = sb->st_mtim.tv_nsec;
+#endif // __APPLE__
+    header->size = sb->st_size;
+    header->path_len = strlen(path);
+}
+
+static void get_cache_path(const char *path, char buf[PATH_MAX]) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const char *p = path; *p; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 1099511628211ull;
+    }
+    snprintf(buf, PATH_MAX, "%s/%016" PRIx64 ".luac", cache_dir, hash);
+}
+
+static bool load_cached(lua_State *L, const char *path, cache_header_t *header,
+                        const char *cache_path) {
+    int fd = open(cache_path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    bool loaded = false;
+    char *buf = NULL;
+    struct stat sb;
+    cache_header_t cached;
+    if (fstat(fd, &sb) ||
+        (size_t)sb.st_size < sizeof cached + header->path_len ||
+        fd_read_full(fd, &cached, sizeof cached) != sizeof cached ||
+        memcmp(&cached, header, sizeof cached)) {
+        goto out;
+    }
+
+    size_t len = sb.st_size - sizeof cached;
+    buf = malloc(len);
+    if (!buf || fd_read_full(fd, buf, len) != (ssize_t)len ||
+        memcmp(buf, path, header->path_len)) {
+        goto out;
+    }
+
+    if (luaL_loadbufferx(L, buf + header->path_len, len - header->path_len,
+                         path, "b") != LUA_OK) {
+        LOG("Unable to load cached chunk of '%s': %s", path,
+            lua_tostring(L, -1));
+        lua_pop(L, 1);
+        goto out;
+    }
+    loaded = true;
+
+out:
+    free(buf);
+    close(fd);
+    return loaded;
+}
+
+static int dump_writer(lua_State *L, const void *p, size_t sz, void *ud) {
+    dump_buffer_t *b = ud;
+    if (b->len + sz > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        while (cap < b->len + sz) {
+            cap *= 2;
+        }
+        char *data = realloc(b->data, cap);
+        if (!data) {
+            return 1;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, p, sz);
+    b->len += sz;
+    return 0;
+}
+
+// Saves chunk on top of the stack
+static void save_cached(lua_State *L, const char *path, cache_header_t *header,
+                        const char *cache_path) {
+    dump_buffer_t b = {0};
+    // Debug info is kept for the tracebacks & line hooks
+    if (lua_dump(L, dump_writer, &b, 0)) {
+        LOG("Unable to dump chunk of '%s'.", path);
+        free(b.data);
+        return;
+    }
+
+    if (create_directory(cache_dir, MKDIR_MODE)) {
+        LOG("Unable to create bytecode cache directory '%s'.", cache_dir);
+        free(b.data);
+        return;
+    }
+
+    // Written to a temporary file first, other runners may be reading it
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, PATH_MAX, "%s.XXXXXX", cache_path);
+    int fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        LOG("Unable to create '%s'.", tmp_path);
+        free(b.data);
+        return;
+    }
+    if (fd_write_full(fd, header, sizeof *header) ||
+        fd_write_full(fd, path, header->path_len) ||
+        fd_write_full(fd, b.data, b.len) || close(fd)) {
+        LOG("Unable to write '%s'.", tmp_path);
+        unlink(tmp_path);
+    } else if (rename(tmp_path, cache_path)) {
+        LOG("Unable to rename '%s' to '%s'.", tmp_path, cache_path);
+        unlink(tmp_path);
+    }
+    free(b.data);
+}
+
+int bytecode_cache_loadfile(lua_State *L, const char *path) {
+    struct stat sb;
+    if (!cache_dir || stat(path, &sb)) {
+        return luaL_loadfile(L, path);
+    }
+
+    cache_header_t header;
+    fill_header(&header, path, &sb);
+    char cache_path[PATH_MAX];
+    get_cache_path(path, cache_path);
+
+    if (load_cached(L, path, &header, cache_path)) {
+        LOG("Loaded '%s' from bytecode cache.", path);
+        return LUA_OK;
+    }
+
+    int rc = luaL_loadfile(L, path);
+    if (rc == LUA_OK) {
+        LOG("Caching bytecode of '%s'...", path);
+        save_cached(L, path, &header, cache_path);
+    }
+    return rc;
+}
+
+static int searcher_cached(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchpath");
+    lua_pushstring(L, name);
+    lua_getfield(L, -3, "path");
+    lua_call(L, 2, 2);
+    if (lua_isnil(L, -2)) {
+        return 1; /* error message of searchpath */
+    }
+    lua_pop(L, 1);
+
+    const char *filename = lua_tostring(L, -1);
+    if (bytecode_cache_loadfile(L, filename) != LUA_OK) {
+        return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s",
+                          name, filename, lua_tostring(L, -1));
+    }
+    lua_pushstring(L, filename);
+    return 2;
+}
+
+void bytecode_cache_install_searcher(lua_State *L) {
+    LOG("Installing cached Lua searcher...");
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchers");
+    lua_pushcfunction(L, searcher_cached);
+    lua_rawseti(L, -2, 2); /* replaces the Lua file searcher */
+    lua_pop(L, 2);         /* pop searchers + package */
+}
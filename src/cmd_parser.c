@@ -49,6 +49,46 @@ static void print_test_help(FILE *file) {
             "Dump internal logging file\n"
             "  -e, --headless                                              "
             "Run in headless mode (no TUI)\n"
+            "      --compact                                               "
+            "Print one line per test & failures only (headless)\n"
+            "  -j, --jobs <N>                                              "
+            "Run tests in N parallel worker processes\n"
+            "      --threads                                               "
+            "Run --jobs workers as threads with separate Lua states\n"
+            "  -c, --concurrent <N>                                        "
+            "Run up to N tests concurrently as coroutines\n"
+            "  -T, --targets <t1,t2|all>                                   "
+            "Run several targets in parallel (multitarget projects)\n"
+            "  -s, --shard <i/n>                                           "
+            "Run only the i-th of n shards of the tests\n"
+            "      --shard-history <file>                                  "
+            "Balance shards by the test durations in a raw log\n"
+            "  -o, --order <failed-first|longest-first>                    "
+            "Order tests using the previous runs\n"
+            "      --cache                                                 "
+            "Skip unchanged tests which passed before\n"
+            "  -w, --watch                                                 "
+            "Rerun affected tests when project files change\n"
+            "  -S, --server <socket>                                       "
+            "Run tests in a running 'taf serve' daemon\n"
+            "      --test-timeout <ms>                                     "
+            "Fail tests running longer than <ms> milliseconds\n"
+            "      --isolate                                               "
+            "Run every test in its own forked process\n"
+            "      --progress-sampling                                     "
+            "Sample the current line instead of tracing every line\n"
+            "      --coverage                                              "
+            "Write line coverage of tests & lib to logs/coverage.info\n"
+            "      --profile                                               "
+            "Write sampled Lua stacks of every test next to the logs\n"
+            "      --tui-scrollback <lines>                                "
+            "Log lines kept by the TUI (default 1000)\n"
+            "      --raw-log-format <json|jsonl|binary>                    "
+            "Format of the raw log (default json)\n"
+            "      --log-overflow <block|drop>                             "
+            "Wait for or drop output log records on slow disk\n"
+            "      --compress-logs                                         "
+            "Write gzip compressed log files\n"
             "  -h, --help                                                  "
             "Display help\n");
 }
@@ -68,12 +108,13 @@ static void print_logs_help(FILE *file) {
 
 static void print_logs_info_help(FILE *file) {
     fprintf(file, "Usage: taf logs info <latest>\n"
-                  "       taf logs info <test_run_raw_json_file>\n"
+                  "       taf logs info <test_run_raw_log_file>\n"
                   "\n"
                   "Display information about the test run.\n"
                   "\n"
                   "Options:\n"
                   "  -o, --outputs            Include outputs\n"
+                  "  -t, --test <n|name>      Show only one test\n"
                   "  -i, --internal-log       Dump internal logging file\n"
                   "  -h, --help               Display help\n");
 }
@@ -110,14 +151,31 @@ static void print_target_remove_help(FILE *file) {
                   "  -h, --help               Display help\n");
 }
 
+static void print_serve_help(FILE *file) {
+    fprintf(file,
+            "Usage: taf serve [<options>]\n"
+            "\n"
+            "Load the project once and run tests requested with\n"
+            "'taf test --server <socket>', each in a forked process.\n"
+            "\n"
+            "Options:\n"
+            "  -s, --socket <path>          Socket path to listen on "
+            "(default: .taf_cache/serve.sock)\n"
+            "  -p, --taf-lib-path <path>    Specify custom path to TAF Lua "
+            "libraries\n"
+            "  -i, --internal-log           Dump internal logging file\n"
+            "  -h, --help                   Display help\n");
+}
+
 static void print_help(FILE *file) {
-    fprintf(file, "Usage: taf [<init|logs|target|test|help|version>]\n"
+    fprintf(file, "Usage: taf [<init|logs|serve|target|test|help|version>]\n"
                   "\n"
                   "TAF Testing Suite.\n"
                   "\n"
                   "Categories:\n"
                   "  init               Initialize new TAF project\n"
                   "  logs               Perform actions on TAF logs\n"
+                  "  serve              Run tests on request from a daemon\n"
                   "  target             Perform actions on project targets "
                   "(multitarget)\n"
                   "  test               Perform project tests\n"
@@ -169,6 +227,19 @@ cmd_logs_info_options *cmd_parser_get_logs_info_options() {
     return &logs_info_opts;
 }
 
+static cmd_serve_options serve_opts;
+cmd_serve_options *cmd_parser_get_serve_options() {
+    //
+    return &serve_opts;
+}
+
+static int parsed_argc = 0;
+static char **parsed_argv = NULL;
+void cmd_parser_get_args(int *argc, char ***argv) {
+    *argc = parsed_argc;
+    *argv = parsed_argv;
+}
+
 typedef struct {
     const char *long_opt;
     const char *short_opt;
@@ -303,6 +374,22 @@ static void set_test_tags(const char *arg) {
     }
 }
 
+static void set_test_targets(const char *arg) {
+    char *copy = strdup(arg);
+    size_t sz = strlen(arg) / 2 + 1;
+    char *targets[sz];
+    for (size_t i = 0; i < sz; i++) {
+        targets[i] = NULL;
+    }
+
+    test_opts.targets_amount = string_split_by_delim(copy, targets, ",", sz);
+    test_opts.targets = malloc(sizeof(char *) * test_opts.targets_amount);
+    for (size_t i = 0; i < test_opts.targets_amount; i++) {
+        test_opts.targets[i] = strdup(targets[i]);
+    }
+    free(copy);
+}
+
 static void set_test_no_logs(const char *) {
     //
     test_opts.no_logs = true;
@@ -318,6 +405,42 @@ static void set_log_level(const char *arg) {
     test_opts.log_level = log_level;
 }
 
+static void set_test_order(const char *arg) {
+    test_order_t order = test_order_from_str(arg);
+    if (order < 0) {
+        fprintf(stderr, "Unknown test order '%s'\n", arg);
+        exit(EXIT_FAILURE);
+    }
+
+    test_opts.order = order;
+}
+
+static void set_test_raw_log_format(const char *arg) {
+    raw_log_format_t format = taf_raw_log_format_from_str(arg);
+    if (format < 0) {
+        fprintf(stderr, "Unknown raw log format '%s'\n", arg);
+        exit(EXIT_FAILURE);
+    }
+
+    test_opts.raw_log_format = format;
+}
+
+static void set_test_log_overflow(const char *arg) {
+    if (STR_EQ(arg, "block")) {
+        test_opts.output_log_drop = false;
+    } else if (STR_EQ(arg, "drop")) {
+        test_opts.output_log_drop = true;
+    } else {
+        fprintf(stderr, "Unknown log overflow policy '%s'\n", arg);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void set_test_compress_logs(const char *) {
+    //
+    test_opts.compress_logs = true;
+}
+
 static void get_test_help(const char *) {
     print_test_help(stdout);
     exit(EXIT_SUCCESS);
@@ -332,6 +455,121 @@ static void set_test_headless(const char *) {
     test_opts.headless = true;
 }
 
+static void set_test_jobs(const char *arg) {
+    char *end = NULL;
+    long jobs = strtol(arg, &end, 10);
+    if (!end || *end != '\0' || jobs < 1) {
+        fprintf(stderr, "Invalid amount of jobs '%s'\n", arg);
+        exit(EXIT_FAILURE);
+    }
+
+    test_opts.jobs = jobs;
+}
+
+static void set_test_concurrent(const char *arg) {
+    char *end = NULL;
+    long concurrent = strtol(arg, &end, 10);
+    if (!end || *end != '\0' || concurrent < 1) {
+        fprintf(stderr, "Invalid amount of concurrent tests '%s'\n", arg);
+        exit(EXIT_FAILURE);
+    }
+
+    test_opts.concurrent = concurrent;
+}
+
+static void set_test_timeout(const char *arg) {
+    char *end = NULL;
+    long timeout = strtol(arg, &end, 10);
+    if (!end || *end != '\0' || timeout < 1) {
+        fprintf(stderr, "Invalid test timeout '%s'\n", arg);
+        exit(EXIT_FAILURE);
+    }
+
+    test_opts.test_timeout = timeout;
+}
+
+static void set_test_tui_scrollback(const char *arg) {
+    char *end = NULL;
+    long lines = strtol(arg, &end, 10);
+    if (!end || *end != '\0' || lines < 1) {
+        fprintf(stderr, "Invalid amount of scrollback lines '%s'\n", arg);
+        exit(EXIT_FAILURE);
+    }
+
+    test_opts.tui_scrollback = lines;
+}
+
+static void set_test_shard(const char *arg) {
+    char *end = NULL;
+    long index = strtol(arg, &end, 10);
+    if (!end || *end != '/') {
+        fprintf(stderr, "Invalid shard '%s', expected <i/n>\n", arg);
+        exit(EXIT_FAILURE);
+    }
+    const char *count_str = end + 1;
+    long count = strtol(count_str, &end, 10);
+    if (!end || end == count_str || *end != '\0' || count < 1 || index < 1 ||
+        index > count) {
+        fprintf(stderr,
+                "Invalid shard '%s', expected <i/n> with 1 <= i <= n\n", arg);
+        exit(EXIT_FAILURE);
+    }
+
+    test_opts.shard_index = index;
+    test_opts.shard_count = count;
+}
+
+static void set_test_shard_history(const char *arg) {
+    //
+    test_opts.shard_history = strdup(arg);
+}
+
+static void set_test_cache(const char *) {
+    //
+    test_opts.cache = true;
+}
+
+static void set_test_compact(const char *) {
+    test_opts.compact = true;
+    test_opts.headless = true;
+}
+
+static void set_test_watch(const char *) {
+    test_opts.watch = true;
+    // TUI would be redrawn on every run
+    test_opts.headless = true;
+}
+
+static void set_test_server(const char *arg) {
+    //
+    test_opts.server = strdup(arg);
+}
+
+static void set_test_isolate(const char *) {
+    //
+    test_opts.isolate = true;
+}
+
+static void set_test_progress_sampling(const char *) {
+    //
+    test_opts.progress_sampling = true;
+}
+
+static void set_test_coverage(const char *) {
+    //
+    test_opts.coverage = true;
+}
+
+static void set_test_profile(const char *) {
+    //
+    test_opts.profile = true;
+}
+
+static void set_test_threads(const char *) {
+    //
+    test_opts.threads = true;
+}
+
 static cmd_option all_test_options[] = {
     {"--log-level", "-l", true, set_log_level},
     {"--no-logs", "-n", false, set_test_no_logs},
@@ -339,6 +577,26 @@ static cmd_option all_test_options[] = {
     {"--tags", "-t", true, set_test_tags},
     {"--internal-log", "-i", false, set_internal_logging},
     {"--headless", "-e", false, set_test_headless},
+    {"--compact", NULL, false, set_test_compact},
+    {"--jobs", "-j", true, set_test_jobs},
+    {"--threads", NULL, false, set_test_threads},
+    {"--concurrent", "-c", true, set_test_concurrent},
+    {"--targets", "-T", true, set_test_targets},
+    {"--shard", "-s", true, set_test_shard},
+    {"--shard-history", NULL, true, set_test_shard_history},
+    {"--order", "-o", true, set_test_order},
+    {"--cache", NULL, false, set_test_cache},
+    {"--watch", "-w", false, set_test_watch},
+    {"--server", "-S", true, set_test_server},
+    {"--test-timeout", NULL, true, set_test_timeout},
+    {"--isolate", NULL, false, set_test_isolate},
+    {"--progress-sampling", NULL, false, set_test_progress_sampling},
+    {"--coverage", NULL, false, set_test_coverage},
+    {"--profile", NULL, false, set_test_profile},
+    {"--tui-scrollback", NULL, true, set_test_tui_scrollback},
+    {"--raw-log-format", NULL, true, set_test_raw_log_format},
+    {"--log-overflow", NULL, true, set_test_log_overflow},
+    {"--compress-logs", NULL, false, set_test_compress_logs},
     {"--help", "-h", false, get_test_help},
     {NULL, NULL, false, NULL},
 };
@@ -353,6 +611,28 @@ static cmd_category parse_test_options(int argc, char **argv) {
     test_opts.internal_logging = false;
     test_opts.custom_taf_lib_path = NULL;
     test_opts.headless = NULL;
+    test_opts.jobs = 1;
+    test_opts.threads = false;
+    test_opts.concurrent = 1;
+    test_opts.targets = NULL;
+    test_opts.targets_amount = 0;
+    test_opts.shard_index = 0;
+    test_opts.shard_count = 0;
+    test_opts.shard_history = NULL;
+    test_opts.order = TEST_ORDER_DEFAULT;
+    test_opts.cache = false;
+    test_opts.watch = false;
+    test_opts.server = NULL;
+    test_opts.test_timeout = 0;
+    test_opts.isolate = false;
+    test_opts.progress_sampling = false;
+    test_opts.coverage = false;
+    test_opts.profile = false;
+    test_opts.tui_scrollback = 1000;
+    test_opts.compact = false;
+    test_opts.raw_log_format = RAW_LOG_FORMAT_JSON;
+    test_opts.output_log_drop = false;
+    test_opts.compress_logs = false;
 
     if (argc <= 2) {
         return CMD_TEST;
@@ -380,9 +660,15 @@ static void set_logs_info_outputs(const char *) {
     logs_info_opts.include_outputs = true;
 }
 
+static void set_logs_info_test(const char *arg) {
+    //
+    logs_info_opts.test = strdup(arg);
+}
+
 static cmd_option all_logs_info_options[] = {
     {"--internal-log", "-i", false, set_internal_logging},
     {"--outputs", "-o", false, set_logs_info_outputs},
+    {"--test", "-t", true, set_logs_info_test},
     {"--help", "-h", false, get_logs_info_help},
     {NULL, NULL, false, NULL},
 };
@@ -403,6 +689,7 @@ static cmd_category parse_logs_options(int argc, char **argv) {
         logs_info_opts.arg = argv[3];
         logs_info_opts.internal_logging = false;
         logs_info_opts.include_outputs = false;
+        logs_info_opts.test = NULL;
         parse_additional_options(all_logs_info_options, 3, argc, argv);
         return CMD_LOGS_INFO;
     } else if (STR_EQ(argv[2], "help") || STR_EQ(argv[2], "-h") ||
@@ -476,7 +763,38 @@ static cmd_category parse_target_options(int argc, char **argv) {
     return CMD_UNKNOWN;
 }
 
+static void set_serve_socket(const char *arg) {
+    //
+    serve_opts.socket_path = strdup(arg);
+}
+
+static void get_serve_help(const char *) {
+    print_serve_help(stdout);
+    exit(EXIT_SUCCESS);
+}
+
+static cmd_option all_serve_options[] = {
+    {"--socket", "-s", true, set_serve_socket},
+    {"--taf-lib-path", "-p", true, set_test_taf_lib_path},
+    {"--internal-log", "-i", false, set_internal_logging},
+    {"--help", "-h", false, get_serve_help},
+    {NULL, NULL, false, NULL},
+};
+
+static cmd_category parse_serve_options(int argc, char **argv) {
+    serve_opts.socket_path = NULL;
+    test_opts.custom_taf_lib_path = NULL;
+    test_opts.internal_logging = false;
+
+    parse_additional_options(all_serve_options, 2, argc, argv);
+
+    return CMD_SERVE;
+}
+
 cmd_category cmd_parser_parse(int argc, char **argv) {
+    parsed_argc = argc;
+    parsed_argv = argv;
+
     if (argc < 2) {
         print_help(stderr);
         return CMD_UNKNOWN;
@@ -490,6 +808,8 @@ cmd_category cmd_parser_parse(int argc, char **argv) {
         return parse_logs_options(argc, argv);
     if (STR_EQ(argv[1], "target"))
         return parse_target_options(argc, argv);
+    if (STR_EQ(argv[1], "serve"))
+        return parse_serve_options(argc, argv);
 
     if (STR_EQ(argv[1], "help") || STR_EQ(argv[1], "--help") ||
         STR_EQ(argv[1], "-h")) {
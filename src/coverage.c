@@ -0,0 +1,262 @@
+#include "coverage.h"
+
+#include "internal_logging.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static source_filter_fn covered_fn = NULL;
+
+typedef struct {
+    source_entry_t **items;
+    size_t count;
+    size_t cap;
+} covered_entries_t;
+
+void coverage_init(source_filter_fn covered) {
+    //
+    covered_fn = covered;
+}
+
+bool coverage_track(source_entry_t *entry) {
+    entry->coverage_checked = true;
+    if (!covered_fn || !entry->lines_count || !covered_fn(entry->path)) {
+        return false;
+    }
+
+    LOG("Recording coverage of '%s'...", entry->path);
+    entry->hits = calloc((entry->lines_count + 7) / 8, 1);
+    if (!entry->hits) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    return true;
+}
+
+void coverage_add_file(const char *path) {
+    size_t len = strlen(path);
+    char *source = malloc(len + 2);
+    if (!source) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    source[0] = '@';
+    memcpy(source + 1, path, len + 1);
+
+    // Merged with the entries of the file, if it was loaded
+    coverage_track(source_cache_add(source));
+    free(source);
+}
+
+static inline void bit_set(uint8_t *bits, size_t i) {
+    //
+    bits[i >> 3] |= 1U << (i & 7);
+}
+
+static inline bool bit_get(const uint8_t *bits, size_t i) {
+    //
+    return bits[i >> 3] & (1U << (i & 7));
+}
+
+// Level of the long bracket `[==[` at `p`, -1 if there is none
+static int long_bracket_level(const char *p, const char *end) {
+    if (p >= end || *p != '[') {
+        return -1;
+    }
+    int level = 0;
+    for (p++; p < end && *p == '='; p++) {
+        level++;
+    }
+    return p < end && *p == '[' ? level : -1;
+}
+
+// Skips the long bracket of `level` opened at `p`, counting line breaks
+static const char *skip_long_bracket(const char *p, const char *end,
+                                     int level, size_t *line) {
+    p += level + 2;
+    while (p < end) {
+        if (*p == '\n') {
+            (*line)++;
+        } else if (*p == ']') {
+            const char *q = p + 1;
+            int n = 0;
+            while (q < end && *q == '=') {
+                q++;
+                n++;
+            }
+            if (n == level && q < end && *q == ']') {
+                return q + 1;
+            }
+        }
+        p++;
+    }
+    return end;
+}
+
+static bool is_block_keyword(const char *word, size_t len) {
+    static const char *keywords[] = {"end", "else", "do", "then", "repeat"};
+    for (size_t i = 0; i < sizeof keywords / sizeof *keywords; i++) {
+        if (strlen(keywords[i]) == len && !memcmp(keywords[i], word, len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Marks lines of `entry` which contain code in `code`. Lines with only
+// comments, closing brackets or block keywords have no instructions.
+static void mark_code_lines(const source_entry_t *entry, uint8_t *code) {
+    const char *p = entry->data;
+    const char *end = entry->data + entry->size;
+    size_t line = 0; // 0-based
+
+    while (p < end) {
+        char c = *p;
+        if (c == '\n') {
+            line++;
+            p++;
+        } else if (isspace((unsigned char)c) || c == ')' || c == '}' ||
+                   c == ']' || c == ',' || c == ';') {
+            p++;
+        } else if (c == '-' && p + 1 < end && p[1] == '-') {
+            int level = long_bracket_level(p + 2, end);
+            if (level >= 0) {
+                p = skip_long_bracket(p + 2, end, level, &line);
+            } else {
+                while (p < end && *p != '\n') {
+                    p++;
+                }
+            }
+        } else if (c == '[' && long_bracket_level(p, end) >= 0) {
+            bit_set(code, line);
+            p = skip_long_bracket(p, end, long_bracket_level(p, end), &line);
+        } else if (c == '"' || c == '\'') {
+            bit_set(code, line);
+            for (p++; p < end && *p != c && *p != '\n'; p++) {
+                if (*p == '\\' && p + 1 < end) {
+                    p++;
+                    if (*p == '\n') {
+                        line++;
+                    }
+                }
+            }
+            if (p < end && *p == c) {
+                p++;
+            }
+        } else if (isalpha((unsigned char)c) || c == '_') {
+            const char *word = p;
+            while (p < end && (isalnum((unsigned char)*p) || *p == '_')) {
+                p++;
+            }
+            if (!is_block_keyword(word, p - word)) {
+                bit_set(code, line);
+            }
+        } else {
+            bit_set(code, line);
+            p++;
+        }
+    }
+}
+
+static void collect_entry(source_entry_t *entry, void *ud) {
+    covered_entries_t *entries = ud;
+    if (!entry->hits) {
+        return;
+    }
+    if (entries->count == entries->cap) {
+        entries->cap = entries->cap ? entries->cap * 2 : 16;
+        entries->items =
+            realloc(entries->items, entries->cap * sizeof *entries->items);
+        if (!entries->items) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    entries->items[entries->count++] = entry;
+}
+
+static int entry_cmp(const void *a, const void *b) {
+    const source_entry_t *ea = *(source_entry_t *const *)a;
+    const source_entry_t *eb = *(source_entry_t *const *)b;
+    return strcmp(ea->path, eb->path);
+}
+
+// Writes the record of `count` entries of the same file, which were loaded
+// several times if the file was reloaded
+static void write_record(FILE *fp, source_entry_t **entries, size_t count) {
+    const source_entry_t *first = entries[0];
+    size_t lines = first->lines_count;
+
+    uint8_t *hits = calloc((lines + 7) / 8, 1);
+    uint8_t *code = calloc((lines + 7) / 8, 1);
+    if (!hits || !code) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t n = entries[i]->lines_count < lines ? entries[i]->lines_count
+                                                   : lines;
+        for (size_t b = 0; b < n / 8; b++) {
+            hits[b] |= entries[i]->hits[b];
+        }
+        for (size_t l = n / 8 * 8; l < n; l++) {
+            if (bit_get(entries[i]->hits, l)) {
+                bit_set(hits, l);
+            }
+        }
+    }
+    mark_code_lines(first, code);
+
+    size_t found = 0;
+    size_t hit = 0;
+    fprintf(fp, "TN:\nSF:%s\n", first->path);
+    for (size_t l = 0; l < lines; l++) {
+        bool executed = bit_get(hits, l);
+        if (!executed && !bit_get(code, l)) {
+            continue;
+        }
+        fprintf(fp, "DA:%zu,%d\n", l + 1, executed);
+        found++;
+        hit += executed;
+    }
+    fprintf(fp, "LF:%zu\nLH:%zu\nend_of_record\n", found, hit);
+
+    free(hits);
+    free(code);
+}
+
+int coverage_write(const char *path) {
+    LOG("Writing coverage to '%s'...", path);
+
+    covered_entries_t entries = {0};
+    source_cache_foreach(collect_entry, &entries);
+    if (entries.count) {
+        qsort(entries.items, entries.count, sizeof *entries.items, entry_cmp);
+    }
+
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        LOG("Unable to open coverage file '%s'", path);
+        free(entries.items);
+        return -1;
+    }
+
+    size_t start = 0;
+    while (start < entries.count) {
+        size_t end = start + 1;
+        while (end < entries.count && !strcmp(entries.items[start]->path,
+                                              entries.items[end]->path)) {
+            end++;
+        }
+        write_record(fp, entries.items + start, end - start);
+        start = end;
+    }
+
+    fclose(fp);
+    LOG("Coverage of %zu sources written.", entries.count);
+    free(entries.items);
+
+    return 0;
+}
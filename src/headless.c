@@ -1,120 +1,381 @@
 #include "headless.h"
 
 #include "cmd_parser.h"
+#include "internal_logging.h"
 #include "project_parser.h"
 #include "util/time.h"
 #include "version.h"
 
-static inline void print_delim(FILE *out) { fputs("-----------\n", out); }
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+// Test log output queued for the writer thread above this size is dropped,
+// so a slow stdout never blocks the tests. Results & the summary are always
+// queued, their queue is unbounded, so a stalled stdout still grows memory.
+#define HEADLESS_QUEUE_MAX (4 * 1024 * 1024)
+
+#define DELIM "-----------\n"
+
+typedef struct headless_chunk {
+    struct headless_chunk *next;
+    FILE *stream;
+    size_t len;
+    char data[];
+} headless_chunk_t;
+
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static headless_chunk_t *queue_head = NULL;
+static headless_chunk_t *queue_tail = NULL;
+static size_t queue_size = 0;
+static size_t dropped_size = 0;
+
+static pthread_t writer_thread;
+static bool writer_running = false;
+static bool writer_stop = false;
+
+static bool compact = false;
 
 static size_t passed_amount = 0;
 static size_t test_amount = 0;
 
+// Queues formatted output for `stream`, written right away if the writer
+// thread is not running. Output which may be `droppable` is dropped when the
+// queue is full.
+static void vout(bool droppable, FILE *stream, const char *fmt,
+                 va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(NULL, 0, fmt, copy);
+    va_end(copy);
+    if (len <= 0) {
+        return;
+    }
+
+    headless_chunk_t *chunk = malloc(sizeof *chunk + len + 1);
+    if (!chunk) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    chunk->next = NULL;
+    chunk->stream = stream;
+    chunk->len = len;
+    vsnprintf(chunk->data, len + 1, fmt, args);
+
+    pthread_mutex_lock(&queue_mutex);
+    if (!writer_running) {
+        pthread_mutex_unlock(&queue_mutex);
+        fwrite(chunk->data, 1, chunk->len, stream);
+        free(chunk);
+        return;
+    }
+    if (droppable && queue_size + len > HEADLESS_QUEUE_MAX) {
+        dropped_size += len;
+        pthread_mutex_unlock(&queue_mutex);
+        free(chunk);
+        return;
+    }
+    if (queue_tail) {
+        queue_tail->next = chunk;
+    } else {
+        queue_head = chunk;
+    }
+    queue_tail = chunk;
+    queue_size += len;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+static void out(FILE *stream, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vout(false, stream, fmt, args);
+    va_end(args);
+}
+
+// Output of the tests, dropped as a whole if stdout is too slow
+static void out_droppable(FILE *stream, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vout(true, stream, fmt, args);
+    va_end(args);
+}
+
+static inline void print_delim(FILE *out_stream) {
+    //
+    out(out_stream, DELIM);
+}
+
+static void *writer_main(void *) {
+    LOG("Headless writer started.");
+
+    pthread_mutex_lock(&queue_mutex);
+    for (;;) {
+        while (!queue_head && !dropped_size && !writer_stop) {
+            pthread_cond_wait(&queue_cond, &queue_mutex);
+        }
+        if (!queue_head && !dropped_size && writer_stop) {
+            break;
+        }
+
+        headless_chunk_t *chunk = queue_head;
+        size_t dropped = dropped_size;
+        queue_head = NULL;
+        queue_tail = NULL;
+        queue_size = 0;
+        dropped_size = 0;
+        pthread_mutex_unlock(&queue_mutex);
+
+        bool flush_stdout = false;
+        bool flush_stderr = false;
+        while (chunk) {
+            headless_chunk_t *next = chunk->next;
+            fwrite(chunk->data, 1, chunk->len, chunk->stream);
+            flush_stdout |= chunk->stream == stdout;
+            flush_stderr |= chunk->stream == stderr;
+            free(chunk);
+            chunk = next;
+        }
+        if (dropped) {
+            fprintf(stderr, "(%zu bytes of test output dropped, stdout is "
+                            "too slow)\n",
+                    dropped);
+            flush_stderr = true;
+        }
+        if (flush_stdout) {
+            fflush(stdout);
+        }
+        if (flush_stderr) {
+            fflush(stderr);
+        }
+
+        pthread_mutex_lock(&queue_mutex);
+    }
+    pthread_mutex_unlock(&queue_mutex);
+
+    LOG("Headless writer stopped.");
+    return NULL;
+}
+
+static void writer_atfork_child() {
+    // Writer thread does not exist in the child, output is written directly
+    pthread_mutex_init(&queue_mutex, NULL);
+    pthread_cond_init(&queue_cond, NULL);
+    writer_running = false;
+    queue_head = NULL;
+    queue_tail = NULL;
+    queue_size = 0;
+    dropped_size = 0;
+}
+
+static void writer_start() {
+    static bool atfork_registered = false;
+    if (!atfork_registered) {
+        pthread_atfork(NULL, NULL, writer_atfork_child);
+        atfork_registered = true;
+    }
+
+    pthread_mutex_lock(&queue_mutex);
+    bool running = writer_running;
+    pthread_mutex_unlock(&queue_mutex);
+    if (running) {
+        return;
+    }
+
+    writer_stop = false;
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL)) {
+        LOG("Unable to start headless writer, writing directly.");
+        return;
+    }
+    pthread_mutex_lock(&queue_mutex);
+    writer_running = true;
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+// Writes all the queued output & stops the writer thread
+static void writer_stop_and_join() {
+    pthread_mutex_lock(&queue_mutex);
+    if (!writer_running) {
+        pthread_mutex_unlock(&queue_mutex);
+        return;
+    }
+    writer_stop = true;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+
+    pthread_join(writer_thread, NULL);
+
+    pthread_mutex_lock(&queue_mutex);
+    writer_running = false;
+    pthread_mutex_unlock(&queue_mutex);
+}
+
 void taf_headless_init() {
     cmd_test_options *opts = cmd_parser_get_test_options();
     project_parsed_t *proj = get_parsed_project();
 
-    printf("TAF v" TAF_VERSION " started (headless mode).\n");
-    printf("Starting project '%s'.\n", proj->project_name);
-    printf("Project minimal TAF version: %s\n", proj->min_taf_ver_str);
+    compact = opts->compact;
+    passed_amount = 0;
+    test_amount = 0;
+
+    writer_start();
+
+    if (compact) {
+        out(stdout, "TAF v" TAF_VERSION " started project '%s'",
+            proj->project_name);
+        if (opts->target) {
+            out(stdout, " (target '%s')", opts->target);
+        }
+        out(stdout, ".\n");
+        return;
+    }
+
+    out(stdout, "TAF v" TAF_VERSION " started (headless mode).\n");
+    out(stdout, "Starting project '%s'.\n", proj->project_name);
+    out(stdout, "Project minimal TAF version: %s\n", proj->min_taf_ver_str);
     if (opts->target) {
-        printf("Test target selected: '%s'.\n", opts->target);
+        out(stdout, "Test target selected: '%s'.\n", opts->target);
     }
-    printf("Output log level: %s\n", taf_log_level_to_str(opts->log_level));
+    out(stdout, "Output log level: %s\n",
+        taf_log_level_to_str(opts->log_level));
     if (opts->tags_amount != 0) {
-        printf("Test run tags selected: '%s'", opts->tags[0]);
+        out(stdout, "Test run tags selected: '%s'", opts->tags[0]);
         for (size_t i = 1; i < opts->tags_amount; i++) {
-            printf(", '%s'", opts->tags[i]);
+            out(stdout, ", '%s'", opts->tags[i]);
         }
-        printf("\n");
+        out(stdout, "\n");
     }
     if (opts->no_logs) {
-        printf("Omitting file logs for this test run.\n");
+        out(stdout, "Omitting file logs for this test run.\n");
     }
     print_delim(stdout);
 }
 
 void taf_headless_test_started(raw_log_test_t *test) {
-    printf("Test '%s' STARTED...\n", test->name);
+    test_amount++;
+    if (compact) {
+        return;
+    }
+
+    out(stdout, "Test '%s' STARTED...\n", test->name);
     if (test->tags_count != 0) {
-        printf("Test tags: '%s'", test->tags[0]);
+        out(stdout, "Test tags: '%s'", test->tags[0]);
         for (size_t i = 1; i < test->tags_count; i++) {
-            printf(", %s", test->tags[i]);
+            out(stdout, ", %s", test->tags[i]);
         }
-        printf("\n");
+        out(stdout, "\n");
     }
     print_delim(stdout);
-    test_amount++;
 }
 
 void taf_headless_log_test(raw_log_test_output_t *output) {
-    printf("%s [%s]:\n", output->date_time,
-           taf_log_level_to_str(output->level));
-    printf("(%s:%d):\n", output->file, output->line);
-    printf("%.*s\n", (int)output->msg_len, output->msg);
-    print_delim(stdout);
+    if (compact) {
+        return;
+    }
+
+    out_droppable(stdout, "%s [%s]:\n(%s:%d):\n%.*s\n" DELIM,
+                  output->date_time, taf_log_level_to_str(output->level),
+                  output->file, output->line, (int)output->msg_len,
+                  output->msg);
 }
 
 void taf_headless_test_failed(raw_log_test_t *test) {
-    fprintf(stderr, "%s Test '%s' FAILED:\n", test->finished, test->name);
+    if (compact) {
+        out(stderr, "%s FAILED '%s'\n", test->finished, test->name);
+        for (size_t i = 0; i < test->failure_reasons_count; i++) {
+            raw_log_test_output_t *o = &test->failure_reasons[i];
+            out(stderr, "    [%s] (%s:%d): %.*s\n",
+                taf_log_level_to_str(o->level), o->file, o->line,
+                (int)o->msg_len, o->msg);
+        }
+        return;
+    }
+
+    out(stderr, "%s Test '%s' FAILED:\n", test->finished, test->name);
     for (size_t i = 0; i < test->failure_reasons_count; i++) {
         raw_log_test_output_t *o = &test->failure_reasons[i];
-        fprintf(stderr, "\nFailure reason %zu: [%s]:\n", i + 1,
-                taf_log_level_to_str(o->level));
-        fprintf(stderr, "(%s:%d):\n%.*s\n", o->file, o->line, (int)o->msg_len,
-                o->msg);
+        out(stderr, "\nFailure reason %zu: [%s]:\n", i + 1,
+            taf_log_level_to_str(o->level));
+        out(stderr, "(%s:%d):\n%.*s\n", o->file, o->line, (int)o->msg_len,
+            o->msg);
     }
     print_delim(stderr);
 }
 
 void taf_headless_test_passed(raw_log_test_t *test) {
-    printf("%s Test '%s' PASSED\n", test->finished, test->name);
-    print_delim(stdout);
     passed_amount++;
+    if (compact) {
+        out(stdout, "%s PASSED '%s'\n", test->finished, test->name);
+        return;
+    }
+
+    out(stdout, "%s Test '%s' PASSED\n", test->finished, test->name);
+    print_delim(stdout);
 }
 
 void taf_headless_defer_queue_started(raw_log_test_t *test) {
+    if (compact) {
+        return;
+    }
+
     char time[TS_LEN];
     get_date_time_now(time);
 
-    printf("%s Defer Queue for Test '%s' STARTED...\n", time, test->name);
+    out(stdout, "%s Defer Queue for Test '%s' STARTED...\n", time, test->name);
     print_delim(stdout);
 }
 
 void taf_headless_defer_queue_failed(raw_log_test_output_t *output) {
-    fprintf(stderr, "%s Defer (%s:%d) failed. Traceback:\n%.*s\n",
-            output->date_time, output->file, output->line, (int)output->msg_len,
-            output->msg);
-    print_delim(stderr);
+    out(stderr, "%s Defer (%s:%d) failed. Traceback:\n%.*s\n",
+        output->date_time, output->file, output->line, (int)output->msg_len,
+        output->msg);
+    if (!compact) {
+        print_delim(stderr);
+    }
 }
 
 void taf_headless_defer_queue_finished(raw_log_test_t *test) {
+    if (compact) {
+        return;
+    }
+
     char time[TS_LEN];
     get_date_time_now(time);
 
-    printf("%s Defer Queue for Test '%s' FINISHED\n", time, test->name);
+    out(stdout, "%s Defer Queue for Test '%s' FINISHED\n", time, test->name);
     print_delim(stdout);
 }
 
 void taf_headless_finalize() {
-    puts("\nTAF Test Run Finished.\n");
-    printf("Total: %zu, Passed: %zu, Failed: %zu\n", test_amount, passed_amount,
-           test_amount - passed_amount);
+    out(stdout, "\nTAF Test Run Finished.\n\n");
+    out(stdout, "Total: %zu, Passed: %zu, Failed: %zu\n", test_amount,
+        passed_amount, test_amount - passed_amount);
+
+    writer_stop_and_join();
 }
 
 void taf_headless_hooks_started() {
+    if (compact) {
+        return;
+    }
+
     char time[TS_LEN];
     get_date_time_now(time);
 
-    printf("%s Running TAF hooks...\n", time);
+    out(stdout, "%s Running TAF hooks...\n", time);
     print_delim(stdout);
 }
 
 void taf_headless_hooks_finished() {
+    if (compact) {
+        return;
+    }
+
     char time[TS_LEN];
     get_date_time_now(time);
 
-    printf("%s Finished running TAF hooks.\n", time);
+    out(stdout, "%s Finished running TAF hooks.\n", time);
     print_delim(stdout);
 }
 
@@ -122,6 +383,8 @@ void taf_headless_hook_failed(const char *err) {
     char time[TS_LEN];
     get_date_time_now(time);
 
-    fprintf(stderr, "%s TAF hook failed. Traceback:\n%s\n", time, err);
-    print_delim(stderr);
+    out(stderr, "%s TAF hook failed. Traceback:\n%s\n", time, err);
+    if (!compact) {
+        print_delim(stderr);
+    }
 }
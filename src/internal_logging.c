@@ -50,6 +50,9 @@ void internal_log(const char *file, int line, const char *func, const char *fmt,
     char date_time_now[TS_LEN];
     get_date_time_now(date_time_now);
 
+    // Keep lines from different runner threads from interleaving
+    flockfile(internal_log_file);
+
     // &file[7] - stripping "../src/" part of file path
     fprintf(internal_log_file, "[%s]: [%s/%s : %d]: ", date_time_now, &file[7],
             func, line);
@@ -62,6 +65,8 @@ void internal_log(const char *file, int line, const char *func, const char *fmt,
     fputs("\n", internal_log_file);
 
     fflush(internal_log_file);
+
+    funlockfile(internal_log_file);
 }
 
 void internal_logging_deinit() {
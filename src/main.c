@@ -2,6 +2,7 @@
 
 #include "taf_init.h"
 #include "taf_logs.h"
+#include "taf_serve.h"
 #include "taf_target.h"
 #include "taf_test.h"
 
@@ -23,6 +24,8 @@ int main(int argc, char **argv) {
         return taf_target_add();
     case CMD_TARGET_REMOVE:
         return taf_target_remove();
+    case CMD_SERVE:
+        return taf_serve();
     case CMD_HELP:
         // Should be already handled in cmd_parser
         return EXIT_SUCCESS;
@@ -1,11 +1,19 @@
 #include "modules/http/taf-http.h"
 
 #include "internal_logging.h"
+#include "profile.h"
+#include "test_scheduler.h"
+#include "test_timeout.h"
 
 #include "util/lua.h"
 
+#include <stdlib.h>
 #include <string.h>
 
+// Upper bound of a single wait between driving a transfer from a test
+// coroutine, libcurl timeouts are used when shorter
+#define HTTP_MAX_YIELD_MS 10
+
 static void ud_clear_slist(l_module_http_t *handle) {
     LOG("Clearing slist...");
     if (handle->headers) {
@@ -198,11 +206,96 @@ int l_module_http_setopt(lua_State *L) {
     return 1;
 }
 
+typedef struct {
+    CURLM *multi;
+    CURL *easy;
+} http_transfer_t;
+
+static void transfer_free(http_transfer_t *t) {
+    curl_multi_remove_handle(t->multi, t->easy);
+    curl_multi_cleanup(t->multi);
+    free(t);
+}
+
+static int perform_yielding_k(lua_State *L, int status, lua_KContext ctx) {
+    http_transfer_t *t = (http_transfer_t *)ctx;
+
+    int running = 0;
+    CURLMcode mc = curl_multi_perform(t->multi, &running);
+    if (mc == CURLM_OK && running) {
+        long left = test_timeout_remaining_ms();
+        if (left == 0) {
+            // The error doesn't return here, so the transfer is freed first
+            transfer_free(t);
+            test_timeout_check(L);
+        }
+        long timeout_ms = -1;
+        curl_multi_timeout(t->multi, &timeout_ms);
+        if (timeout_ms < 0 || timeout_ms > HTTP_MAX_YIELD_MS) {
+            timeout_ms = HTTP_MAX_YIELD_MS;
+        }
+        if (left > 0 && timeout_ms > left) {
+            timeout_ms = left;
+        }
+        return test_scheduler_sleep(L, timeout_ms, ctx, perform_yielding_k);
+    }
+
+    CURLcode rc = CURLE_OK;
+    if (mc != CURLM_OK) {
+        LOG("curl_multi_perform: %s", curl_multi_strerror(mc));
+        rc = CURLE_FAILED_INIT;
+    }
+    int left;
+    CURLMsg *msg;
+    while ((msg = curl_multi_info_read(t->multi, &left))) {
+        if (msg->msg == CURLMSG_DONE) {
+            rc = msg->data.result;
+        }
+    }
+
+    transfer_free(t);
+
+    if (rc != CURLE_OK) {
+        const char *err = curl_easy_strerror(rc);
+        LOG("curl transfer: %s", err);
+        return luaL_error(L, "curl_easy_perform: %s", err);
+    }
+    lua_pushboolean(L, 1);
+    LOG("Successfully finished taf-http perform.");
+    return 1;
+}
+
+// Same as curl_easy_perform, but lets other tests run during the transfer
+static int perform_yielding(lua_State *L, CURL *easy) {
+    LOG("Performing transfer from the test scheduler...");
+
+    http_transfer_t *t = malloc(sizeof *t);
+    if (!t) {
+        return luaL_error(L, "out of memory");
+    }
+    t->easy = easy;
+    t->multi = curl_multi_init();
+    if (!t->multi) {
+        free(t);
+        LOG("curl_multi_init() failed");
+        return luaL_error(L, "curl_multi_init() failed");
+    }
+    curl_multi_add_handle(t->multi, easy);
+
+    return perform_yielding_k(L, LUA_OK, (lua_KContext)t);
+}
+
 int l_module_http_perform(lua_State *L) {
     LOG("Invoked taf-http perform...");
     int s = selfshift(L);
     CURL **ud = luaL_checkudata(L, s, "taf-http");
+    if (test_scheduler_can_yield(L)) {
+        return perform_yielding(L, *ud);
+    }
+    profile_offcpu_begin(L, "http");
     CURLcode rc = curl_easy_perform(*ud);
+    profile_offcpu_end();
+    test_timeout_check(L);
     if (rc != CURLE_OK) {
         const char *err = curl_easy_strerror(rc);
         LOG("curl_easy_perform: %s", err);
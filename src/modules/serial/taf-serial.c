@@ -1,8 +1,13 @@
 #include "modules/serial/taf-serial.h"
 
 #include "internal_logging.h"
+#include "profile.h"
+#include "test_scheduler.h"
+#include "test_timeout.h"
 #include "util/lua.h"
+#include "util/time.h"
 
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -550,6 +555,61 @@ int l_module_serial_set_flowcontrol(lua_State *L) {
 }
 
 /*----------- reading ------------------------------------------------*/
+typedef struct {
+    struct sp_port *port;
+    unsigned long deadline; // 0 if waiting indefinitely
+    int want;
+    int got;
+    char buf[];
+} serial_read_t;
+
+static int read_yielding_k(lua_State *L, int status, lua_KContext ctx) {
+    serial_read_t *r = lua_touserdata(L, (int)ctx);
+    test_timeout_check(L);
+
+    int got = sp_nonblocking_read(r->port, r->buf + r->got, r->want - r->got);
+    if (got < 0) {
+        const char *err = sp_last_error_message();
+        LOG("Unable to read: %s", err);
+        return luaL_error(L, err);
+    }
+    r->got += got;
+
+    unsigned long now = millis_monotonic();
+    bool timed_out = r->deadline != 0 && now >= r->deadline;
+    if (r->got < r->want && !timed_out) {
+        long timeout = r->deadline != 0 ? (long)(r->deadline - now) : -1;
+        int fd;
+        if (sp_get_port_handle(r->port, &fd) != SP_OK) {
+            // Fall back to polling the port
+            LOG("Unable to get port handle, polling...");
+            return test_scheduler_sleep(L, 1, ctx, read_yielding_k);
+        }
+        return test_scheduler_wait_fd(L, fd, POLLIN, timeout, ctx,
+                                      read_yielding_k);
+    }
+
+    LOG("Read %d bytes: %.*s", r->got, r->got, r->buf);
+    lua_pushlstring(L, r->buf, r->got);
+
+    LOG("Successfully finished taf-serial read.");
+    return 1;
+}
+
+// Same as sp_blocking_read, but lets other tests run while waiting
+static int read_yielding(lua_State *L, l_module_serial_t *u, int n,
+                         int to_ms) {
+    LOG("Reading from the test scheduler...");
+
+    serial_read_t *r = lua_newuserdatauv(L, sizeof *r + n, 0);
+    r->port = u->port;
+    r->deadline = to_ms > 0 ? millis_monotonic() + to_ms : 0;
+    r->want = n;
+    r->got = 0;
+
+    return read_yielding_k(L, LUA_OK, lua_gettop(L));
+}
+
 static inline int read_helper(lua_State *L, int blocking) {
     LOG("Invoked taf-serial read. Blocking: %d", blocking);
     int s = selfshift(L);
@@ -558,10 +618,26 @@ static inline int read_helper(lua_State *L, int blocking) {
     int to_ms = luaL_optinteger(L, s + 2, 0);
     LOG("Amount of bytes to read: %d, timeout: %d", n, to_ms);
 
+    if (blocking && test_scheduler_can_yield(L)) {
+        return read_yielding(L, u, n, to_ms);
+    }
+
+    if (blocking) {
+        // Don't block past the deadline of the test
+        to_ms = test_timeout_clamp(to_ms);
+    }
+
     luaL_Buffer b;
     char *buf = luaL_buffinitsize(L, &b, n);
-    int got = blocking ? sp_blocking_read(u->port, buf, n, to_ms)
-                       : sp_nonblocking_read(u->port, buf, n);
+    int got;
+    if (blocking) {
+        profile_offcpu_begin(L, "serial read");
+        got = sp_blocking_read(u->port, buf, n, to_ms);
+        profile_offcpu_end();
+    } else {
+        got = sp_nonblocking_read(u->port, buf, n);
+    }
+    test_timeout_check(L);
 
     if (got < 0) {
         const char *err = sp_last_error_message();
@@ -592,8 +668,13 @@ static inline int write_helper(lua_State *L, int blocking) {
     int to_ms = luaL_optinteger(L, s + 2, 0);
     LOG("Length: %zu, Buffer: '%.*s', timeout: %d", len, (int)len, buf, to_ms);
 
+    if (blocking) {
+        to_ms = test_timeout_clamp(to_ms);
+    }
+
     int wrote = blocking ? sp_blocking_write(u->port, buf, len, to_ms)
                          : sp_nonblocking_write(u->port, buf, len);
+    test_timeout_check(L);
 
     if (wrote < 0) {
         const char *err = sp_last_error_message();
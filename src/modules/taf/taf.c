@@ -2,9 +2,14 @@
 
 #include "cmd_parser.h"
 #include "internal_logging.h"
+#include "profile.h"
+#include "taf_state.h"
 #include "taf_test.h"
 #include "test_case.h"
+#include "test_each.h"
 #include "test_logs.h"
+#include "test_scheduler.h"
+#include "test_timeout.h"
 #include "util/lua.h"
 #include "util/time.h"
 
@@ -21,101 +26,172 @@ int l_module_taf_sleep(lua_State *L) {
         LOG("taf-main sleep ms %d <= 0", ms);
         return 0;
     }
+    test_timeout_check(L);
+    ms = test_timeout_clamp(ms);
+    if (test_scheduler_can_yield(L)) {
+        LOG("Yielding to the test scheduler for %d ms...", ms);
+        return test_scheduler_sleep(L, ms, 0, NULL);
+    }
+
     LOG("Sleeping for %d ms...", ms);
+    profile_offcpu_begin(L, "sleep");
     usleep(ms * 1000);
+    profile_offcpu_end();
+    test_timeout_check(L);
 
     LOG("Successfully finished taf-main sleep");
 
     return 0; /* no Lua return values */
 }
 
-int l_module_taf_register_test(lua_State *L) {
-    LOG("Registering new test...");
+// Parses array of tags at `index` with `max` elements into `tags`.
+// Returns true if one of the tags was requested for the test run.
+static bool parse_tags(lua_State *L, int index, lua_Integer max,
+                       test_tags_t *tags) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    bool matched = false;
 
-    int s = selfshift(L);
+    tags->amount = max;
+    tags->tags = malloc(sizeof(*tags->tags) * tags->amount);
 
-    const char *name = luaL_checkstring(L, s);
-    LOG("Test name: '%s'", name);
-    int body_index;
+    for (lua_Integer i = 1; i <= max; ++i) {
+        lua_rawgeti(L, index, i); // push tags[i]
 
-    cmd_test_options *opts = cmd_parser_get_test_options();
-    bool register_test = false;
-    if (opts->tags_amount == 0) {
-        register_test = true;
-    }
+        if (!lua_isstring(L, -1)) {
+            LOG("One of the tags is not a string, throwing error...");
+            luaL_error(L, "Tag #%d is not a string (got %s)", (int)i,
+                       luaL_typename(L, -1));
+            return false;
+        }
 
-    test_tags_t tags = {.tags = NULL, .amount = 0};
+        const char *tag = lua_tostring(L, -1);
+        LOG("Adding test tag %s", tag);
+        tags->tags[i - 1] = strdup(tag);
 
-    switch (lua_type(L, s + 1)) {
-    case LUA_TFUNCTION: {
-        LOG("Second argument is test body, skipping third argument...");
-        body_index = 1;
-        break;
-    }
-    case LUA_TTABLE: {
-        // Got tags, check them & test body
-        lua_Integer max;
-        int is_array = lua_table_is_array(L, s + 1, &max);
-        if (!is_array) {
-            LOG("Second argument is table but not an array, throwing error...");
-            luaL_error(L, "Tags are supposed to be an array of strings, e.g.: "
-                          "{\"tag1\", \"tag2\"}");
-            return 0;
+        for (size_t j = 0; j < opts->tags_amount; j++) {
+            if (!strcmp(tag, opts->tags[j])) {
+                LOG("Found tags match with test run.");
+                matched = true;
+            }
         }
 
-        tags.amount = max;
-        tags.tags = malloc(sizeof(*tags.tags) * tags.amount);
-
-        for (lua_Integer i = 1; i <= max; ++i) {
-            lua_rawgeti(L, s + 1, i); // push tags[i]
+        lua_pop(L, 1); // pop tags[i]
+    }
 
-            if (!lua_isstring(L, -1)) {
-                LOG("One of the tags is not a string, throwing error...");
-                luaL_error(L, "Tag #%lld is not a string (got %s)",
-                           (long long)i, luaL_typename(L, -1));
-                return 0;
-            }
+    LOG("Successfully added test tags.");
 
-            const char *tag = lua_tostring(L, -1);
-            LOG("Adding test tag %s", tag);
-            tags.tags[i - 1] = strdup(tag);
+    return matched;
+}
 
-            for (size_t i = 0; i < opts->tags_amount; i++) {
-                if (!strcmp(tag, opts->tags[i])) {
-                    LOG("Found tags match with test run.");
-                    register_test = true;
-                }
-            }
+// Parses test options table at `index`: `{ tags = {...}, timeout = ms }`.
+// Returns true if one of the tags was requested for the test run.
+static bool parse_options(lua_State *L, int index, test_tags_t *tags,
+                          unsigned long *timeout) {
+    LOG("Parsing test options...");
+    bool matched = false;
 
-            lua_pop(L, 1); // pop tags[i]
+    if (lua_getfield(L, index, "tags") != LUA_TNIL) {
+        lua_Integer max;
+        if (!lua_istable(L, -1) ||
+            (!lua_table_is_array(L, lua_gettop(L), &max) && max != 0)) {
+            LOG("Option 'tags' is not an array, throwing error...");
+            luaL_error(L, "Option 'tags' is supposed to be an array of "
+                          "strings, e.g.: {\"tag1\", \"tag2\"}");
+            return false;
+        }
+        matched = parse_tags(L, lua_gettop(L), max, tags);
+    }
+    lua_pop(L, 1); // pop tags
+
+    if (lua_getfield(L, index, "timeout") != LUA_TNIL) {
+        int isnum;
+        lua_Integer ms = lua_tointegerx(L, -1, &isnum);
+        if (!isnum || ms < 1) {
+            LOG("Option 'timeout' is not a positive integer, throwing "
+                "error...");
+            luaL_error(L, "Option 'timeout' is supposed to be a positive "
+                          "amount of milliseconds");
+            return false;
         }
+        LOG("Test timeout: %lld ms", (long long)ms);
+        *timeout = ms;
+    }
+    lua_pop(L, 1); // pop timeout
 
-        LOG("Successfully added test tags.");
+    return matched;
+}
+
+// Parses test arguments starting at `index`: optional tags or options table
+// followed by test body. Returns index of the body, sets `register_test` to
+// whether the test matches tags of the test run.
+static int parse_test_args(lua_State *L, int index, test_tags_t *tags,
+                           unsigned long *timeout, bool *register_test) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    *register_test = opts->tags_amount == 0;
+
+    switch (lua_type(L, index)) {
+    case LUA_TFUNCTION: {
+        LOG("Got test body, skipping next argument...");
+        return index;
+    }
+    case LUA_TTABLE: {
+        lua_Integer max;
+        if (lua_table_is_array(L, index, &max)) {
+            // Got tags
+            *register_test |= parse_tags(L, index, max, tags);
+        } else {
+            // Got options table
+            *register_test |= parse_options(L, index, tags, timeout);
+        }
 
-        body_index = 2;
-        luaL_checktype(L, s + 2, LUA_TFUNCTION);
-        break;
+        luaL_checktype(L, index + 1, LUA_TFUNCTION);
+        return index + 1;
     }
     default: {
-        const char *typename = lua_typename(L, s + 1);
-        LOG("Wrong argument type for second argument: %s", typename);
-        luaL_error(
-            L,
-            "Expected test body or array of tags for second argument, got %s.",
-            typename);
-        return 0;
+        const char *typename = luaL_typename(L, index);
+        LOG("Wrong argument type for argument #%d: %s", index, typename);
+        return luaL_error(L,
+                          "Expected test body, array of tags or options table "
+                          "for argument #%d, got %s.",
+                          index, typename);
     }
     }
+}
+
+int l_module_taf_register_test(lua_State *L) {
+    LOG("Registering new test...");
+
+    int s = selfshift(L);
+
+    const char *name = luaL_checkstring(L, s);
+    LOG("Test name: '%s'", name);
+
+    test_tags_t tags = {.tags = NULL, .amount = 0};
+    unsigned long timeout = 0;
+    bool register_test;
+    int body_index =
+        parse_test_args(L, s + 1, &tags, &timeout, &register_test);
 
     if (!register_test) {
         LOG("Skipping test registering: test does not containg required tags.");
         return 0;
     }
 
-    lua_pushvalue(L, s + body_index);         /* duplicate fn -> top */
+    const char *file = NULL;
+    lua_Debug ar;
+    lua_pushvalue(L, body_index);
+    if (lua_getinfo(L, ">S", &ar) && ar.source[0] == '@') {
+        file = strdup(ar.source + 1);
+    }
+
+    lua_pushvalue(L, body_index);             /* duplicate fn -> top */
     int ref = luaL_ref(L, LUA_REGISTRYINDEX); /* pop & ref */
 
-    test_case_t test_case = {.name = strdup(name), .tags = tags, .ref = ref};
+    test_case_t test_case = {.name = strdup(name),
+                             .tags = tags,
+                             .ref = ref,
+                             .file = file,
+                             .timeout = timeout};
 
     LOG("Creating test case with name %s,  reference %d", test_case.name,
         test_case.ref);
@@ -127,6 +203,39 @@ int l_module_taf_register_test(lua_State *L) {
     return 0;
 }
 
+int l_module_taf_register_test_each(lua_State *L) {
+    LOG("Registering parametrized test...");
+
+    int s = selfshift(L);
+
+    const char *name_fmt = luaL_checkstring(L, s);
+    LOG("Test name format: '%s'", name_fmt);
+    if (!lua_istable(L, s + 1) && !lua_isstring(L, s + 1)) {
+        return luaL_error(L,
+                          "Expected array of rows or path of CSV/JSON file "
+                          "with rows for argument #%d, got %s.",
+                          s + 1, luaL_typename(L, s + 1));
+    }
+
+    test_tags_t tags = {.tags = NULL, .amount = 0};
+    unsigned long timeout = 0;
+    bool register_test;
+    int body_index =
+        parse_test_args(L, s + 2, &tags, &timeout, &register_test);
+
+    if (!register_test) {
+        LOG("Skipping test registering: test does not containg required tags.");
+        return 0;
+    }
+
+    size_t amount = test_each_register(L, name_fmt, s + 1, body_index, tags,
+                                       timeout);
+
+    LOG("Successfully registered %zu cases of '%s'", amount, name_fmt);
+
+    return 0;
+}
+
 int l_module_taf_defer(lua_State *L) {
     LOG("Adding new defer to defer queue...");
 
@@ -136,14 +245,15 @@ int l_module_taf_defer(lua_State *L) {
 
     luaL_checktype(L, s, LUA_TFUNCTION);
 
-    lua_getfield(L, LUA_REGISTRYINDEX, DEFER_LIST_KEY);
-    if (lua_isnil(L, -1)) {
+    taf_state_t *state = taf_state_get();
+    if (state->defer_ref == LUA_NOREF) {
         LOG("Defer queue is nil, creating new one...");
-        lua_pop(L, 1);
         lua_newtable(L);
         lua_pushvalue(L, -1);
-        lua_setfield(L, LUA_REGISTRYINDEX, DEFER_LIST_KEY);
+        state->defer_ref = luaL_ref(L, LUA_REGISTRYINDEX);
         LOG("Successfully created new defer queue.");
+    } else {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, state->defer_ref);
     }
     int list = lua_gettop(L);
 
@@ -306,7 +416,8 @@ int l_module_taf_millis(lua_State *L) {
 
     LOG("Invoked taf-main millis...");
 
-    unsigned long uptime = millis_since_start();
+    unsigned long uptime =
+        millis_monotonic() - taf_state_get()->test_start_millis;
 
     LOG("Pushing uptime: %lu", uptime);
     lua_pushnumber(L, uptime);
@@ -343,6 +454,7 @@ static const luaL_Reg module_fns[] = {
     {"print", l_module_taf_print},                               //
     {"log", l_module_taf_log},                                   //
     {"test", l_module_taf_register_test},                        //
+    {"test_each", l_module_taf_register_test_each},              //
     {NULL, NULL},                                                //
 };
 
@@ -0,0 +1,269 @@
+#include "output_log.h"
+
+#include "internal_logging.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Capacity of the ring, a power of 2
+#define OUTPUT_LOG_RING_SIZE (4 * 1024 * 1024)
+
+// Time the producer waits for the writer to free space in the full ring
+#define OUTPUT_LOG_FULL_WAIT_US 200
+
+#define OUTPUT_LOG_PREFIX_MAX 512
+
+static FILE *file = NULL;
+static bool drop_when_full = false;
+
+static char *ring = NULL;
+// Free running positions, `head` is advanced by the writer, `tail` by the
+// producer
+static _Atomic size_t ring_head = 0;
+static _Atomic size_t ring_tail = 0;
+static _Atomic size_t dropped = 0;
+
+static pthread_t writer_thread;
+static bool writer_running = false;
+static atomic_bool writer_stop = false;
+
+// Writer sleeps on the condition when the ring is empty
+static pthread_mutex_t idle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static atomic_bool writer_idle = false;
+
+static void write_dropped() {
+    size_t n = atomic_exchange(&dropped, 0);
+    if (n) {
+        fprintf(file, "[%zu bytes of output log dropped, disk is too slow]\n\n",
+                n);
+    }
+}
+
+static void *writer_main(void *) {
+    LOG("Output log writer started.");
+
+    for (;;) {
+        size_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+        if (head == tail) {
+            write_dropped();
+            fflush(file);
+
+            pthread_mutex_lock(&idle_mutex);
+            atomic_store(&writer_idle, true);
+            while (atomic_load(&ring_tail) == head &&
+                   !atomic_load(&writer_stop)) {
+                pthread_cond_wait(&idle_cond, &idle_mutex);
+            }
+            atomic_store(&writer_idle, false);
+            pthread_mutex_unlock(&idle_mutex);
+
+            if (atomic_load(&ring_tail) == head) {
+                break;
+            }
+            continue;
+        }
+
+        // Up to the end of the ring, the rest is written by the next pass
+        size_t start = head & (OUTPUT_LOG_RING_SIZE - 1);
+        size_t len = tail - head;
+        if (len > OUTPUT_LOG_RING_SIZE - start) {
+            len = OUTPUT_LOG_RING_SIZE - start;
+        }
+        fwrite(ring + start, 1, len, file);
+        atomic_store_explicit(&ring_head, head + len, memory_order_release);
+    }
+
+    LOG("Output log writer stopped.");
+    return NULL;
+}
+
+static void writer_atfork_child() {
+    // Writer thread does not exist in the child, records are written directly
+    pthread_mutex_init(&idle_mutex, NULL);
+    pthread_cond_init(&idle_cond, NULL);
+    writer_running = false;
+}
+
+void output_log_open(FILE *out, bool drop) {
+    static bool atfork_registered = false;
+    if (!atfork_registered) {
+        pthread_atfork(NULL, NULL, writer_atfork_child);
+        atfork_registered = true;
+    }
+
+    file = out;
+    drop_when_full = drop;
+
+    ring = malloc(OUTPUT_LOG_RING_SIZE);
+    if (!ring) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    atomic_store(&ring_head, 0);
+    atomic_store(&ring_tail, 0);
+    atomic_store(&dropped, 0);
+    atomic_store(&writer_stop, false);
+    atomic_store(&writer_idle, false);
+
+    int rc = pthread_create(&writer_thread, NULL, writer_main, NULL);
+    writer_running = rc == 0;
+    if (rc) {
+        LOG("Unable to start output log writer: %s, writing directly.",
+            strerror(rc));
+    }
+}
+
+static void wake_writer() {
+    // Orders the store of the tail before the check, the writer sets the
+    // flag before checking the tail
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load(&writer_idle)) {
+        return;
+    }
+    pthread_mutex_lock(&idle_mutex);
+    pthread_cond_signal(&idle_cond);
+    pthread_mutex_unlock(&idle_mutex);
+}
+
+// Copies `len` bytes of `data` into the ring, waiting for free space
+static void ring_put(const char *data, size_t len) {
+    size_t tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    while (len) {
+        size_t head = atomic_load_explicit(&ring_head, memory_order_acquire);
+        size_t space = OUTPUT_LOG_RING_SIZE - (tail - head);
+        if (space == 0) {
+            // Record larger than the ring, the writer takes its beginning
+            atomic_store_explicit(&ring_tail, tail, memory_order_release);
+            wake_writer();
+            nanosleep(&(struct timespec){0, OUTPUT_LOG_FULL_WAIT_US * 1000},
+                      NULL);
+            continue;
+        }
+        size_t start = tail & (OUTPUT_LOG_RING_SIZE - 1);
+        size_t n = len < space ? len : space;
+        if (n > OUTPUT_LOG_RING_SIZE - start) {
+            n = OUTPUT_LOG_RING_SIZE - start;
+        }
+        memcpy(ring + start, data, n);
+        data += n;
+        len -= n;
+        tail += n;
+    }
+    atomic_store_explicit(&ring_tail, tail, memory_order_release);
+}
+
+// Appends parts of a record, which is either written whole or dropped
+static void put_record(const char **parts, const size_t *lens, size_t count) {
+    if (!writer_running) {
+        for (size_t i = 0; i < count; i++) {
+            fwrite(parts[i], 1, lens[i], file);
+        }
+        return;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += lens[i];
+    }
+
+    size_t tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring_head, memory_order_acquire);
+    if (drop_when_full && total > OUTPUT_LOG_RING_SIZE - (tail - head)) {
+        atomic_fetch_add(&dropped, total);
+        wake_writer();
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        ring_put(parts[i], lens[i]);
+    }
+    wake_writer();
+}
+
+// Formats `fmt` into `buf`, or into an allocated buffer if it doesn't fit.
+// Returns the text, to be freed if it is not `buf`.
+static char *format_text(char buf[OUTPUT_LOG_PREFIX_MAX], size_t *len,
+                         const char *fmt, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    int n = vsnprintf(buf, OUTPUT_LOG_PREFIX_MAX, fmt, copy);
+    va_end(copy);
+    if (n < 0) {
+        *len = 0;
+        return buf;
+    }
+    *len = n;
+    if (n < OUTPUT_LOG_PREFIX_MAX) {
+        return buf;
+    }
+
+    char *str = malloc(n + 1);
+    if (!str) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    vsnprintf(str, n + 1, fmt, args);
+    return str;
+}
+
+void output_log_printf(const char *fmt, ...) {
+    char buf[OUTPUT_LOG_PREFIX_MAX];
+    size_t len;
+    va_list args;
+    va_start(args, fmt);
+    char *str = format_text(buf, &len, fmt, args);
+    va_end(args);
+
+    put_record((const char *[]){str}, (size_t[]){len}, 1);
+
+    if (str != buf) {
+        free(str);
+    }
+}
+
+void output_log_message(const char *data, size_t len, const char *fmt, ...) {
+    char buf[OUTPUT_LOG_PREFIX_MAX];
+    size_t prefix_len;
+    va_list args;
+    va_start(args, fmt);
+    char *prefix = format_text(buf, &prefix_len, fmt, args);
+    va_end(args);
+
+    put_record((const char *[]){prefix, data, "\n\n"},
+               (size_t[]){prefix_len, len, 2}, 3);
+
+    if (prefix != buf) {
+        free(prefix);
+    }
+}
+
+void output_log_close() {
+    if (!file) {
+        return;
+    }
+    LOG("Closing output log...");
+
+    if (writer_running) {
+        pthread_mutex_lock(&idle_mutex);
+        atomic_store(&writer_stop, true);
+        pthread_cond_signal(&idle_cond);
+        pthread_mutex_unlock(&idle_mutex);
+        pthread_join(writer_thread, NULL);
+        writer_running = false;
+    }
+    write_dropped();
+
+    fclose(file);
+    file = NULL;
+    free(ring);
+    ring = NULL;
+
+    LOG("Output log closed.");
+}
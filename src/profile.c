@@ -0,0 +1,272 @@
+#include "profile.h"
+
+#include "internal_logging.h"
+
+#include "taf_state.h"
+#include "test_case.h"
+
+#include "util/time.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Time between two samples of the Lua stack
+#define PROFILE_INTERVAL_MS 5
+
+// Instructions between checks whether a sample is due
+#define PROFILE_HOOK_COUNT 1000
+
+#define PROFILE_MAX_DEPTH 64
+#define PROFILE_STACK_MAX 4096
+
+typedef struct {
+    char *stack; // folded, NULL if the slot is free
+    unsigned long count;
+} profile_slot_t;
+
+static bool profiling = false;
+static pthread_t profiled_thread;
+
+static pthread_t timer_thread;
+static atomic_bool timer_running = false;
+static atomic_bool sample_pending = false;
+
+// Hook of the profiled Lua state wrapped by the profile hook
+static lua_Hook wrapped_hook = NULL;
+static int wrapped_mask = 0;
+
+// Open addressing hash map of folded stacks, capacity is a power of 2
+static profile_slot_t *slots = NULL;
+static size_t slots_cap = 0;
+static size_t slots_len = 0;
+
+static char offcpu_stack[PROFILE_STACK_MAX];
+static unsigned long offcpu_started = 0;
+static int offcpu_depth = 0;
+
+static size_t hash_str(const char *str) {
+    size_t h = 1469598103934665603ULL;
+    for (; *str; str++) {
+        h = (h ^ (unsigned char)*str) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static void grow() {
+    size_t old_cap = slots_cap;
+    profile_slot_t *old = slots;
+
+    slots_cap = slots_cap ? slots_cap * 2 : 256;
+    slots = calloc(slots_cap, sizeof *slots);
+    if (!slots) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old_cap; i++) {
+        if (!old[i].stack) {
+            continue;
+        }
+        size_t j = hash_str(old[i].stack) & (slots_cap - 1);
+        while (slots[j].stack) {
+            j = (j + 1) & (slots_cap - 1);
+        }
+        slots[j] = old[i];
+    }
+    free(old);
+}
+
+static void add_stack(const char *stack, unsigned long count) {
+    if (slots_len * 2 >= slots_cap) {
+        grow();
+    }
+
+    size_t i = hash_str(stack) & (slots_cap - 1);
+    while (slots[i].stack) {
+        if (!strcmp(slots[i].stack, stack)) {
+            slots[i].count += count;
+            return;
+        }
+        i = (i + 1) & (slots_cap - 1);
+    }
+    slots[i].stack = strdup(stack);
+    slots[i].count = count;
+    slots_len++;
+}
+
+// Appends `str` to `buf`, replacing characters with a meaning in folded
+// stacks. Returns new length of `buf`.
+static size_t append_frame(char *buf, size_t len, const char *str) {
+    for (; *str && len < PROFILE_STACK_MAX - 1; str++) {
+        char c = *str;
+        buf[len++] = c == ';' ? ',' : c == '\n' ? ' ' : c;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+// Writes the folded Lua stack of `L` into `buf`, rooted at the current test
+static void capture_stack(lua_State *L, char *buf) {
+    static lua_Debug frames[PROFILE_MAX_DEPTH];
+
+    const char *test = "(no test)";
+    taf_state_t *state = taf_state_get();
+    size_t amount;
+    test_case_t *tests = test_case_get_all(&amount);
+    if (state && state->current_test_index < amount) {
+        test = tests[state->current_test_index].name;
+    }
+    size_t len = append_frame(buf, 0, test);
+
+    int depth = 0;
+    while (depth < PROFILE_MAX_DEPTH &&
+           lua_getstack(L, depth, &frames[depth])) {
+        lua_getinfo(L, "Sn", &frames[depth]);
+        depth++;
+    }
+
+    // Folded stacks start with the outermost frame
+    for (int i = depth - 1; i >= 0; i--) {
+        lua_Debug *ar = &frames[i];
+        char frame[256];
+        if (ar->what[0] == 'C') {
+            snprintf(frame, sizeof frame, ";%s [C]", ar->name ? ar->name : "?");
+        } else if (ar->what[0] == 'm') {
+            snprintf(frame, sizeof frame, ";(main) (%s)", ar->short_src);
+        } else {
+            snprintf(frame, sizeof frame, ";%s (%s:%d)",
+                     ar->name ? ar->name : "?", ar->short_src,
+                     ar->linedefined);
+        }
+        len = append_frame(buf, len, frame);
+    }
+}
+
+static void profile_hook(lua_State *L, lua_Debug *ar) {
+    if (ar->event == LUA_HOOKCOUNT) {
+        if (atomic_exchange_explicit(&sample_pending, false,
+                                     memory_order_relaxed)) {
+            char stack[PROFILE_STACK_MAX];
+            capture_stack(L, stack);
+            add_stack(stack, 1);
+        }
+        if (!(wrapped_mask & LUA_MASKCOUNT)) {
+            return;
+        }
+    }
+
+    if (wrapped_hook) {
+        wrapped_hook(L, ar);
+    }
+}
+
+static void *timer_main(void *) {
+    LOG("Profile timer started.");
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (atomic_load(&timer_running)) {
+        next.tv_nsec += PROFILE_INTERVAL_MS * 1000000L;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        atomic_store_explicit(&sample_pending, true, memory_order_relaxed);
+    }
+
+    return NULL;
+}
+
+void profile_start(lua_State *L) {
+    LOG("Starting profiler, sampling every %d ms...", PROFILE_INTERVAL_MS);
+
+    wrapped_hook = lua_gethook(L);
+    wrapped_mask = lua_gethookmask(L);
+    int count = lua_gethookcount(L);
+    lua_sethook(L, profile_hook, wrapped_mask | LUA_MASKCOUNT,
+                wrapped_mask & LUA_MASKCOUNT ? count : PROFILE_HOOK_COUNT);
+
+    profiled_thread = pthread_self();
+    profiling = true;
+
+    atomic_store(&timer_running, true);
+    if (pthread_create(&timer_thread, NULL, timer_main, NULL)) {
+        LOG("Unable to start profile timer: %s", strerror(errno));
+        atomic_store(&timer_running, false);
+    }
+}
+
+int profile_stop(const char *path) {
+    if (!profiling) {
+        return 0;
+    }
+    profiling = false;
+
+    if (atomic_exchange(&timer_running, false)) {
+        pthread_join(timer_thread, NULL);
+    }
+
+    LOG("Writing %zu folded stacks to '%s'...", slots_len, path);
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        LOG("Unable to open profile file '%s'", path);
+    }
+    for (size_t i = 0; i < slots_cap; i++) {
+        if (!slots[i].stack) {
+            continue;
+        }
+        if (fp) {
+            fprintf(fp, "%s %lu\n", slots[i].stack, slots[i].count);
+        }
+        free(slots[i].stack);
+    }
+    free(slots);
+    slots = NULL;
+    slots_cap = 0;
+    slots_len = 0;
+
+    wrapped_hook = NULL;
+    wrapped_mask = 0;
+
+    if (!fp) {
+        return -1;
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+void profile_offcpu_begin(lua_State *L, const char *tag) {
+    if (!profiling || !pthread_equal(profiled_thread, pthread_self()) ||
+        offcpu_depth++ > 0) {
+        return;
+    }
+
+    capture_stack(L, offcpu_stack);
+    size_t len = strlen(offcpu_stack);
+    snprintf(offcpu_stack + len, PROFILE_STACK_MAX - len, ";[%s]", tag);
+    offcpu_started = millis_monotonic();
+}
+
+void profile_offcpu_end() {
+    if (!profiling || !pthread_equal(profiled_thread, pthread_self()) ||
+        offcpu_depth == 0 || --offcpu_depth > 0) {
+        return;
+    }
+
+    unsigned long elapsed = millis_monotonic() - offcpu_started;
+    unsigned long samples =
+        (elapsed + PROFILE_INTERVAL_MS / 2) / PROFILE_INTERVAL_MS;
+    if (samples > 0) {
+        add_stack(offcpu_stack, samples);
+    }
+    // Sample pending since the call started belongs to the blocking call
+    atomic_store_explicit(&sample_pending, false, memory_order_relaxed);
+}
@@ -0,0 +1,543 @@
+#include "raw_log_bin.h"
+
+#include "internal_logging.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static FILE *bin_file = NULL;
+static uint64_t bin_offset = 0;
+
+// Interned strings, NUL-terminated one after another
+static char *strings = NULL;
+static size_t strings_size = 0;
+static size_t strings_cap = 0;
+
+// Open addressing hash map of string offsets + 1, capacity is a power of 2
+static uint32_t *string_slots = NULL;
+static size_t string_slots_cap = 0;
+static size_t string_slots_len = 0;
+
+static raw_log_bin_test_t *index_entries = NULL;
+static size_t index_cap = 0;
+
+static size_t hash_str(const char *str) {
+    size_t h = 1469598103934665603ULL;
+    for (; *str; str++) {
+        h = (h ^ (unsigned char)*str) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static void grow_string_slots() {
+    size_t old_cap = string_slots_cap;
+    uint32_t *old = string_slots;
+
+    string_slots_cap = string_slots_cap ? string_slots_cap * 2 : 1024;
+    string_slots = calloc(string_slots_cap, sizeof *string_slots);
+    if (!string_slots) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old_cap; i++) {
+        if (!old[i]) {
+            continue;
+        }
+        size_t j = hash_str(strings + old[i] - 1) & (string_slots_cap - 1);
+        while (string_slots[j]) {
+            j = (j + 1) & (string_slots_cap - 1);
+        }
+        string_slots[j] = old[i];
+    }
+    free(old);
+}
+
+// Offset of `str` in the string table, added if it is not there yet
+static uint32_t intern(const char *str) {
+    if (!str) {
+        return RAW_LOG_BIN_NO_STRING;
+    }
+    if (string_slots_len * 2 >= string_slots_cap) {
+        grow_string_slots();
+    }
+
+    size_t i = hash_str(str) & (string_slots_cap - 1);
+    while (string_slots[i]) {
+        if (!strcmp(strings + string_slots[i] - 1, str)) {
+            return string_slots[i] - 1;
+        }
+        i = (i + 1) & (string_slots_cap - 1);
+    }
+
+    size_t len = strlen(str) + 1;
+    if (strings_size + len > strings_cap) {
+        while (strings_size + len > strings_cap) {
+            strings_cap = strings_cap ? strings_cap * 2 : 4096;
+        }
+        strings = realloc(strings, strings_cap);
+        if (!strings) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    uint32_t offset = strings_size;
+    memcpy(strings + offset, str, len);
+    strings_size += len;
+
+    string_slots[i] = offset + 1;
+    string_slots_len++;
+    return offset;
+}
+
+static void bin_write(const void *data, size_t size) {
+    if (size && fwrite(data, 1, size, bin_file) != size) {
+        LOG("Unable to write binary raw log.");
+    }
+    bin_offset += size;
+}
+
+static void bin_align(size_t alignment) {
+    static const uint8_t zeros[8] = {0};
+    size_t pad = (alignment - bin_offset % alignment) % alignment;
+    bin_write(zeros, pad);
+}
+
+int raw_log_bin_create(const char *path) {
+    LOG("Creating binary raw log '%s'...", path);
+
+    bin_file = fopen(path, "w");
+    if (!bin_file) {
+        LOG("Unable to create binary raw log '%s'", path);
+        return -1;
+    }
+    bin_offset = 0;
+
+    // Placeholder, written when the log is complete
+    raw_log_bin_header_t header = {0};
+    bin_write(&header, sizeof header);
+
+    return 0;
+}
+
+static void write_messages(const raw_log_test_output_t *outputs, size_t count,
+                           raw_log_bin_output_t *records) {
+    for (size_t i = 0; i < count; i++) {
+        const raw_log_test_output_t *o = &outputs[i];
+        records[i] = (raw_log_bin_output_t){
+            .msg_offset = bin_offset,
+            .msg_len = o->msg_len,
+            .file = intern(o->file),
+            .date_time = intern(o->date_time),
+            .line = o->line,
+            .level = o->level,
+        };
+        bin_write(o->msg, o->msg_len);
+        bin_write("", 1);
+    }
+}
+
+void raw_log_bin_add_test(int index, raw_log_test_t *test) {
+    if (!bin_file) {
+        return;
+    }
+    LOG("Writing test '%s' to binary raw log...", test->name);
+
+    if ((size_t)index > index_cap) {
+        size_t cap = index_cap ? index_cap : 64;
+        while (cap < (size_t)index) {
+            cap *= 2;
+        }
+        index_entries = realloc(index_entries, cap * sizeof *index_entries);
+        if (!index_entries) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = index_cap; i < cap; i++) {
+            index_entries[i] = (raw_log_bin_test_t){
+                .name = RAW_LOG_BIN_NO_STRING,
+                .started = RAW_LOG_BIN_NO_STRING,
+                .finished = RAW_LOG_BIN_NO_STRING,
+                .teardown_start = RAW_LOG_BIN_NO_STRING,
+                .status = RAW_LOG_BIN_NO_STRING,
+            };
+        }
+        index_cap = cap;
+    }
+
+    size_t count = test->outputs_count + test->failure_reasons_count +
+                   test->teardown_outputs_count + test->teardown_errors_count;
+    raw_log_bin_output_t *records = calloc(count ? count : 1, sizeof *records);
+    if (!records) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    raw_log_bin_output_t *r = records;
+    write_messages(test->outputs, test->outputs_count, r);
+    r += test->outputs_count;
+    write_messages(test->failure_reasons, test->failure_reasons_count, r);
+    r += test->failure_reasons_count;
+    write_messages(test->teardown_outputs, test->teardown_outputs_count, r);
+    r += test->teardown_outputs_count;
+    write_messages(test->teardown_errors, test->teardown_errors_count, r);
+
+    raw_log_bin_test_t *entry = &index_entries[index - 1];
+    *entry = (raw_log_bin_test_t){
+        .name = intern(test->name),
+        .started = intern(test->started),
+        .finished = intern(test->finished),
+        .teardown_start = intern(test->teardown_start),
+        .status = intern(test->status),
+        .tags_count = test->tags_count,
+        .outputs_count = test->outputs_count,
+        .failure_reasons_count = test->failure_reasons_count,
+        .teardown_outputs_count = test->teardown_outputs_count,
+        .teardown_errors_count = test->teardown_errors_count,
+        .duration_ms = test->duration_ms,
+    };
+
+    bin_align(8);
+    entry->outputs_offset = bin_offset;
+    bin_write(records, count * sizeof *records);
+    free(records);
+
+    entry->tags_offset = bin_offset;
+    for (size_t i = 0; i < test->tags_count; i++) {
+        uint32_t tag = intern(test->tags[i]);
+        bin_write(&tag, sizeof tag);
+    }
+}
+
+static void writer_free() {
+    free(strings);
+    strings = NULL;
+    strings_size = 0;
+    strings_cap = 0;
+    free(string_slots);
+    string_slots = NULL;
+    string_slots_cap = 0;
+    string_slots_len = 0;
+    free(index_entries);
+    index_entries = NULL;
+    index_cap = 0;
+}
+
+int raw_log_bin_finish(raw_log_t *log) {
+    if (!bin_file) {
+        return -1;
+    }
+    LOG("Finishing binary raw log...");
+
+    raw_log_bin_header_t header = {
+        .version = RAW_LOG_BIN_VERSION,
+        .tests_count = log->tests_count,
+        .tags_count = log->tags_count,
+        .project_name = intern(log->project_name),
+        .taf_version = intern(log->taf_version),
+        .os = intern(log->os),
+        .os_version = intern(log->os_version),
+        .started = intern(log->started),
+        .finished = intern(log->finished),
+        .target = intern(log->target),
+    };
+    memcpy(header.magic, RAW_LOG_BIN_MAGIC, sizeof header.magic);
+
+    bin_align(4);
+    header.tags_offset = bin_offset;
+    for (size_t i = 0; i < log->tags_count; i++) {
+        uint32_t tag = intern(log->tags[i]);
+        bin_write(&tag, sizeof tag);
+    }
+
+    header.strings_offset = bin_offset;
+    header.strings_size = strings_size;
+    bin_write(strings, strings_size);
+
+    bin_align(8);
+    header.index_offset = bin_offset;
+    for (size_t i = 0; i < log->tests_count; i++) {
+        raw_log_bin_test_t none = {
+            .name = RAW_LOG_BIN_NO_STRING,
+            .started = RAW_LOG_BIN_NO_STRING,
+            .finished = RAW_LOG_BIN_NO_STRING,
+            .teardown_start = RAW_LOG_BIN_NO_STRING,
+            .status = RAW_LOG_BIN_NO_STRING,
+        };
+        bin_write(i < index_cap ? &index_entries[i] : &none, sizeof none);
+    }
+
+    int rc = 0;
+    if (fseek(bin_file, 0, SEEK_SET) ||
+        fwrite(&header, sizeof header, 1, bin_file) != 1) {
+        LOG("Unable to write binary raw log header.");
+        rc = -1;
+    }
+    if (fclose(bin_file)) {
+        rc = -1;
+    }
+    bin_file = NULL;
+    writer_free();
+
+    LOG("Binary raw log finished.");
+
+    return rc;
+}
+
+static inline bool range_valid(const raw_log_bin_t *bin, uint64_t offset,
+                               uint64_t count, size_t size) {
+    return offset <= bin->size && count <= (bin->size - offset) / size;
+}
+
+// String with the offset `ref` in the string table, NULL if there is none
+static const char *bin_string(const raw_log_bin_t *bin, uint32_t ref) {
+    if (ref == RAW_LOG_BIN_NO_STRING || ref >= bin->header->strings_size) {
+        return NULL;
+    }
+    return (const char *)bin->data + bin->header->strings_offset + ref;
+}
+
+raw_log_bin_t *raw_log_bin_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(raw_log_bin_header_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    char magic[8];
+    if (read(fd, magic, sizeof magic) != sizeof magic ||
+        memcmp(magic, RAW_LOG_BIN_MAGIC, sizeof magic)) {
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOG("Unable to mmap binary raw log '%s'", path);
+        return NULL;
+    }
+
+    raw_log_bin_t *bin = malloc(sizeof *bin);
+    bin->data = data;
+    bin->size = st.st_size;
+    bin->header = data;
+
+    const raw_log_bin_header_t *h = bin->header;
+    // String table must end with '\0' for strings to be used in place
+    if (h->version != RAW_LOG_BIN_VERSION ||
+        !range_valid(bin, h->strings_offset, h->strings_size, 1) ||
+        h->strings_size == 0 ||
+        bin->data[h->strings_offset + h->strings_size - 1] != '\0' ||
+        h->index_offset % 8 != 0 ||
+        !range_valid(bin, h->index_offset, h->tests_count,
+                     sizeof(raw_log_bin_test_t)) ||
+        h->tags_offset % 4 != 0 ||
+        !range_valid(bin, h->tags_offset, h->tags_count, sizeof(uint32_t))) {
+        LOG("Binary raw log '%s' is incomplete or corrupt", path);
+        raw_log_bin_close(bin);
+        return NULL;
+    }
+    bin->tests = (const raw_log_bin_test_t *)(bin->data + h->index_offset);
+
+    LOG("Mapped binary raw log '%s' with %u tests.", path, h->tests_count);
+
+    return bin;
+}
+
+void raw_log_bin_close(raw_log_bin_t *bin) {
+    if (!bin) {
+        return;
+    }
+    munmap((void *)bin->data, bin->size);
+    free(bin);
+}
+
+// Strings are cast from the read-only mapping, they are never written
+// through the raw log structs
+static char **get_tags(const raw_log_bin_t *bin, uint64_t offset,
+                       uint32_t count) {
+    if (!count || offset % 4 != 0 ||
+        !range_valid(bin, offset, count, sizeof(uint32_t))) {
+        return NULL;
+    }
+    const uint32_t *refs = (const uint32_t *)(bin->data + offset);
+    char **tags = calloc(count, sizeof *tags);
+    for (uint32_t i = 0; i < count; i++) {
+        const char *tag = bin_string(bin, refs[i]);
+        tags[i] = (char *)(tag ? tag : "");
+    }
+    return tags;
+}
+
+void raw_log_bin_get_run(const raw_log_bin_t *bin, raw_log_t *log) {
+    const raw_log_bin_header_t *h = bin->header;
+    memset(log, 0, sizeof *log);
+    log->project_name = (char *)bin_string(bin, h->project_name);
+    log->taf_version = (char *)bin_string(bin, h->taf_version);
+    log->os = (char *)bin_string(bin, h->os);
+    log->os_version = (char *)bin_string(bin, h->os_version);
+    log->started = (char *)bin_string(bin, h->started);
+    log->finished = (char *)bin_string(bin, h->finished);
+    log->target = (char *)bin_string(bin, h->target);
+    log->tags = get_tags(bin, h->tags_offset, h->tags_count);
+    log->tags_count = log->tags ? h->tags_count : 0;
+    log->tests_count = h->tests_count;
+}
+
+void raw_log_bin_put_run(raw_log_t *log) {
+    free(log->tags);
+    log->tags = NULL;
+    log->tags_count = 0;
+}
+
+const char *raw_log_bin_test_name(const raw_log_bin_t *bin, size_t index) {
+    if (index >= bin->header->tests_count) {
+        return NULL;
+    }
+    return bin_string(bin, bin->tests[index].name);
+}
+
+static raw_log_test_output_t *get_outputs(const raw_log_bin_t *bin,
+                                          const raw_log_bin_output_t *records,
+                                          uint32_t count) {
+    if (!count) {
+        return NULL;
+    }
+    raw_log_test_output_t *outputs = calloc(count, sizeof *outputs);
+    for (uint32_t i = 0; i < count; i++) {
+        const raw_log_bin_output_t *r = &records[i];
+        raw_log_test_output_t *o = &outputs[i];
+        if (range_valid(bin, r->msg_offset, (uint64_t)r->msg_len + 1, 1)) {
+            o->msg = (char *)bin->data + r->msg_offset;
+            o->msg_len = r->msg_len;
+        } else {
+            o->msg = "";
+        }
+        const char *file = bin_string(bin, r->file);
+        const char *date_time = bin_string(bin, r->date_time);
+        o->file = (char *)(file ? file : "");
+        o->date_time = (char *)(date_time ? date_time : "");
+        o->line = r->line;
+        o->level = r->level;
+    }
+    return outputs;
+}
+
+bool raw_log_bin_get_test(const raw_log_bin_t *bin, size_t index,
+                          raw_log_test_t *test, bool with_outputs) {
+    memset(test, 0, sizeof *test);
+    if (index >= bin->header->tests_count) {
+        return false;
+    }
+    const raw_log_bin_test_t *e = &bin->tests[index];
+    uint64_t count = (uint64_t)e->outputs_count + e->failure_reasons_count +
+                     e->teardown_outputs_count + e->teardown_errors_count;
+    if (e->name == RAW_LOG_BIN_NO_STRING || e->outputs_offset % 8 != 0 ||
+        !range_valid(bin, e->outputs_offset, count,
+                     sizeof(raw_log_bin_output_t))) {
+        return false;
+    }
+
+    test->name = (char *)bin_string(bin, e->name);
+    test->started = (char *)bin_string(bin, e->started);
+    test->finished = (char *)bin_string(bin, e->finished);
+    test->teardown_start = (char *)bin_string(bin, e->teardown_start);
+    test->status = (char *)bin_string(bin, e->status);
+    test->duration_ms = e->duration_ms;
+    test->tags = get_tags(bin, e->tags_offset, e->tags_count);
+    test->tags_count = test->tags ? e->tags_count : 0;
+
+    const raw_log_bin_output_t *records =
+        (const raw_log_bin_output_t *)(bin->data + e->outputs_offset);
+    const raw_log_bin_output_t *failure_reasons = records + e->outputs_count;
+    const raw_log_bin_output_t *teardown_outputs =
+        failure_reasons + e->failure_reasons_count;
+    const raw_log_bin_output_t *teardown_errors =
+        teardown_outputs + e->teardown_outputs_count;
+
+    test->failure_reasons =
+        get_outputs(bin, failure_reasons, e->failure_reasons_count);
+    test->failure_reasons_count = e->failure_reasons_count;
+    if (with_outputs) {
+        test->outputs = get_outputs(bin, records, e->outputs_count);
+        test->outputs_count = e->outputs_count;
+        test->teardown_outputs =
+            get_outputs(bin, teardown_outputs, e->teardown_outputs_count);
+        test->teardown_outputs_count = e->teardown_outputs_count;
+        test->teardown_errors =
+            get_outputs(bin, teardown_errors, e->teardown_errors_count);
+        test->teardown_errors_count = e->teardown_errors_count;
+    }
+
+    return true;
+}
+
+void raw_log_bin_put_test(raw_log_test_t *test) {
+    free(test->tags);
+    free(test->failure_reasons);
+    free(test->outputs);
+    free(test->teardown_outputs);
+    free(test->teardown_errors);
+    memset(test, 0, sizeof *test);
+}
+
+static inline char *dup_or_null(const char *str) {
+    //
+    return str ? strdup(str) : NULL;
+}
+
+static void copy_outputs(raw_log_test_output_t *outputs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        raw_log_test_output_t *o = &outputs[i];
+        o->msg = strndup(o->msg, o->msg_len);
+        o->file = strdup(o->file);
+        o->date_time = strdup(o->date_time);
+    }
+}
+
+raw_log_t *raw_log_bin_to_raw_log(const raw_log_bin_t *bin) {
+    raw_log_t *log = calloc(1, sizeof *log);
+    raw_log_bin_get_run(bin, log);
+    log->project_name = dup_or_null(log->project_name);
+    log->taf_version = dup_or_null(log->taf_version);
+    log->os = dup_or_null(log->os);
+    log->os_version = dup_or_null(log->os_version);
+    log->started = dup_or_null(log->started);
+    log->finished = dup_or_null(log->finished);
+    log->target = dup_or_null(log->target);
+    for (size_t i = 0; i < log->tags_count; i++) {
+        log->tags[i] = strdup(log->tags[i]);
+    }
+
+    log->tests = calloc(log->tests_count, sizeof *log->tests);
+    for (size_t i = 0; i < log->tests_count; i++) {
+        raw_log_test_t *t = &log->tests[i];
+        if (!raw_log_bin_get_test(bin, i, t, true)) {
+            continue;
+        }
+        // Arrays are kept, only the strings are copied out of the mapping
+        t->name = dup_or_null(t->name);
+        t->started = dup_or_null(t->started);
+        t->finished = dup_or_null(t->finished);
+        t->teardown_start = dup_or_null(t->teardown_start);
+        t->status = dup_or_null(t->status);
+        for (size_t k = 0; k < t->tags_count; k++) {
+            t->tags[k] = strdup(t->tags[k]);
+        }
+        copy_outputs(t->failure_reasons, t->failure_reasons_count);
+        copy_outputs(t->outputs, t->outputs_count);
+        copy_outputs(t->teardown_outputs, t->teardown_outputs_count);
+        copy_outputs(t->teardown_errors, t->teardown_errors_count);
+    }
+
+    return log;
+}
@@ -0,0 +1,211 @@
+#include "source_cache.h"
+
+#include "internal_logging.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    const char *key; // `ar->source` pointer, NULL if the slot is free
+    source_entry_t *entry;
+} source_slot_t;
+
+static source_filter_fn skip_fn = NULL;
+
+// Open addressing hash map, capacity is a power of 2
+static source_slot_t *slots = NULL;
+static size_t slots_cap = 0;
+static size_t slots_len = 0;
+
+// Every entry ever created, they are freed all at once since the TUI render
+// thread may still read entries replaced in the map
+static source_entry_t **entries = NULL;
+static size_t entries_len = 0;
+static size_t entries_cap = 0;
+
+static inline size_t hash_ptr(const char *ptr) {
+    uint64_t h = (uint64_t)(uintptr_t)ptr;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+static void *xrealloc(void *ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static void map_file(source_entry_t *entry) {
+    int fd = open(entry->path, O_RDONLY);
+    if (fd < 0) {
+        LOG("Unable to open source '%s'", entry->path);
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size == 0 || st.st_size > UINT32_MAX) {
+        close(fd);
+        return;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOG("Unable to mmap source '%s'", entry->path);
+        return;
+    }
+    entry->data = data;
+    entry->size = st.st_size;
+
+    // memchr is vectorized by libc, so this is a fast newline scan
+    size_t cap = 256;
+    entry->lines = xrealloc(NULL, cap * sizeof *entry->lines);
+    entry->lines[0] = 0;
+    entry->lines_count = 1;
+    const char *p = entry->data;
+    const char *end = entry->data + entry->size;
+    while ((p = memchr(p, '\n', end - p)) && ++p < end) {
+        if (entry->lines_count == cap) {
+            cap *= 2;
+            entry->lines = xrealloc(entry->lines, cap * sizeof *entry->lines);
+        }
+        entry->lines[entry->lines_count++] = p - entry->data;
+    }
+}
+
+static source_entry_t *entry_new(const char *source) {
+    source_entry_t *entry = calloc(1, sizeof *entry);
+    if (!entry) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    entry->source = strdup(source);
+    entry->path = entry->source[0] == '@' ? entry->source + 1 : entry->source;
+    entry->skip = skip_fn && skip_fn(entry->path);
+    if (!entry->skip) {
+        map_file(entry);
+    }
+    LOG("Cached source '%s', skip: %d, lines: %zu", entry->path, entry->skip,
+        entry->lines_count);
+
+    if (entries_len == entries_cap) {
+        entries_cap = entries_cap ? entries_cap * 2 : 16;
+        entries = xrealloc(entries, entries_cap * sizeof *entries);
+    }
+    entries[entries_len++] = entry;
+
+    return entry;
+}
+
+static void grow() {
+    size_t old_cap = slots_cap;
+    source_slot_t *old = slots;
+
+    slots_cap = slots_cap ? slots_cap * 2 : 64;
+    slots = calloc(slots_cap, sizeof *slots);
+    if (!slots) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old_cap; i++) {
+        if (!old[i].key) {
+            continue;
+        }
+        size_t j = hash_ptr(old[i].key) & (slots_cap - 1);
+        while (slots[j].key) {
+            j = (j + 1) & (slots_cap - 1);
+        }
+        slots[j] = old[i];
+    }
+    free(old);
+}
+
+void source_cache_init(source_filter_fn skip) {
+    //
+    skip_fn = skip;
+}
+
+source_entry_t *source_cache_get(const char *source) {
+    if (slots_len * 2 >= slots_cap) {
+        grow();
+    }
+
+    size_t i = hash_ptr(source) & (slots_cap - 1);
+    while (slots[i].key) {
+        if (slots[i].key == source) {
+            source_entry_t *entry = slots[i].entry;
+            // Lua may reuse the address of a collected chunk source
+            if (strcmp(entry->source, source) != 0) {
+                slots[i].entry = entry_new(source);
+            }
+            return slots[i].entry;
+        }
+        i = (i + 1) & (slots_cap - 1);
+    }
+
+    slots[i].key = source;
+    slots[i].entry = entry_new(source);
+    slots_len++;
+
+    return slots[i].entry;
+}
+
+source_entry_t *source_cache_add(const char *source) {
+    //
+    return entry_new(source);
+}
+
+const char *source_cache_line(const source_entry_t *entry, int line,
+                              size_t *len) {
+    if (!entry || !entry->data || line < 1 ||
+        (size_t)line > entry->lines_count) {
+        return NULL;
+    }
+
+    size_t start = entry->lines[line - 1];
+    size_t end = (size_t)line < entry->lines_count ? entry->lines[line]
+                                                     : entry->size;
+    while (end > start &&
+           (entry->data[end - 1] == '\n' || entry->data[end - 1] == '\r')) {
+        end--;
+    }
+    *len = end - start;
+
+    return entry->data + start;
+}
+
+void source_cache_foreach(void (*fn)(source_entry_t *, void *), void *ud) {
+    for (size_t i = 0; i < entries_len; i++) {
+        fn(entries[i], ud);
+    }
+}
+
+void source_cache_free() {
+    for (size_t i = 0; i < entries_len; i++) {
+        source_entry_t *entry = entries[i];
+        if (entry->data) {
+            munmap((void *)entry->data, entry->size);
+        }
+        free(entry->hits);
+        free(entry->lines);
+        free(entry->source);
+        free(entry);
+    }
+    free(entries);
+    entries = NULL;
+    entries_len = 0;
+    entries_cap = 0;
+
+    free(slots);
+    slots = NULL;
+    slots_cap = 0;
+    slots_len = 0;
+}
@@ -5,65 +5,32 @@
 #include "cmd_parser.h"
 #include "headless.h"
 #include "internal_logging.h"
+#include "taf_state.h"
+#include "test_logs.h"
 
 #include "util/time.h"
 
 #include <stdlib.h>
-
-typedef struct {
-    taf_hook_t *hooks;
-    size_t count;
-    size_t capacity;
-} hook_da_t;
-
-static hook_da_t hooks_test_run_started = {
-    .hooks = NULL,
-    .capacity = 2,
-    .count = 0,
-};
-static hook_da_t hooks_test_started = {
-    .hooks = NULL,
-    .capacity = 2,
-    .count = 0,
-};
-static hook_da_t hooks_test_finished = {
-    .hooks = NULL,
-    .capacity = 2,
-    .count = 0,
-};
-static hook_da_t hooks_test_run_finished = {
-    .hooks = NULL,
-    .capacity = 2,
-    .count = 0,
-};
+#include <string.h>
 
 static bool headless = false;
 
-static inline hook_da_t *taf_get_hooks(taf_hook_fn fn) {
-    switch (fn) {
-    case TAF_HOOK_FN_TEST_RUN_STARTED:
-        return &hooks_test_run_started;
-    case TAF_HOOK_FN_TEST_STARTED:
-        return &hooks_test_started;
-    case TAF_HOOK_FN_TEST_FINISHED:
-        return &hooks_test_finished;
-    case TAF_HOOK_FN_TEST_RUN_FINISHED:
-        return &hooks_test_run_finished;
-    }
-    return NULL;
+static inline taf_hook_list_t *taf_get_hooks(taf_hook_fn fn) {
+    //
+    return &taf_state_get()->hooks[fn];
 }
 
-static void hook_da_append(hook_da_t *hook_da, taf_hook_t hook) {
-    if (!hook_da->hooks) {
-        hook_da->hooks = malloc(sizeof(taf_hook_t) * hook_da->capacity);
+static void hook_list_append(taf_hook_list_t *list, taf_hook_t hook) {
+    if (!list->hooks) {
+        list->capacity = 2;
+        list->hooks = malloc(sizeof(taf_hook_t) * list->capacity);
     }
-    if (hook_da->count >= hook_da->capacity) {
-        hook_da->capacity *= 2;
-        hook_da->hooks =
-            realloc(hook_da->hooks, sizeof(taf_hook_t) * hook_da->capacity);
+    if (list->count >= list->capacity) {
+        list->capacity *= 2;
+        list->hooks = realloc(list->hooks, sizeof(taf_hook_t) * list->capacity);
     }
-    hook_da->hooks[hook_da->count] = hook;
-    hook_da->count++;
+    list->hooks[list->count] = hook;
+    list->count++;
 }
 
 void taf_hooks_init() {
@@ -77,15 +44,15 @@ void taf_hooks_init() {
 
 void taf_hooks_add_to_queue(taf_hook_t hook) {
     LOG("Adding hook with type %d and ref %d", hook.fn, hook.ref);
-    hook_da_t *hooks_da = taf_get_hooks(hook.fn);
-    hook_da_append(hooks_da, hook);
+    taf_hook_list_t *hooks = taf_get_hooks(hook.fn);
+    hook_list_append(hooks, hook);
     LOG("Successfully added hook.");
 }
 
 void taf_hooks_run(lua_State *L, taf_hook_fn fn,
                    int (*context_push)(lua_State *L)) {
     LOG("Running all hooks with type %d...", fn);
-    hook_da_t *hooks = taf_get_hooks(fn);
+    taf_hook_list_t *hooks = taf_get_hooks(fn);
     if (hooks->count == 0) {
         LOG("No hooks found for type %d", fn);
         return;
@@ -99,7 +66,11 @@ void taf_hooks_run(lua_State *L, taf_hook_fn fn,
             const char *err = lua_tostring(L, -1);
             LOG("Error running hook with type %d and ref %d:\n%s", fn, ref,
                 err);
-            if (headless) {
+            if (taf_state_get()->log_silent) {
+                // Runner doesn't own the UI, keep the error in the test log
+                taf_log_test(TAF_LOG_LEVEL_WARNING, "(hook)", 0, err,
+                             strlen(err));
+            } else if (headless) {
                 taf_headless_hook_failed(err);
             } else {
                 char ts[TS_LEN];
@@ -115,9 +86,11 @@ void taf_hooks_run(lua_State *L, taf_hook_fn fn,
 
 void taf_hooks_deinit() {
     LOG("Deinitializing TAF hooks...");
-    free(hooks_test_run_started.hooks);
-    free(hooks_test_started.hooks);
-    free(hooks_test_finished.hooks);
-    free(hooks_test_run_finished.hooks);
+    taf_state_t *state = taf_state_get();
+    for (size_t i = 0; i < TAF_HOOK_FN_COUNT; i++) {
+        free(state->hooks[i].hooks);
+        state->hooks[i].hooks = NULL;
+        state->hooks[i].count = 0;
+    }
     LOG("Successfully deinitialized TAF hooks.");
 }
@@ -19,6 +19,7 @@
 
 static const char *gitignore_contents = //
     "logs/\n"                           //
+    ".taf_cache/\n"                     //
     "\n"                                //
     "\n"                                //
     ".DS_Store"                         //
@@ -4,12 +4,11 @@
 
 #include "cmd_parser.h"
 #include "project_parser.h"
+#include "raw_log_bin.h"
 #include "test_logs.h"
 
 #include "util/files.h"
 
-#include <json.h>
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +18,149 @@
 #include <limits.h>
 #endif // __APPLE__
 
+static void print_outputs(const char *title, raw_log_test_output_t *outputs,
+                          size_t count) {
+    printf("    %s:\n", title);
+    for (size_t j = 0; j < count; j++) {
+        raw_log_test_output_t *output = &outputs[j];
+        printf("---------\n");
+        printf("        %zu: [%s][%s]:\n%s\n", j + 1, output->date_time,
+               taf_log_level_to_str(output->level), output->msg);
+        printf("---------\n");
+    }
+}
+
+static void print_run(raw_log_t *raw_log) {
+    printf("TAF test run started on %s\n", raw_log->started);
+    printf("TAF version %s\n", raw_log->taf_version);
+    printf("Test run performed on %s\n", raw_log->os_version);
+    if (raw_log->target) {
+        printf("Test target: '%s'\n", raw_log->target);
+    }
+    if (raw_log->tags_count != 0) {
+        printf("Test run performed with tags [");
+        for (size_t i = 0; i < raw_log->tags_count; i++) {
+            printf(" '%s'", raw_log->tags[i]);
+            if (i != raw_log->tags_count - 1) {
+                printf(",");
+            }
+        }
+        printf(" ]\n");
+    } else {
+        printf("Test run performed with no tags\n");
+    }
+    printf("Total tests perfomed: %zu\n\n", raw_log->tests_count);
+}
+
+// `test` is NULL if the test did not run
+static void print_test(size_t i, raw_log_test_t *test, bool include_outputs) {
+    if (!test || !test->name) {
+        // Log of a run which was interrupted
+        printf("Test [%zu] was not run\n\n", i + 1);
+        return;
+    }
+    printf("Test [%zu] '%s':\n", i + 1, test->name);
+    printf("    Tags: [");
+    for (size_t j = 0; j < test->tags_count; j++) {
+        printf(" '%s'", test->tags[j]);
+        if (j != test->tags_count - 1) {
+            printf(",");
+        }
+    }
+    printf(" ]\n");
+    printf("    Started: %s\n", test->started);
+    if (!test->status) {
+        printf("    Did not finish\n");
+    } else {
+        printf("    Finished: %s\n", test->finished);
+        printf("    Status: %s\n", test->status);
+    }
+    if (test->status && strcmp("passed", test->status) &&
+        test->failure_reasons_count != 0) {
+        printf("    Failure reasons:\n");
+        for (size_t j = 0; j < test->failure_reasons_count; j++) {
+            raw_log_test_output_t *failure = &test->failure_reasons[j];
+            printf("        %zu: [%s]: %s\n", j + 1,
+                   taf_log_level_to_str(failure->level), failure->msg);
+        }
+    }
+    if (include_outputs) {
+        if (test->outputs_count == 0) {
+            printf("    No test outputs.\n");
+        } else {
+            print_outputs("Outputs", test->outputs, test->outputs_count);
+        }
+        if (test->teardown_outputs_count == 0) {
+            printf("    No teardown outputs.\n");
+        } else {
+            print_outputs("Teardown Outputs", test->teardown_outputs,
+                          test->teardown_outputs_count);
+        }
+        if (test->teardown_errors_count == 0) {
+            printf("    No teardown errors.\n");
+        } else {
+            print_outputs("Teardown errors", test->teardown_errors,
+                          test->teardown_errors_count);
+        }
+    }
+    printf("\n");
+}
+
+static void print_summary(raw_log_t *raw_log, size_t passed) {
+    printf("Total tests passed: %zu\n", passed);
+    printf("Total tests failed: %zu\n", raw_log->tests_count - passed);
+    if (raw_log->finished) {
+        printf("Test run finished on %s\n", raw_log->finished);
+    } else {
+        printf("Test run did not finish\n");
+    }
+}
+
+// Whether the test with the 0-based `index` & `name` is selected by the
+// `--test` option
+static bool test_selected(const char *selected, size_t index,
+                          const char *name) {
+    if (!selected) {
+        return true;
+    }
+    char *end = NULL;
+    unsigned long n = strtoul(selected, &end, 10);
+    if (end && end != selected && *end == '\0') {
+        return n == index + 1;
+    }
+    return name && !strcmp(selected, name);
+}
+
+static inline bool test_passed(raw_log_test_t *test) {
+    //
+    return test->status && !strcmp(test->status, "passed");
+}
+
+// Prints the mapped binary log, reading only the selected tests in full
+static void print_binary_log(raw_log_bin_t *bin,
+                             cmd_logs_info_options *opts) {
+    raw_log_t raw_log;
+    raw_log_bin_get_run(bin, &raw_log);
+    print_run(&raw_log);
+
+    size_t passed = 0;
+    for (size_t i = 0; i < raw_log.tests_count; i++) {
+        const char *name = raw_log_bin_test_name(bin, i);
+        bool selected = test_selected(opts->test, i, name);
+        raw_log_test_t test;
+        bool run = raw_log_bin_get_test(bin, i, &test,
+                                        selected && opts->include_outputs);
+        if (selected) {
+            print_test(i, run ? &test : NULL, opts->include_outputs);
+        }
+        passed += run && test_passed(&test);
+        raw_log_bin_put_test(&test);
+    }
+
+    print_summary(&raw_log, passed);
+    raw_log_bin_put_run(&raw_log);
+}
+
 int taf_logs_info() {
 
     cmd_logs_info_options *opts = cmd_parser_get_logs_info_options();
@@ -39,8 +181,14 @@ int taf_logs_info() {
             return EXIT_FAILURE;
         }
         project_parsed_t *proj = get_parsed_project();
-        snprintf(log_file_path, PATH_MAX, "%s/logs/test_run_latest_raw.json",
-                 proj->project_path);
+        char logs_dir[PATH_MAX];
+        snprintf(logs_dir, PATH_MAX, "%s/logs", proj->project_path);
+        if (!taf_raw_log_get_latest(logs_dir, log_file_path)) {
+            LOG("No latest log in '%s'.", logs_dir);
+            fprintf(stderr, "No test run logs found in %s.\n", logs_dir);
+            internal_logging_deinit();
+            return EXIT_FAILURE;
+        }
     } else if (file_exists(opts->arg)) {
         snprintf(log_file_path, PATH_MAX, "%s", opts->arg);
     } else {
@@ -52,9 +200,17 @@ int taf_logs_info() {
 
     LOG("Log path: %s", log_file_path);
 
-    LOG("Getting json object...");
-    json_object *root = json_object_from_file(log_file_path);
-    raw_log_t *raw_log = taf_json_to_raw_log(root);
+    raw_log_bin_t *bin = raw_log_bin_open(log_file_path);
+    if (bin) {
+        print_binary_log(bin, opts);
+        raw_log_bin_close(bin);
+
+        internal_logging_deinit();
+        project_parser_free();
+        return EXIT_SUCCESS;
+    }
+
+    raw_log_t *raw_log = taf_raw_log_from_file(log_file_path);
     if (!raw_log || !raw_log->os || !raw_log->os_version) {
         LOG("Log file is incorrect or corrupt");
         fprintf(stderr, "Log file %s is either incorrect or corrupt.\n",
@@ -63,97 +219,18 @@ int taf_logs_info() {
         return EXIT_FAILURE;
     }
 
-    printf("TAF test run started on %s\n", raw_log->started);
-    printf("TAF version %s\n", raw_log->taf_version);
-    printf("Test run performed on %s\n", raw_log->os_version);
-    if (raw_log->target) {
-        printf("Test target: '%s'\n", raw_log->target);
-    }
-    if (raw_log->tags_count != 0) {
-        printf("Test run performed with tags [");
-        for (size_t i = 0; i < raw_log->tags_count; i++) {
-            printf(" '%s'", raw_log->tags[i]);
-            if (i != raw_log->tags_count - 1) {
-                printf(",");
-            }
-        }
-        printf(" ]\n");
-    } else {
-        printf("Test run performed with no tags\n");
-    }
-    printf("Total tests perfomed: %zu\n\n", raw_log->tests_count);
+    print_run(raw_log);
     size_t passed = 0;
     for (size_t i = 0; i < raw_log->tests_count; i++) {
         raw_log_test_t *test = &raw_log->tests[i];
-        printf("Test [%zu] '%s':\n", i + 1, test->name);
-        printf("    Tags: [");
-        for (size_t j = 0; j < test->tags_count; j++) {
-            printf(" '%s'", test->tags[j]);
-            if (j != test->tags_count - 1) {
-                printf(",");
-            }
-        }
-        printf(" ]\n");
-        printf("    Started: %s\n", test->started);
-        printf("    Finished: %s\n", test->finished);
-        printf("    Status: %s\n", test->status);
-        if (!strcmp("passed", test->status)) {
-            passed++;
-        } else if (test->failure_reasons_count != 0) {
-            printf("    Failure reasons:\n");
-            for (size_t j = 0; j < test->failure_reasons_count; j++) {
-                raw_log_test_output_t *failure = &test->failure_reasons[j];
-                printf("        %zu: [%s]: %s\n", j + 1,
-                       taf_log_level_to_str(failure->level), failure->msg);
-            }
+        if (test_selected(opts->test, i, test->name)) {
+            print_test(i, test, opts->include_outputs);
         }
-        if (opts->include_outputs) {
-            if (test->outputs_count == 0) {
-                printf("    No test outputs.\n");
-            } else {
-                printf("    Outputs:\n");
-                for (size_t j = 0; j < test->outputs_count; j++) {
-                    raw_log_test_output_t *output = &test->outputs[j];
-                    printf("---------\n");
-                    printf("        %zu: [%s][%s]:\n%s\n", j + 1,
-                           output->date_time,
-                           taf_log_level_to_str(output->level), output->msg);
-                    printf("---------\n");
-                }
-            }
-            if (test->teardown_outputs_count == 0) {
-                printf("    No teardown outputs.\n");
-            } else {
-                printf("    Teardown Outputs:\n");
-                for (size_t j = 0; j < test->teardown_outputs_count; j++) {
-                    raw_log_test_output_t *output = &test->teardown_outputs[j];
-                    printf("---------\n");
-                    printf("        %zu: [%s][%s]:\n%s\n", j + 1,
-                           output->date_time,
-                           taf_log_level_to_str(output->level), output->msg);
-                    printf("---------\n");
-                }
-            }
-            if (test->teardown_errors_count == 0) {
-                printf("    No teardown errors.\n");
-            } else {
-                printf("    Teardown errors:\n");
-                for (size_t j = 0; j < test->teardown_errors_count; j++) {
-                    raw_log_test_output_t *output = &test->teardown_errors[j];
-                    printf("---------\n");
-                    printf("        %zu: [%s][%s]:\n%s\n", j + 1,
-                           output->date_time,
-                           taf_log_level_to_str(output->level), output->msg);
-                    printf("---------\n");
-                }
-            }
-        }
-        printf("\n");
+        passed += test_passed(test);
     }
+    print_summary(raw_log, passed);
 
-    printf("Total tests passed: %zu\n", passed);
-    printf("Total tests failed: %zu\n", raw_log->tests_count - passed);
-    printf("Test run finished on %s\n", raw_log->finished);
+    taf_raw_log_free(raw_log);
 
     internal_logging_deinit();
 
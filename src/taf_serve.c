@@ -0,0 +1,478 @@
+#include "taf_serve.h"
+
+#include "internal_logging.h"
+
+#include "cmd_parser.h"
+#include "project_parser.h"
+#include "taf_test.h"
+#include "test_cache.h"
+
+#include "util/files.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SERVE_DEFAULT_SOCKET TEST_CACHE_DIR "/serve.sock"
+
+// Sent after the output of a run, followed by the exit code and '\a'.
+// It's an OSC sequence, so it's invisible even if printed as is.
+#define SERVE_EXIT_MARKER "\x1b]taf-exit;"
+#define SERVE_EXIT_MARKER_MAX 32
+
+#define SERVE_MAX_ARGS 1024
+#define SERVE_MAX_ARG_LEN 65536
+
+#define SERVE_POLL_MS 200
+
+// Reads of a request wait at most this long, so a client which never sends
+// its request doesn't keep its run forever
+#define SERVE_REQUEST_TIMEOUT_MS 5000
+
+typedef struct {
+    pid_t pid;
+    int fd;
+} serve_run_t;
+
+static volatile sig_atomic_t stop = 0;
+
+static serve_run_t *runs = NULL;
+static size_t runs_count = 0;
+
+static void handle_stop(int) { stop = 1; }
+
+static int socket_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr->sun_path) {
+        fprintf(stderr, "Socket path '%s' is too long.\n", path);
+        LOG("Socket path '%s' is too long.", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// Hash of the files loaded into the prewarmed state, the state is rebuilt
+// when it changes
+static uint64_t project_signature(project_parsed_t *proj) {
+    const char *dirs[] = {"lib", "hooks"};
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t d = 0; d < sizeof dirs / sizeof *dirs; d++) {
+        char *dir;
+        asprintf(&dir, "%s/%s", proj->project_path, dirs[d]);
+        str_array_t files = list_lua_recursive(dir);
+        free(dir);
+        for (size_t i = 0; i < files.count; i++) {
+            struct stat sb;
+            if (stat(files.items[i], &sb)) {
+                continue;
+            }
+            int64_t values[] = {sb.st_mtime, sb.st_size, sb.st_ino};
+            for (const char *p = files.items[i]; *p; p++) {
+                hash = (hash ^ (unsigned char)*p) * 1099511628211ull;
+            }
+            const unsigned char *v = (const unsigned char *)values;
+            for (size_t j = 0; j < sizeof values; j++) {
+                hash = (hash ^ v[j]) * 1099511628211ull;
+            }
+        }
+        free_str_array(&files);
+    }
+    return hash;
+}
+
+static void send_exit_code(int fd, int exitcode) {
+    char trailer[SERVE_EXIT_MARKER_MAX];
+    int n = snprintf(trailer, sizeof trailer, SERVE_EXIT_MARKER "%d\a",
+                     exitcode);
+    fd_write_full(fd, trailer, n);
+}
+
+static int read_u32(int fd, uint32_t *value) {
+    return fd_read_full(fd, value, sizeof *value) == sizeof *value ? 0 : -1;
+}
+
+// Reads a length-prefixed string, returns NULL on error
+static char *read_string(int fd) {
+    uint32_t len;
+    if (read_u32(fd, &len) || len > SERVE_MAX_ARG_LEN) {
+        return NULL;
+    }
+    char *str = malloc(len + 1);
+    if (fd_read_full(fd, str, len) != len) {
+        free(str);
+        return NULL;
+    }
+    str[len] = '\0';
+    return str;
+}
+
+// Reads `taf test` arguments of a request, returns NULL on error
+static char **read_request(int fd, int *argc) {
+    uint32_t count;
+    if (read_u32(fd, &count) || count < 2 || count > SERVE_MAX_ARGS) {
+        return NULL;
+    }
+    char **argv = calloc(count + 1, sizeof *argv);
+    for (uint32_t i = 0; i < count; i++) {
+        argv[i] = read_string(fd);
+        if (!argv[i]) {
+            goto error;
+        }
+    }
+    *argc = count;
+    return argv;
+
+error:
+    for (uint32_t i = 0; i < count; i++) {
+        free(argv[i]);
+    }
+    free(argv);
+    return NULL;
+}
+
+static void reap_runs() {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (size_t i = 0; i < runs_count; i++) {
+            if (runs[i].pid != pid) {
+                continue;
+            }
+            int exitcode = WIFEXITED(status)     ? WEXITSTATUS(status)
+                           : WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                                                 : EXIT_FAILURE;
+            LOG("Run %d finished with exit code %d.", pid, exitcode);
+            // Run has flushed all its output before exiting
+            send_exit_code(runs[i].fd, exitcode);
+            close(runs[i].fd);
+            runs[i] = runs[--runs_count];
+            break;
+        }
+    }
+}
+
+// Reads the request of the client on `fd` & runs it. The request is read
+// here, so a slow client never stalls the daemon.
+static void run_child(lua_State *L, int listen_fd, int fd) {
+    close(listen_fd);
+    for (size_t i = 0; i < runs_count; i++) {
+        close(runs[i].fd);
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    struct timeval timeout = {
+        .tv_sec = SERVE_REQUEST_TIMEOUT_MS / 1000,
+        .tv_usec = SERVE_REQUEST_TIMEOUT_MS % 1000 * 1000,
+    };
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout)) {
+        LOG("setsockopt failed: %s", strerror(errno));
+    }
+    char *cwd = read_string(fd);
+    int argc = 0;
+    char **argv = cwd ? read_request(fd, &argc) : NULL;
+
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    if (!argv) {
+        LOG("Invalid request.");
+        fprintf(stderr, "Invalid request to taf serve.\n");
+        exit(EXIT_FAILURE);
+    }
+    LOG("Request with %d arguments from '%s'.", argc, cwd);
+
+    // Relative paths of the arguments are relative to the client
+    if (chdir(cwd)) {
+        fprintf(stderr, "Unable to change directory to '%s': %s\n", cwd,
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (strcmp(argv[1], "test") || cmd_parser_parse(argc, argv) != CMD_TEST) {
+        fprintf(stderr, "Only 'taf test' can be requested.\n");
+        exit(EXIT_FAILURE);
+    }
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    opts->headless = true;
+
+    exit(taf_test_prewarmed(L));
+}
+
+static void handle_connection(lua_State **L, int listen_fd, int fd,
+                              uint64_t *signature) {
+    project_parsed_t *proj = get_parsed_project();
+    uint64_t current = project_signature(proj);
+    if (!*L || current != *signature) {
+        LOG("Project changed, prewarming Lua state again...");
+        if (*L) {
+            taf_test_prewarm_free(*L);
+        }
+        *L = taf_test_prewarm();
+        *signature = current;
+    }
+    if (!*L) {
+        const char *msg = "Unable to load the project.\n";
+        fd_write_full(fd, msg, strlen(msg));
+        send_exit_code(fd, EXIT_FAILURE);
+        close(fd);
+        return;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == -1) {
+        LOG("fork failed: %s", strerror(errno));
+        send_exit_code(fd, EXIT_FAILURE);
+        close(fd);
+        return;
+    }
+    if (pid == 0) {
+        run_child(*L, listen_fd, fd);
+    }
+
+    LOG("Started run %d.", pid);
+    runs = realloc(runs, (runs_count + 1) * sizeof *runs);
+    runs[runs_count].pid = pid;
+    runs[runs_count].fd = fd;
+    runs_count++;
+}
+
+static int serve_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (socket_address(path, &addr)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    // Socket file may be left from a daemon which didn't exit cleanly
+    if (!connect(fd, (struct sockaddr *)&addr, sizeof addr)) {
+        fprintf(stderr, "taf serve is already running on '%s'.\n", path);
+        close(fd);
+        return -1;
+    }
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof addr) || listen(fd, 64)) {
+        fprintf(stderr, "Unable to listen on '%s': %s\n", path,
+                strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int taf_serve() {
+    cmd_test_options *test_opts = cmd_parser_get_test_options();
+    cmd_serve_options *opts = cmd_parser_get_serve_options();
+
+    if (test_opts->internal_logging && internal_logging_init()) {
+        fprintf(stderr, "Unable to init internal logging.\n");
+        return EXIT_FAILURE;
+    }
+
+    LOG("Starting TAF serve...");
+
+    if (project_parser_parse()) {
+        internal_logging_deinit();
+        return EXIT_FAILURE;
+    }
+    project_parsed_t *proj = get_parsed_project();
+
+    char socket_path[PATH_MAX];
+    if (opts->socket_path) {
+        snprintf(socket_path, PATH_MAX, "%s", opts->socket_path);
+    } else {
+        char dir[PATH_MAX];
+        snprintf(dir, PATH_MAX, "%s/" TEST_CACHE_DIR, proj->project_path);
+        create_directory(dir, MKDIR_MODE);
+        snprintf(socket_path, PATH_MAX, "%s/" SERVE_DEFAULT_SOCKET,
+                 proj->project_path);
+    }
+
+    uint64_t signature = project_signature(proj);
+    lua_State *L = taf_test_prewarm();
+    if (!L) {
+        project_parser_free();
+        internal_logging_deinit();
+        return EXIT_FAILURE;
+    }
+
+    int listen_fd = serve_listen(socket_path);
+    if (listen_fd == -1) {
+        taf_test_prewarm_free(L);
+        project_parser_free();
+        internal_logging_deinit();
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction sa = {0};
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("Serving project '%s' on '%s'.\n", proj->project_name,
+           socket_path);
+    fflush(stdout);
+
+    struct pollfd pfd = {.fd = listen_fd, .events = POLLIN};
+    while (!stop) {
+        int rc = poll(&pfd, 1, SERVE_POLL_MS);
+        reap_runs();
+        if (rc <= 0) {
+            continue;
+        }
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd == -1) {
+            continue;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        handle_connection(&L, listen_fd, fd, &signature);
+    }
+
+    LOG("Stopping TAF serve...");
+    printf("Stopping, waiting for %zu runs...\n", runs_count);
+    close(listen_fd);
+    unlink(socket_path);
+    while (runs_count > 0) {
+        reap_runs();
+        usleep(SERVE_POLL_MS * 1000);
+    }
+    free(runs);
+
+    if (L) {
+        taf_test_prewarm_free(L);
+    }
+    project_parser_free();
+    internal_logging_deinit();
+
+    return EXIT_SUCCESS;
+}
+
+static int write_u32(int fd, uint32_t value) {
+    return fd_write_full(fd, &value, sizeof value);
+}
+
+// Output is printed as it comes, except for the last few bytes which may be
+// the exit code trailer
+static int relay_output(int fd) {
+    char buf[4096 + SERVE_EXIT_MARKER_MAX];
+    size_t held = 0;
+    while (true) {
+        ssize_t n = read(fd, buf + held, sizeof buf - held);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        held += n;
+        if (held > SERVE_EXIT_MARKER_MAX) {
+            size_t out = held - SERVE_EXIT_MARKER_MAX;
+            fwrite(buf, 1, out, stdout);
+            fflush(stdout);
+            memmove(buf, buf + out, SERVE_EXIT_MARKER_MAX);
+            held = SERVE_EXIT_MARKER_MAX;
+        }
+    }
+
+    size_t marker_len = strlen(SERVE_EXIT_MARKER);
+    for (size_t i = 0; i + marker_len <= held; i++) {
+        if (memcmp(buf + i, SERVE_EXIT_MARKER, marker_len)) {
+            continue;
+        }
+        fwrite(buf, 1, i, stdout);
+        fflush(stdout);
+        buf[held] = '\0';
+        return atoi(buf + i + marker_len);
+    }
+
+    fwrite(buf, 1, held, stdout);
+    fflush(stdout);
+    fprintf(stderr, "Connection to taf serve closed unexpectedly.\n");
+    return EXIT_FAILURE;
+}
+
+int taf_serve_request() {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+
+    struct sockaddr_un addr;
+    if (socket_address(opts->server, &addr)) {
+        return EXIT_FAILURE;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof addr)) {
+        fprintf(stderr, "Unable to connect to taf serve on '%s': %s\n",
+                opts->server, strerror(errno));
+        if (fd != -1) {
+            close(fd);
+        }
+        return EXIT_FAILURE;
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof cwd)) {
+        fprintf(stderr, "Unable to get current directory: %s\n",
+                strerror(errno));
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    int argc;
+    char **argv;
+    cmd_parser_get_args(&argc, &argv);
+
+    // Same arguments without --server
+    uint32_t count = 0;
+    for (int i = 0; i < argc; i++) {
+        if (!strcmp(argv[i], "--server") || !strcmp(argv[i], "-S")) {
+            i++;
+            continue;
+        }
+        count++;
+    }
+    uint32_t cwd_len = strlen(cwd);
+    int rc = write_u32(fd, cwd_len) || fd_write_full(fd, cwd, cwd_len) ||
+             write_u32(fd, count);
+    for (int i = 0; i < argc && !rc; i++) {
+        if (!strcmp(argv[i], "--server") || !strcmp(argv[i], "-S")) {
+            i++;
+            continue;
+        }
+        uint32_t len = strlen(argv[i]);
+        rc = write_u32(fd, len) || fd_write_full(fd, argv[i], len);
+    }
+    if (rc) {
+        fprintf(stderr, "Unable to send request to taf serve.\n");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    shutdown(fd, SHUT_WR);
+
+    int exitcode = relay_output(fd);
+    close(fd);
+    return exitcode;
+}
@@ -0,0 +1,59 @@
+#include "taf_state.h"
+
+#include "internal_logging.h"
+
+#include <lauxlib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static _Thread_local taf_state_t *current_state = NULL;
+
+taf_state_t *taf_state_new() {
+    LOG("Creating new TAF runner state...");
+
+    taf_state_t *state = calloc(1, sizeof *state);
+    if (!state) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    state->log_test_index = -1;
+    state->defer_ref = LUA_NOREF;
+
+    LOG("Successfully created TAF runner state.");
+
+    return state;
+}
+
+taf_state_t *taf_state_new_shared(taf_state_t *parent) {
+    taf_state_t *state = taf_state_new();
+
+    state->L = parent->L;
+    state->tests = parent->tests;
+    state->tests_len = parent->tests_len;
+    state->tests_cap = parent->tests_cap;
+    for (size_t i = 0; i < TAF_HOOK_FN_COUNT; i++) {
+        state->hooks[i] = parent->hooks[i];
+    }
+
+    return state;
+}
+
+void taf_state_free(taf_state_t *state) {
+    LOG("Freeing TAF runner state...");
+    if (current_state == state) {
+        current_state = NULL;
+    }
+    free(state);
+    LOG("Successfully freed TAF runner state.");
+}
+
+taf_state_t *taf_state_get() {
+    //
+    return current_state;
+}
+
+void taf_state_set(taf_state_t *state) {
+    //
+    current_state = state;
+}
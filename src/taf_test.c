@@ -3,13 +3,29 @@
 #include "headless.h"
 #include "internal_logging.h"
 
+#include "bytecode_cache.h"
 #include "cmd_parser.h"
+#include "coverage.h"
 #include "modules/http/taf-http.h"
+#include "profile.h"
 #include "project_parser.h"
+#include "source_cache.h"
 #include "taf_hooks.h"
+#include "taf_serve.h"
+#include "taf_state.h"
 #include "taf_tui.h"
+#include "test_cache.h"
 #include "test_case.h"
+#include "test_each.h"
+#include "test_history.h"
 #include "test_logs.h"
+#include "test_order.h"
+#include "test_pool.h"
+#include "test_scheduler.h"
+#include "test_shard.h"
+#include "test_targets.h"
+#include "test_timeout.h"
+#include "test_watch.h"
 #include "version.h"
 
 #include "modules/json/taf-json.h"
@@ -24,14 +40,12 @@
 #include <lua.h>
 #include <lualib.h>
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-static int g_first = 0;
-static int g_last = 0;
-
 static char *module_path = NULL;
 
 static char *test_dir_path = NULL;
@@ -39,81 +53,100 @@ static char *test_common_dir_path = NULL;
 static char *lib_dir_path = NULL;
 static char *hooks_dir_path = NULL;
 
-typedef struct line_cache {
-    char *path;
-    char **lines;
-    struct line_cache *next;
-} line_cache_t;
+// Project is loaded before the test options are known (`taf serve`)
+static bool prewarmed = false;
+
+// History of the previous runs, loaded on demand
+static test_history_t *history = NULL;
 
-static line_cache_t *cache_head = NULL;
+// Tests of the current shard and their order, selected once and reused by
+// every Lua state
+static bool *shard_keep = NULL;
+static size_t shard_keep_len = 0;
+static size_t *test_order = NULL;
+static size_t test_order_len = 0;
 
 static bool headless = false;
 
-static char *get_line_text(const char *path, int lineno) {
+#define COVERAGE_FILE "coverage.info"
 
-    for (line_cache_t *c = cache_head; c; c = c->next) {
-        if (strcmp(c->path, path) == 0) {
-            return c->lines[lineno - 1]; // lineno is 1-based
-        }
+#define PROFILE_SUFFIX "_profile.folded"
+#define PROFILE_FILE "profile.folded"
+
+static bool skip_source(const char *path) {
+    // Internal module & hook lines are not shown
+    return strncasecmp(module_path, path, strlen(module_path)) == 0 ||
+           strncasecmp(hooks_dir_path, path, strlen(hooks_dir_path)) == 0;
+}
+
+static bool path_in_dir(const char *path, const char *dir) {
+    if (!dir) {
+        return false;
     }
+    size_t len = strlen(dir);
+    return !strncmp(path, dir, len) && path[len] == '/';
+}
 
-    FILE *fp = fopen(path, "r");
-    if (!fp)
-        return NULL;
+static bool covered_source(const char *path) {
+    return path_in_dir(path, test_dir_path) ||
+           path_in_dir(path, test_common_dir_path) ||
+           path_in_dir(path, lib_dir_path);
+}
 
-    line_cache_t *c = malloc(sizeof *c);
-    c->path = strdup(path);
-    c->lines = NULL;
-    c->next = cache_head;
-    cache_head = c;
+// Instructions between checks of the progress sampling clock
+#define PROGRESS_SAMPLING_HOOK_COUNT 1000
 
-    size_t cap = 0, n = 0;
-    char *line = NULL;
-    size_t len = 0;
+// The TUI is redrawn at most 30 times a second, sampling faster is wasted
+#define PROGRESS_SAMPLING_INTERVAL_MS 10
 
-    while (getline(&line, &len, fp) > 0) {
-        if (n == cap) {
-            cap = cap ? cap * 2 : 128;
-            c->lines = realloc(c->lines, sizeof(char *) * (cap + 1));
-        }
-        c->lines[n++] = strdup(line);
-    }
-    free(line);
-    c->lines[n] = NULL;
-    fclose(fp);
+static unsigned long next_progress_sample = 0;
+
+static void report_line(const source_entry_t *source, int line) {
+    taf_tui_set_current_line(source, line);
 
-    return (lineno > 0 && lineno <= (int)n) ? c->lines[lineno - 1] : NULL;
+    taf_state_t *state = taf_state_get();
+    int first = state->test_first_line;
+    int div = state->test_last_line - first;
+    double progress;
+    progress = div == 0 ? 0 : (double)(line - first) / div;
+    taf_tui_set_test_progress(progress);
 }
 
 static void line_hook(lua_State *L, lua_Debug *ar) {
     if (lua_getinfo(L, "Sl", ar) && ar->currentline > 0) {
 
-        const char *src = ar->source;
-        if (src[0] == '@')
-            src++;
-
-        if (strncasecmp(module_path, src, strlen(module_path)) == 0) {
-            // Skip internal module lines
+        const source_entry_t *source = source_cache_get(ar->source);
+        if (source->skip) {
             return;
         }
 
-        if (strncasecmp(hooks_dir_path, src, strlen(hooks_dir_path)) == 0) {
-            // Skip hook lines
-            return;
-        }
+        report_line(source, ar->currentline);
+    }
+}
 
-        const char *text = get_line_text(src, ar->currentline);
+// Line hook recording executed lines, also feeds the TUI unless headless
+static void coverage_hook(lua_State *L, lua_Debug *ar) {
+    if (lua_getinfo(L, "Sl", ar) && ar->currentline > 0) {
 
-        taf_tui_set_current_line(src, ar->currentline,
-                                 text ? text : "(source unavailable)");
+        source_entry_t *source = source_cache_get(ar->source);
+        coverage_hit(source, ar->currentline);
 
-        int div = g_last - g_first;
-        double progress;
-        progress = div == 0 ? 0 : (double)(ar->currentline - g_first) / div;
-        taf_tui_set_test_progress(progress);
+        if (!headless && !source->skip) {
+            report_line(source, ar->currentline);
+        }
+    }
+}
 
-        taf_tui_update();
+// Count hook reporting the current line at most every
+// PROGRESS_SAMPLING_INTERVAL_MS, so the hook costs a clock read per
+// PROGRESS_SAMPLING_HOOK_COUNT instructions
+static void sampling_hook(lua_State *L, lua_Debug *ar) {
+    unsigned long now = millis_monotonic();
+    if (now < next_progress_sample) {
+        return;
     }
+    next_progress_sample = now + PROGRESS_SAMPLING_INTERVAL_MS;
+    line_hook(L, ar);
 }
 
 static int taf_errhandler(lua_State *L) {
@@ -127,13 +160,14 @@ static int taf_errhandler(lua_State *L) {
 static void run_deferred(lua_State *L, const char *status) {
     LOG("Running deferred test queue...");
 
-    lua_getfield(L, LUA_REGISTRYINDEX, DEFER_LIST_KEY);
-    if (lua_isnil(L, -1)) {
+    taf_state_t *state = taf_state_get();
+    if (state->defer_ref == LUA_NOREF) {
         LOG("Defer queue is empty.");
-        lua_pop(L, 1);
         return;
     }
 
+    lua_rawgeti(L, LUA_REGISTRYINDEX, state->defer_ref);
+
     int list = lua_gettop(L);
     lua_Integer n = luaL_len(L, list);
 
@@ -192,113 +226,179 @@ static void run_deferred(lua_State *L, const char *status) {
     taf_log_defer_queue_finished();
 
     LOG("Clearing defer list...");
-    lua_pushnil(L);
-    lua_setfield(L, LUA_REGISTRYINDEX, DEFER_LIST_KEY);
+    lua_pop(L, 1);
+    luaL_unref(L, LUA_REGISTRYINDEX, state->defer_ref);
+    state->defer_ref = LUA_NOREF;
     LOG("Defer list cleared.");
 
     LOG("Finished running defer queue.");
 }
 
-static bool test_marked_failed = false;
+void taf_mark_test_failed() { taf_state_get()->test_marked_failed = true; }
 
-void taf_mark_test_failed() { test_marked_failed = true; }
+test_case_t *taf_test_get_current_test() {
+    taf_state_t *state = taf_state_get();
+    return &state->tests[state->current_test_index];
+}
 
-static size_t current_test_index = 0;
+// Timeout of the test in ms, 0 if it has none
+static unsigned long get_test_timeout(test_case_t *test) {
+    if (test->timeout != 0) {
+        return test->timeout;
+    }
+    return cmd_parser_get_test_options()->test_timeout;
+}
 
-test_case_t *taf_test_get_current_test() {
+// Starts test with index `i`, leaving error handler and test body on top of
+// the stack. Returns error handler index.
+static int test_begin(lua_State *L, size_t i) {
+    taf_state_t *state = taf_state_get();
     test_case_t *tests = test_case_get_all(NULL);
-    return &tests[current_test_index];
-}
 
-static int run_all_tests(lua_State *L) {
-    LOG("Running tests...");
+    state->test_marked_failed = false;
+    state->current_test_index = i;
 
-    size_t passed = 0;
+    taf_log_test_started(i + 1, tests[i]);
+    taf_hooks_run(L, TAF_HOOK_FN_TEST_STARTED, hooks_context_push);
 
-    size_t amount;
-    test_case_t *tests = test_case_get_all(&amount);
-    LOG("Test amount: %zu", amount);
-    taf_log_tests_create(amount);
-    taf_hooks_run(L, TAF_HOOK_FN_TEST_RUN_STARTED, hooks_context_push);
-    reset_taf_start_millis();
+    LOG("Setting up error handler...");
+    lua_pushcfunction(L, taf_errhandler);
+    int erridx = lua_gettop(L);
+    LOG("Error handler index: %d", erridx);
 
-    for (size_t i = 0; i < amount; ++i) {
+    LOG("Pushing test body with index %d...", tests[i].ref);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, tests[i].ref);
+    lua_pushvalue(L, -1);
+    lua_Debug ar;
+    if (lua_getinfo(L, ">S", &ar)) {
+        state->test_first_line = ar.linedefined;
+        state->test_last_line = ar.lastlinedefined;
+    }
+    if (tests[i].row != 0) {
+        // Case of taf.test_each, body is called with its row
+        test_each_wrap_body(L, &tests[i]);
+    }
 
-        test_marked_failed = false;
-        current_test_index = i;
+    state->test_start_millis = millis_monotonic();
 
-        taf_log_test_started(i + 1, tests[i]);
-        taf_hooks_run(L, TAF_HOOK_FN_TEST_STARTED, hooks_context_push);
+    test_timeout_arm(L, get_test_timeout(&tests[i]));
 
-        LOG("Setting up error handler...");
-        lua_pushcfunction(L, taf_errhandler);
-        int erridx = lua_gettop(L);
-        LOG("Error handler index: %d", erridx);
+    LOG("Executing test '%s'...", tests[i].name);
 
-        LOG("Pushing test body with index %d...", tests[i].ref);
-        lua_rawgeti(L, LUA_REGISTRYINDEX, tests[i].ref);
-        lua_pushvalue(L, -1);
-        lua_Debug ar;
-        if (lua_getinfo(L, ">S", &ar)) {
-            g_first = ar.linedefined;
-            g_last = ar.lastlinedefined;
-        }
+    return erridx;
+}
 
-        LOG("Resetting taf.millis...");
-        reset_millis();
+// Finishes test with index `i` which test body returned `rc`.
+// Returns true if test passed.
+static bool test_finish(lua_State *L, size_t i, int rc, int erridx) {
+    taf_state_t *state = taf_state_get();
+    test_case_t *tests = test_case_get_all(NULL);
+    bool passed = false;
 
-        LOG("Executing test '%s'...", tests[i].name);
-        int rc = lua_pcall(L, 0, 0, erridx);
-        LOG("Finished executing test '%s', status: %d", tests[i].name, rc);
+    LOG("Finished executing test '%s', status: %d", tests[i].name, rc);
 
-        char *file = NULL;
-        int line = 0;
-        char *trace = NULL;
+    // Deferred functions & hooks run without the deadline
+    bool timed_out = test_timeout_disarm(L);
 
-        if (rc != LUA_OK) {
-            trace = strdup(lua_tostring(L, -1)); /* traceback string */
-            LOG("Test '%s' traceback: %s", tests[i].name, trace);
+    char *file = NULL;
+    int line = 0;
+    char *trace = NULL;
 
-            if (trace) {
-                const char *colon1 = strchr(trace, ':');
-                if (colon1) {
-                    const char *colon2 = strchr(colon1 + 1, ':');
-                    if (colon2) {
-                        file = strndup(trace, colon1 - trace);
-                        line = atoi(colon1 + 1);
-                    }
+    if (rc != LUA_OK) {
+        trace = strdup(lua_tostring(L, -1)); /* traceback string */
+        LOG("Test '%s' traceback: %s", tests[i].name, trace);
+
+        if (trace) {
+            const char *colon1 = strchr(trace, ':');
+            if (colon1) {
+                const char *colon2 = strchr(colon1 + 1, ':');
+                if (colon2) {
+                    file = strndup(trace, colon1 - trace);
+                    line = atoi(colon1 + 1);
                 }
             }
-            lua_pop(L, 1); /* pop traceback */
         }
+        lua_pop(L, 1); /* pop traceback */
+    }
 
-        LOG("Popping error handler...");
-        lua_remove(L, erridx);
-
-        if (rc == LUA_OK) {
-            if (test_marked_failed) {
-                taf_log_test_failed(i + 1, tests[i], NULL, NULL, 0);
-            } else {
-                taf_log_test_passed(i + 1, tests[i]);
-                passed++;
-            }
+    LOG("Popping error handler...");
+    lua_remove(L, erridx);
+
+    if (rc == LUA_OK && timed_out) {
+        // Timeout error was caught by the test itself
+        char msg[64];
+        snprintf(msg, sizeof msg, "Test timed out after %lu ms",
+                 get_test_timeout(&tests[i]));
+        taf_log_test_failed(i + 1, tests[i], msg,
+                            tests[i].file ? tests[i].file : "(?)",
+                            state->test_first_line);
+        rc = LUA_ERRRUN;
+    } else if (rc == LUA_OK) {
+        if (state->test_marked_failed) {
+            taf_log_test_failed(i + 1, tests[i], NULL, NULL, 0);
         } else {
-            taf_log_test_failed(i + 1, tests[i],
-                                trace ? trace : "unknown error",
-                                file ? file : "(?)", line);
-            free(file);
-            free(trace);
+            taf_log_test_passed(i + 1, tests[i]);
+            passed = true;
         }
+    } else {
+        taf_log_test_failed(i + 1, tests[i], trace ? trace : "unknown error",
+                            file ? file : "(?)", line);
+        free(file);
+        free(trace);
+    }
+
+    run_deferred(L, rc == LUA_OK ? "passed" : "failed");
 
-        run_deferred(L, rc == LUA_OK ? "passed" : "failed");
+    taf_hooks_run(L, TAF_HOOK_FN_TEST_FINISHED, hooks_context_push);
+
+    return passed;
+}
 
-        taf_hooks_run(L, TAF_HOOK_FN_TEST_FINISHED, hooks_context_push);
+// Reports test with index `i` as passed without running it if its result
+// is cached. Returns true if it was.
+static bool run_cached_test(size_t i) {
+    if (!test_cache_hit(i)) {
+        return false;
     }
+    test_case_t *tests = test_case_get_all(NULL);
+    LOG("Skipping cached test '%s'...", tests[i].name);
 
-    taf_hooks_run(L, TAF_HOOK_FN_TEST_RUN_FINISHED, hooks_context_push);
-    taf_log_tests_finalize();
+    taf_log_test_started(i + 1, tests[i]);
+    const char *msg = "Unchanged since it passed, result reused from cache.";
+    taf_log_test(TAF_LOG_LEVEL_INFO, "(cache)", 0, msg, strlen(msg));
+    taf_log_test_passed(i + 1, tests[i]);
 
-    return passed == amount ? EXIT_SUCCESS : EXIT_FAILURE;
+    return true;
+}
+
+static bool run_test(lua_State *L, size_t i) {
+    if (run_cached_test(i)) {
+        return true;
+    }
+    int erridx = test_begin(L, i);
+    int rc = lua_pcall(L, 0, 0, erridx);
+    return test_finish(L, i, rc, erridx);
+}
+
+static int run_test_coroutine_k(lua_State *L, int status, lua_KContext ctx) {
+    // Error handler is the only value below the test body
+    test_finish(L, (size_t)ctx, status == LUA_YIELD ? LUA_OK : status, 1);
+    return 0;
+}
+
+// Coroutine body for the test scheduler, test index is the only argument.
+// Test body may yield to the scheduler while waiting.
+static int run_test_coroutine(lua_State *L) {
+    size_t i = lua_tointeger(L, 1);
+    lua_settop(L, 0);
+
+    if (run_cached_test(i)) {
+        return 0;
+    }
+
+    int erridx = test_begin(L, i);
+    int rc = lua_pcallk(L, 0, 0, erridx, i, run_test_coroutine_k);
+    return run_test_coroutine_k(L, rc, i);
 }
 
 static char *get_lib_dir() {
@@ -348,34 +448,35 @@ static char *get_lib_dir() {
     return strdup(default_path);
 }
 
-static void inject_modules_dir(lua_State *L) {
-    LOG("Injecting TAF library directory...");
-
-    module_path = get_lib_dir();
-
+static void append_package_path(lua_State *L, const char *dir) {
     lua_getglobal(L, "package");
     lua_getfield(L, -1, "path"); /* pkg.path string */
-    const char *old_path = lua_tostring(L, -1);
-    if (directory_exists(test_common_dir_path)) {
-        lua_pushfstring(L,
-                        "%s;%s/?.lua;%s/?/init.lua;%s/?.lua;%s/?/init.lua;%s/"
-                        "?.lua;%s/?/init.lua;%s/?.lua;%s/?/init.lua",
-                        old_path, module_path, module_path, lib_dir_path,
-                        lib_dir_path, test_dir_path, test_dir_path,
-                        test_common_dir_path, test_common_dir_path);
-    } else {
-        lua_pushfstring(L,
-                        "%s;%s/?.lua;%s/?/init.lua;%s/?.lua;%s/?/init.lua;%s/"
-                        "?.lua;%s/?/init.lua",
-                        old_path, module_path, module_path, lib_dir_path,
-                        lib_dir_path, test_dir_path, test_dir_path);
-    }
+    lua_pushfstring(L, "%s;%s/?.lua;%s/?/init.lua", lua_tostring(L, -1), dir,
+                    dir);
     lua_setfield(L, -3, "path"); /* package.path = … */
     lua_pop(L, 2);               /* pop path + package */
+}
+
+static void inject_modules_dir(lua_State *L) {
+    LOG("Injecting TAF library directory...");
+
+    append_package_path(L, module_path);
+    append_package_path(L, lib_dir_path);
 
     LOG("Successfully injected TAF library directory.");
 }
 
+static void inject_test_dirs(lua_State *L) {
+    LOG("Injecting test directories...");
+
+    append_package_path(L, test_dir_path);
+    if (test_common_dir_path && directory_exists(test_common_dir_path)) {
+        append_package_path(L, test_common_dir_path);
+    }
+
+    LOG("Successfully injected test directories.");
+}
+
 static void register_clua_module(lua_State *L, const char *name,
                                  lua_CFunction openf) {
     luaL_requiref(L, name, openf, 1);
@@ -399,23 +500,36 @@ static void register_test_api(lua_State *L) {
     register_clua_module(L, "taf-hooks", l_module_hooks_register_module);
 
     inject_modules_dir(L);
+    bytecode_cache_install_searcher(L);
+
+    // Options of prewarmed states are only known once tests are loaded
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    if (opts->cache || opts->watch || prewarmed) {
+        test_cache_track_requires(L);
+    }
 
     LOG("Test API registered.");
 }
 
+static int load_lua_file(lua_State *L, const char *file) {
+    LOG("Loading Lua file %s...", file);
+    if (bytecode_cache_loadfile(L, file) || lua_pcall(L, 0, 0, 0)) {
+        const char *err = lua_tostring(L, -1);
+        LOG("Failed loading: %s", err);
+        fprintf(stderr, "Lua error loading %s: %s\n", file, err);
+        lua_pop(L, 1);
+        return -1;
+    }
+    LOG("File %s loaded successfully.", file);
+    return 0;
+}
+
 static int load_lua_files(lua_State *L, str_array_t *files) {
 
     for (size_t i = 0; i < files->count; i++) {
-        char *file = files->items[i];
-        LOG("Loading Lua file %s...", file);
-        if (luaL_dofile(L, file)) {
-            const char *err = lua_tostring(L, -1);
-            LOG("Failed loading: %s", err);
-            fprintf(stderr, "Lua error loading %s: %s\n", file, err);
-            lua_pop(L, 1);
+        if (load_lua_file(L, files->items[i])) {
             return -1;
         }
-        LOG("File %s loaded successfully.", file);
     }
 
     return 0;
@@ -445,10 +559,481 @@ static int load_lua_dir(const char *dir_path, lua_State *L) {
     }
 }
 
+static void test_state_free(lua_State *L) {
+    test_case_free_all(L);
+    taf_hooks_deinit();
+
+    LOG("Closing Lua state...");
+    lua_close(L);
+}
+
+static test_history_t *get_history() {
+    if (!history) {
+        history = test_history_load();
+    }
+    return history;
+}
+
+// Returns -1 if the shard history cannot be read
+static int shard_tests(lua_State *L) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    if (opts->shard_count == 0) {
+        return 0;
+    }
+
+    size_t amount;
+    test_case_t *tests = test_case_get_all(&amount);
+    if (!shard_keep) {
+        // Local logs differ between machines, only the given history is used
+        test_history_t *shard_history = NULL;
+        if (opts->shard_history) {
+            shard_history = test_history_from_file(opts->shard_history);
+            if (!shard_history) {
+                fprintf(stderr, "Unable to read shard history '%s'\n",
+                        opts->shard_history);
+                return -1;
+            }
+        }
+        shard_keep_len = amount;
+        shard_keep = calloc(amount ? amount : 1, sizeof *shard_keep);
+        test_shard_select(shard_history, tests, amount, opts->shard_index,
+                          opts->shard_count, shard_keep);
+        test_history_free(shard_history);
+    }
+    if (amount != shard_keep_len) {
+        LOG("Test amount mismatch: %zu, shard selected for %zu.", amount,
+            shard_keep_len);
+        return 0;
+    }
+    test_case_retain(L, shard_keep);
+    return 0;
+}
+
+static void order_tests() {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    if (opts->order == TEST_ORDER_DEFAULT) {
+        return;
+    }
+
+    size_t amount;
+    test_case_t *tests = test_case_get_all(&amount);
+    if (!test_order) {
+        test_order_len = amount;
+        test_order = calloc(amount ? amount : 1, sizeof *test_order);
+        test_order_sort(get_history(), tests, amount, opts->order, test_order);
+    }
+    if (amount != test_order_len) {
+        LOG("Test amount mismatch: %zu, order selected for %zu.", amount,
+            test_order_len);
+        return;
+    }
+    test_case_reorder(test_order);
+}
+
+// Installs the coverage hook on `L` if coverage is on, before any project
+// file is executed, so top level lines of tests/ & lib/ are recorded too
+static void enable_coverage(lua_State *L) {
+    if (!cmd_parser_get_test_options()->coverage) {
+        return;
+    }
+    source_cache_init(skip_source);
+    coverage_init(covered_source);
+    lua_sethook(L, coverage_hook, LUA_MASKLINE, 0);
+}
+
+// Creates Lua state with TAF API, lib/ and hooks/ loaded into the current
+// runner
+static lua_State *test_state_prepare() {
+    LOG("Creating Lua state...");
+    lua_State *L = luaL_newstate();
+    LOG("Opening Lua libs...");
+    luaL_openlibs(L);
+    taf_state_get()->L = L;
+
+    register_test_api(L);
+    enable_coverage(L);
+
+    LOG("Project lib directory path: %s", lib_dir_path);
+    if (load_lua_dir(lib_dir_path, L) == -2) {
+        test_state_free(L);
+        return NULL;
+    }
+    if (load_lua_dir(hooks_dir_path, L) == -2) {
+        test_state_free(L);
+        return NULL;
+    }
+
+    return L;
+}
+
+// Loads tests of the current target into `L`. Returns -1 and frees `L` on
+// error.
+static int test_state_load_tests(lua_State *L) {
+    // Options of a prewarmed state are known only now
+    enable_coverage(L);
+    inject_test_dirs(L);
+
+    if (test_common_dir_path && load_lua_dir(test_common_dir_path, L) == -2) {
+        test_state_free(L);
+        return -1;
+    }
+    if (load_lua_dir(test_dir_path, L) == -2) {
+        test_state_free(L);
+        return -1;
+    }
+
+    if (shard_tests(L)) {
+        test_state_free(L);
+        return -1;
+    }
+    order_tests();
+
+    return 0;
+}
+
+// Creates Lua state with the whole project loaded into the current runner
+static lua_State *test_state_new() {
+    lua_State *L = test_state_prepare();
+    if (!L || test_state_load_tests(L)) {
+        return NULL;
+    }
+    return L;
+}
+
+static void free_test_selection() {
+    free(shard_keep);
+    shard_keep = NULL;
+    free(test_order);
+    test_order = NULL;
+    test_history_free(history);
+    history = NULL;
+}
+
+static void free_dir_paths() {
+    free(hooks_dir_path);
+    hooks_dir_path = NULL;
+    free(module_path);
+    module_path = NULL;
+    free(test_common_dir_path);
+    test_common_dir_path = NULL;
+    free(test_dir_path);
+    test_dir_path = NULL;
+    free(lib_dir_path);
+    lib_dir_path = NULL;
+    free_test_selection();
+    test_cache_free();
+    bytecode_cache_deinit();
+    source_cache_free();
+}
+
+static int run_all_tests(lua_State *L, test_run_result_t *result) {
+    LOG("Running tests...");
+
+    cmd_test_options *opts = cmd_parser_get_test_options();
+
+    size_t passed = 0;
+
+    size_t amount;
+    test_case_get_all(&amount);
+    LOG("Test amount: %zu", amount);
+    taf_log_tests_create(amount);
+    taf_hooks_run(L, TAF_HOOK_FN_TEST_RUN_STARTED, hooks_context_push);
+    reset_taf_start_millis();
+
+    if (opts->isolate) {
+        LOG("Running every test in its own process, %zu at a time...",
+            opts->jobs);
+        passed = test_pool_run(L, opts->jobs, true, run_test);
+    } else if (opts->jobs > 1 && amount > 1 && opts->threads) {
+        LOG("Running tests with %zu threads...", opts->jobs);
+        passed = test_pool_run_threads(opts->jobs, run_test, test_state_new,
+                                       test_state_free);
+    } else if (opts->jobs > 1 && amount > 1) {
+        LOG("Running tests with %zu jobs...", opts->jobs);
+        passed = test_pool_run(L, opts->jobs, false, run_test);
+    } else if (opts->concurrent > 1 && amount > 1) {
+        LOG("Running up to %zu tests concurrently...", opts->concurrent);
+        passed = test_scheduler_run(L, opts->concurrent, run_test_coroutine);
+    } else {
+        for (size_t i = 0; i < amount; ++i) {
+            if (run_test(L, i)) {
+                passed++;
+            }
+        }
+    }
+
+    taf_hooks_run(L, TAF_HOOK_FN_TEST_RUN_FINISHED, hooks_context_push);
+    if (opts->cache) {
+        test_cache_save();
+    }
+    taf_log_tests_finalize();
+
+    result->total = amount;
+    result->passed = passed;
+
+    return passed == amount ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool is_test_file(const char *path) {
+    return path_in_dir(path, test_dir_path) ||
+           path_in_dir(path, test_common_dir_path);
+}
+
+static bool str_array_contains(str_array_t *array, const char *str) {
+    for (size_t i = 0; i < array->count; i++) {
+        if (!strcmp(array->items[i], str)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int str_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Runs tests defined in `files`, or all tests if `files` is NULL
+static void watch_run(lua_State *L, str_array_t *files,
+                      test_run_result_t *result) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    taf_state_t *state = taf_state_get();
+
+    test_case_t *all = state->tests;
+    size_t all_len = state->tests_len;
+    size_t all_cap = state->tests_cap;
+
+    if (files) {
+        test_case_t *selected = malloc((all_len ? all_len : 1) * sizeof *all);
+        size_t len = 0;
+        for (size_t i = 0; i < all_len; i++) {
+            if (all[i].file && str_array_contains(files, all[i].file)) {
+                selected[len++] = all[i];
+            }
+        }
+        state->tests = selected;
+        state->tests_len = len;
+        state->tests_cap = all_len;
+    }
+
+    if (state->tests_len == 0) {
+        printf("No tests affected.\n");
+    } else {
+        if (opts->cache) {
+            test_cache_load(L);
+        }
+        run_all_tests(L, result);
+    }
+
+    if (files) {
+        free(state->tests);
+        state->tests = all;
+        state->tests_len = all_len;
+        state->tests_cap = all_cap;
+    }
+}
+
+// Reloads changed files and everything requiring them. Test files which were
+// reloaded are added to `test_files`.
+static void watch_reload(lua_State *L, str_array_t *changed,
+                         str_array_t *test_files) {
+    str_array_t affected = {NULL, 0};
+    for (size_t i = 0; i < changed->count; i++) {
+        str_array_t dependents =
+            test_cache_get_dependents(L, changed->items[i]);
+        for (size_t j = 0; j < dependents.count; j++) {
+            if (!str_array_contains(&affected, dependents.items[j])) {
+                str_array_push(&affected, dependents.items[j]);
+            }
+        }
+        free_str_array(&dependents);
+    }
+    qsort(affected.items, affected.count, sizeof(char *), str_cmp);
+
+    for (size_t i = 0; i < affected.count; i++) {
+        test_cache_unload(L, affected.items[i]);
+    }
+
+    // Libraries first, tests may use them while loading
+    for (size_t i = 0; i < affected.count; i++) {
+        const char *file = affected.items[i];
+        if (path_in_dir(file, lib_dir_path) && file_exists(file)) {
+            load_lua_file(L, file);
+        }
+    }
+
+    for (size_t i = 0; i < affected.count; i++) {
+        const char *file = affected.items[i];
+        if (!is_test_file(file)) {
+            continue;
+        }
+        LOG("Reloading tests from '%s'...", file);
+
+        size_t amount;
+        test_case_t *tests = test_case_get_all(&amount);
+        bool *keep = malloc((amount ? amount : 1) * sizeof *keep);
+        for (size_t j = 0; j < amount; j++) {
+            keep[j] = !tests[j].file || strcmp(tests[j].file, file);
+        }
+        test_case_retain(L, keep);
+        free(keep);
+
+        if (file_exists(file)) {
+            load_lua_file(L, file);
+        }
+
+        str_array_push(test_files, file);
+    }
+
+    free_str_array(&affected);
+}
+
+// Keeps running tests affected by the changes in the project until watching
+// fails, `L` is replaced if the whole project has to be reloaded
+static int watch_tests(lua_State **L, test_run_result_t *result) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+
+    test_watch_t *watch = test_watch_new();
+    if (!watch) {
+        fprintf(stderr, "--watch is not supported on this platform.\n");
+        return EXIT_FAILURE;
+    }
+    test_watch_add(watch, lib_dir_path);
+    test_watch_add(watch, hooks_dir_path);
+    test_watch_add(watch, test_dir_path);
+    if (test_common_dir_path) {
+        test_watch_add(watch, test_common_dir_path);
+    }
+
+    // Thread workers load the whole project themselves
+    if (opts->threads) {
+        LOG("Threads are not supported in watch mode, using processes.");
+        opts->threads = false;
+    }
+
+    watch_run(*L, NULL, result);
+
+    while (true) {
+        printf("\nWatching for changes, press Ctrl+C to exit...\n");
+        fflush(stdout);
+
+        str_array_t changed = test_watch_wait(watch);
+        if (changed.count == 0) {
+            LOG("Watching failed.");
+            break;
+        }
+
+        bool reload_all = !*L;
+        for (size_t i = 0; i < changed.count; i++) {
+            printf("Changed: %s\n", changed.items[i]);
+            if (path_in_dir(changed.items[i], hooks_dir_path)) {
+                reload_all = true;
+            }
+        }
+
+        if (reload_all) {
+            LOG("Reloading the whole project...");
+            if (*L) {
+                test_state_free(*L);
+            }
+            free_test_selection();
+            *L = test_state_new();
+            if (*L) {
+                watch_run(*L, NULL, result);
+            }
+        } else {
+            str_array_t test_files = {NULL, 0};
+            watch_reload(*L, &changed, &test_files);
+            watch_run(*L, &test_files, result);
+            free_str_array(&test_files);
+        }
+
+        free_str_array(&changed);
+    }
+
+    test_watch_free(watch);
+
+    return EXIT_FAILURE;
+}
+
+static bool target_exists(project_parsed_t *proj, const char *target) {
+    for (size_t i = 0; i < proj->targets_amount; i++) {
+        if (!strcmp(target, proj->targets[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int check_target(project_parsed_t *proj) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+
+    if (!opts->target && proj->multitarget) {
+        fprintf(stderr, "Project is multitarget, but no target specified.\n");
+        LOG("No target specified.");
+        return EXIT_FAILURE;
+    }
+    if (opts->target && !proj->multitarget) {
+        fprintf(stderr, "Unknown target '%s', project is not multitarget.\n",
+                opts->target);
+        LOG("Target specified, but project is not multitarget.");
+        return EXIT_FAILURE;
+    }
+    if (opts->target && !target_exists(proj, opts->target)) {
+        fprintf(stderr, "Target '%s' was not found.\n", opts->target);
+        LOG("Target %s was not found.", opts->target);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int taf_test_target(test_run_result_t *result);
+
+static int taf_test_targets(project_parsed_t *proj) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+
+    if (!proj->multitarget) {
+        fprintf(stderr, "--targets requires multitarget project.\n");
+        LOG("--targets specified, but project is not multitarget.");
+        return EXIT_FAILURE;
+    }
+    if (opts->target) {
+        fprintf(stderr, "Target '%s' can't be used together with --targets.\n",
+                opts->target);
+        LOG("Both target and --targets specified.");
+        return EXIT_FAILURE;
+    }
+
+    char **targets = opts->targets;
+    size_t targets_amount = opts->targets_amount;
+    if (targets_amount == 1 && !strcmp(targets[0], "all")) {
+        targets = proj->targets;
+        targets_amount = proj->targets_amount;
+    }
+    if (targets_amount == 0) {
+        fprintf(stderr, "Project has no targets.\n");
+        LOG("No targets to run.");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < targets_amount; i++) {
+        if (!target_exists(proj, targets[i])) {
+            fprintf(stderr, "Target '%s' was not found.\n", targets[i]);
+            LOG("Target %s was not found.", targets[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return test_targets_run(targets, targets_amount, taf_test_target);
+}
+
 int taf_test() {
 
     cmd_test_options *opts = cmd_parser_get_test_options();
 
+    if (opts->server) {
+        return taf_serve_request();
+    }
+
     if (opts->internal_logging && internal_logging_init()) {
         fprintf(stderr, "Unable to init internal logging.\n");
         return EXIT_FAILURE;
@@ -475,41 +1060,39 @@ int taf_test() {
                proj->min_taf_ver_str, TAF_VERSION);
     }
 
-    if (!opts->target && proj->multitarget) {
-        fprintf(stderr, "Project is multitarget, but no target specified.\n");
-        LOG("No target specified.");
+    if (opts->targets_amount != 0) {
+        int exitcode = taf_test_targets(proj);
+        project_parser_free();
         internal_logging_deinit();
-        return EXIT_FAILURE;
+        return exitcode;
     }
-    if (opts->target && !proj->multitarget) {
-        fprintf(stderr, "Unknown target '%s', project is not multitarget.\n",
-                opts->target);
-        LOG("Target specified, but project is not multitarget.");
+
+    if (check_target(proj)) {
         internal_logging_deinit();
         return EXIT_FAILURE;
     }
-    if (opts->target) {
-        bool found = false;
-        for (size_t i = 0; i < proj->targets_amount; i++) {
-            if (!strcmp(opts->target, proj->targets[i])) {
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            fprintf(stderr, "Target '%s' was not found.\n", opts->target);
-            LOG("Target %s was not found.", opts->target);
-            internal_logging_deinit();
-            return EXIT_FAILURE;
-        }
-    }
 
-    LOG("Creating Lua state...");
-    lua_State *L = luaL_newstate();
-    LOG("Opening Lua libs...");
-    luaL_openlibs(L);
+    test_run_result_t result;
+    return taf_test_target(&result);
+}
+
+static void init_project_paths() {
+    project_parsed_t *proj = get_parsed_project();
 
     asprintf(&lib_dir_path, "%s/lib", proj->project_path);
+    asprintf(&hooks_dir_path, "%s/hooks", proj->project_path);
+    module_path = get_lib_dir();
+
+    char bytecode_dir[PATH_MAX];
+    snprintf(bytecode_dir, PATH_MAX, "%s/" TEST_CACHE_DIR "/bytecode",
+             proj->project_path);
+    bytecode_cache_init(bytecode_dir);
+}
+
+static void init_test_paths() {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    project_parsed_t *proj = get_parsed_project();
+
     if (proj->multitarget) {
         asprintf(&test_common_dir_path, "%s/tests/common", proj->project_path);
         asprintf(&test_dir_path, "%s/tests/%s", proj->project_path,
@@ -517,105 +1100,168 @@ int taf_test() {
     } else {
         asprintf(&test_dir_path, "%s/tests", proj->project_path);
     }
+}
+
+static int run_loaded_tests(lua_State *L, taf_state_t *state,
+                            test_run_result_t *result);
+
+static int taf_test_target(test_run_result_t *result) {
+    init_project_paths();
+    init_test_paths();
 
-    register_test_api(L);
     taf_hooks_init();
 
-    LOG("Project lib directory path: %s", lib_dir_path);
-    if (load_lua_dir(lib_dir_path, L) == -2) {
-        test_case_free_all(L);
-        lua_close(L);
-        free(module_path);
-        free(test_common_dir_path);
-        free(test_dir_path);
-        free(lib_dir_path);
+    taf_state_t *state = taf_state_new();
+    taf_state_set(state);
+
+    lua_State *L = test_state_new();
+    if (!L) {
+        taf_state_free(state);
+        free_dir_paths();
         project_parser_free();
         internal_logging_deinit();
         return EXIT_FAILURE;
     }
 
-    asprintf(&hooks_dir_path, "%s/hooks", proj->project_path);
-    if (load_lua_dir(hooks_dir_path, L) == -2) {
-        test_case_free_all(L);
-        lua_close(L);
-        free(hooks_dir_path);
-        free(module_path);
-        free(test_common_dir_path);
-        free(test_dir_path);
-        free(lib_dir_path);
-        project_parser_free();
-        internal_logging_deinit();
-        return EXIT_FAILURE;
+    return run_loaded_tests(L, state, result);
+}
+
+// Path of the file `name` in the logs directory, which is created if needed
+static bool get_logs_file_path(char path[PATH_MAX], const char *name) {
+    taf_log_get_logs_dir(path);
+    if (!directory_exists(path) && create_directory(path, MKDIR_MODE)) {
+        LOG("Unable to create logs directory.");
+        fprintf(stderr, "Unable to create directory '%s'\n", path);
+        return false;
     }
 
-    if (proj->multitarget) {
-        if (load_lua_dir(test_common_dir_path, L) == -2) {
-            test_case_free_all(L);
-            lua_close(L);
-            free(hooks_dir_path);
-            free(module_path);
-            free(test_common_dir_path);
-            free(test_dir_path);
-            free(lib_dir_path);
-            project_parser_free();
-            internal_logging_deinit();
-            return EXIT_FAILURE;
-        }
+    size_t len = strlen(path);
+    snprintf(path + len, PATH_MAX - len, "/%s", name);
+    return true;
+}
+
+// Covered files which were never executed are reported with zero hits
+static void add_covered_files(const char *dir) {
+    if (!dir || !directory_exists(dir)) {
+        return;
     }
-    if (load_lua_dir(test_dir_path, L) == -2) {
-        test_case_free_all(L);
-        lua_close(L);
-        free(hooks_dir_path);
-        free(module_path);
-        free(test_common_dir_path);
-        free(test_dir_path);
-        free(lib_dir_path);
-        project_parser_free();
-        internal_logging_deinit();
-        return EXIT_FAILURE;
+    str_array_t files = list_lua_recursive(dir);
+    for (size_t i = 0; i < files.count; i++) {
+        coverage_add_file(files.items[i]);
+    }
+    free_str_array(&files);
+}
+
+static void write_coverage() {
+    char path[PATH_MAX];
+    if (!get_logs_file_path(path, COVERAGE_FILE)) {
+        return;
+    }
+    add_covered_files(lib_dir_path);
+    add_covered_files(test_common_dir_path);
+    add_covered_files(test_dir_path);
+    if (coverage_write(path)) {
+        fprintf(stderr, "Unable to write coverage to '%s'\n", path);
+        return;
+    }
+    printf("Coverage written to '%s'\n", path);
+}
+
+static void write_profile() {
+    char path[PATH_MAX];
+    // Next to the logs of the run
+    if (!taf_log_get_run_file_path(path, PROFILE_SUFFIX) &&
+        !get_logs_file_path(path, PROFILE_FILE)) {
+        profile_stop("/dev/null");
+        return;
+    }
+
+    if (profile_stop(path)) {
+        fprintf(stderr, "Unable to write profile to '%s'\n", path);
+        return;
     }
+    printf("Profile written to '%s'\n", path);
+}
+
+// Runs tests loaded into `L` and frees everything
+static int run_loaded_tests(lua_State *L, taf_state_t *state,
+                            test_run_result_t *result) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
 
     size_t amount;
     test_case_get_all(&amount);
 
+    if (amount == 0 && opts->shard_count != 0) {
+        LOG("No tests in shard %zu/%zu.", opts->shard_index, opts->shard_count);
+        printf("No tests in shard %zu/%zu.\n", opts->shard_index,
+               opts->shard_count);
+        result->total = 0;
+        result->passed = 0;
+        test_state_free(L);
+        taf_state_free(state);
+        free_dir_paths();
+        project_parser_free();
+        internal_logging_deinit();
+        return EXIT_SUCCESS;
+    }
+
     if (amount == 0) {
         LOG("No tests found.");
         fprintf(stderr, "No tests to execute.\n");
-        test_case_free_all(L);
-        lua_close(L);
-        free(hooks_dir_path);
-        free(module_path);
-        free(test_common_dir_path);
-        free(test_dir_path);
-        free(lib_dir_path);
+        test_state_free(L);
+        taf_state_free(state);
+        free_dir_paths();
         project_parser_free();
         internal_logging_deinit();
         return EXIT_FAILURE;
     }
 
+    if (opts->cache && !opts->watch) {
+        test_cache_load(L);
+    }
+
+    if ((opts->coverage || opts->profile) &&
+        (opts->jobs > 1 || opts->isolate || opts->concurrent > 1)) {
+        // Workers & coroutines of the scheduler run without the hook
+        LOG("Coverage or profiling enabled, running tests one by one...");
+        fprintf(stderr,
+                "Warning: %s ignores -j, --isolate and -c, running tests "
+                "one by one.\n",
+                opts->coverage ? "--coverage" : "--profile");
+        opts->jobs = 1;
+        opts->isolate = false;
+        opts->concurrent = 1;
+    }
+
     if (!opts->headless && taf_tui_init()) {
-        test_case_free_all(L);
-        lua_close(L);
-        free(hooks_dir_path);
-        free(module_path);
-        free(test_common_dir_path);
-        free(test_dir_path);
-        free(lib_dir_path);
+        test_state_free(L);
+        taf_state_free(state);
+        free_dir_paths();
         project_parser_free();
         internal_logging_deinit();
         return EXIT_FAILURE;
     }
     headless = opts->headless;
 
-    if (opts->headless) {
-        taf_headless_init();
-    }
-    if (!opts->headless) {
+    if (opts->coverage) {
+        // Installed before the project was loaded
+        LOG("Coverage hook enabled.");
+    } else if (!opts->headless) {
         LOG("Enabling line hook...");
-        lua_sethook(L, line_hook, LUA_MASKLINE, 0);
+        source_cache_init(skip_source);
+        if (opts->progress_sampling) {
+            lua_sethook(L, sampling_hook, LUA_MASKCOUNT,
+                        PROGRESS_SAMPLING_HOOK_COUNT);
+        } else {
+            lua_sethook(L, line_hook, LUA_MASKLINE, 0);
+        }
+    }
+    if (opts->profile) {
+        profile_start(L);
     }
 
-    int exitcode = run_all_tests(L);
+    int exitcode =
+        opts->watch ? watch_tests(&L, result) : run_all_tests(L, result);
 
     LOG("Tidying up...");
 
@@ -623,21 +1269,91 @@ int taf_test() {
         taf_tui_deinit();
     }
 
-    test_case_free_all(L);
+    if (opts->coverage) {
+        write_coverage();
+    }
+    if (opts->profile) {
+        write_profile();
+    }
 
-    LOG("Closing Lua state...");
-    lua_close(L);
+    if (L) {
+        test_state_free(L);
+    }
+    taf_state_free(state);
 
     project_parser_free();
 
     internal_logging_deinit();
-    taf_hooks_deinit();
 
-    free(hooks_dir_path);
-    free(module_path);
-    free(test_common_dir_path);
-    free(test_dir_path);
-    free(lib_dir_path);
+    free_dir_paths();
 
     return exitcode;
 }
+
+lua_State *taf_test_prewarm() {
+    LOG("Prewarming Lua state...");
+
+    prewarmed = true;
+    init_project_paths();
+
+    taf_hooks_init();
+
+    taf_state_t *state = taf_state_new();
+    taf_state_set(state);
+
+    lua_State *L = test_state_prepare();
+    if (!L) {
+        taf_state_free(state);
+        free_dir_paths();
+        return NULL;
+    }
+
+    LOG("Preloading TAF library...");
+    lua_getglobal(L, "require");
+    lua_pushstring(L, "taf");
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+        LOG("Unable to preload TAF library: %s", lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+
+    return L;
+}
+
+void taf_test_prewarm_free(lua_State *L) {
+    test_state_free(L);
+    taf_state_free(taf_state_get());
+    taf_state_set(NULL);
+    free_dir_paths();
+    prewarmed = false;
+}
+
+int taf_test_prewarmed(lua_State *L) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    project_parsed_t *proj = get_parsed_project();
+
+    if (opts->watch) {
+        fprintf(stderr, "--watch can't be used with taf serve.\n");
+        return EXIT_FAILURE;
+    }
+    if (opts->targets_amount != 0) {
+        // Every target needs its own Lua state anyway
+        taf_test_prewarm_free(L);
+        return taf_test_targets(proj);
+    }
+    if (check_target(proj)) {
+        return EXIT_FAILURE;
+    }
+
+    // Headless output of the prewarmed runner depends on the options
+    taf_hooks_init();
+    init_test_paths();
+
+    if (test_state_load_tests(L)) {
+        taf_state_free(taf_state_get());
+        free_dir_paths();
+        return EXIT_FAILURE;
+    }
+
+    test_run_result_t result;
+    return run_loaded_tests(L, taf_state_get(), &result);
+}
@@ -2,6 +2,7 @@
 
 #include "cmd_parser.h"
 #include "project_parser.h"
+#include "source_cache.h"
 #include "version.h"
 
 #include "util/string.h"
@@ -10,10 +11,21 @@
 #include <notcurses/notcurses.h>
 
 #include <locale.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+// The UI is redrawn by the render thread at most this many times a second
+#define TUI_MAX_FPS 30
+
+// Colored parts of a log line, e.g. time, log level & message
+#define UI_LOG_LINE_SEGMENTS 4
+
 typedef enum {
     PASSED = 0U,
     FAILED = 1U,
@@ -46,15 +58,48 @@ typedef struct {
     int failed_tests;
 
     double current_test_progress;
-    char *current_file;
+    const source_entry_t *current_source;
     int current_line;
-    char *current_line_str;
+    unsigned long current_test_started;
 
     uint64_t total_elapsed_ms;
 } ui_state_t;
 
 static ui_state_t ui = {0};
 
+// Line of the log plane
+typedef struct {
+    char *text;
+    size_t segment_ends[UI_LOG_LINE_SEGMENTS];
+    int segment_colors[UI_LOG_LINE_SEGMENTS]; // palette index, -1 default
+    int segments;
+    bool separator;
+} ui_log_line_t;
+
+// Newest log lines, the log plane shows as many of them as fit on the
+// screen. Lines are added by the events & drawn by the render thread.
+static ui_log_line_t *log_ring = NULL;
+static size_t log_ring_cap = 0;
+static size_t log_ring_start = 0;
+static size_t log_ring_len = 0;
+static bool log_dirty = false;
+
+// Current line & test progress published by the line hook without locking.
+// Written only by the thread running tests, `seq` is odd while it writes.
+typedef struct {
+    _Atomic unsigned seq;
+    _Atomic(const source_entry_t *) source;
+    _Atomic int line;
+    _Atomic int progress_ppm; // parts per million
+} ui_snapshot_t;
+
+static ui_snapshot_t snapshot = {0};
+
+// Guards notcurses & `ui`, held by the render thread while drawing
+static pthread_mutex_t tui_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t render_thread;
+static atomic_bool render_running = false;
+
 static struct notcurses *nc = NULL;
 static struct ncplane *log_plane = NULL;
 static struct ncplane *ui_plane = NULL;
@@ -91,7 +136,142 @@ static const char *test_state_to_str_map[] = {
     "RUNNING",
 };
 
-void taf_tui_update() {
+// Returns line `i` of the log ring, 0 is the oldest one
+static inline ui_log_line_t *log_ring_at(size_t i) {
+    return &log_ring[(log_ring_start + i) % log_ring_cap];
+}
+
+// Appends new empty line to the log ring, dropping the oldest line if the
+// ring is full. `tui_mutex` must be held.
+static ui_log_line_t *log_line_new() {
+    ui_log_line_t *line;
+    if (log_ring_len == log_ring_cap) {
+        line = log_ring_at(0);
+        free(line->text);
+        log_ring_start = (log_ring_start + 1) % log_ring_cap;
+    } else {
+        line = log_ring_at(log_ring_len++);
+    }
+    memset(line, 0, sizeof *line);
+    log_dirty = true;
+    return line;
+}
+
+// Appends `len` bytes of `text` with the palette index `color`, -1 for the
+// default color, to `line`
+static void log_line_add(ui_log_line_t *line, int color, const char *text,
+                         size_t len) {
+    if (line->segments == UI_LOG_LINE_SEGMENTS) {
+        // Merged into the last segment
+        line->segments--;
+    }
+    size_t start =
+        line->segments == 0 ? 0 : line->segment_ends[line->segments - 1];
+    line->text = realloc(line->text, start + len + 1);
+    if (!line->text) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(line->text + start, text, len);
+    line->text[start + len] = '\0';
+    line->segment_ends[line->segments] = start + len;
+    line->segment_colors[line->segments] = color;
+    line->segments++;
+}
+
+static void log_line_addf(ui_log_line_t *line, int color, const char *fmt,
+                          ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof buf, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        return;
+    }
+    log_line_add(line, color, buf,
+                 (size_t)n < sizeof buf ? (size_t)n : sizeof buf - 1);
+}
+
+// Appends `text` wrapped at the screen width as lines of `color`
+static void log_push_text(int color, const char *text) {
+    size_t count;
+    size_t *indices = string_wrapped_lines(text, absx, &count);
+    size_t text_len = strlen(text);
+    for (size_t i = 0; i < count; i++) {
+        size_t start = indices[i];
+        size_t end = i + 1 < count ? indices[i + 1] : text_len;
+        while (end > start && text[end - 1] == '\n') {
+            end--;
+        }
+        log_line_add(log_line_new(), color, text + start, end - start);
+    }
+    free(indices);
+}
+
+static void log_push_separator() {
+    //
+    log_line_new()->separator = true;
+}
+
+// Appends line starting with time `time` followed by `fmt` in `color`
+static void log_push_event(const char *time, int color, const char *fmt,
+                           ...) {
+    ui_log_line_t *line = log_line_new();
+    log_line_addf(line, -1, "%s ", time);
+
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof buf, fmt, args);
+    va_end(args);
+    if (n > 0) {
+        log_line_add(line, color, buf,
+                     (size_t)n < sizeof buf ? (size_t)n : sizeof buf - 1);
+    }
+}
+
+// Draws the newest lines of the log ring at the bottom of the log plane,
+// `tui_mutex` must be held
+static void draw_log() {
+    if (!log_dirty) {
+        return;
+    }
+    log_dirty = false;
+
+    ncplane_erase(log_plane);
+    uint rows, cols;
+    ncplane_dim_yx(log_plane, &rows, &cols);
+    size_t shown = log_ring_len < rows ? log_ring_len : rows;
+    for (size_t i = 0; i < shown; i++) {
+        ui_log_line_t *line = log_ring_at(log_ring_len - shown + i);
+        int y = rows - shown + i;
+        if (line->separator) {
+            for (uint x = 0; x < cols; x++) {
+                ncplane_putstr_yx(log_plane, y, x, "─");
+            }
+            continue;
+        }
+        ncplane_cursor_move_yx(log_plane, y, 0);
+        size_t start = 0;
+        for (int s = 0; s < line->segments; s++) {
+            int color = line->segment_colors[s];
+            if (color < 0) {
+                ncplane_set_fg_default(log_plane);
+            } else {
+                ncplane_set_fg_palindex(log_plane, color);
+            }
+            size_t end = line->segment_ends[s];
+            ncplane_printf(log_plane, "%.*s", (int)(end - start),
+                           line->text + start);
+            start = end;
+        }
+        ncplane_set_fg_default(log_plane);
+    }
+}
+
+// Redraws the UI, `tui_mutex` must be held
+static void draw_ui() {
 
     ncplane_dim_yx(notcurses_stdplane(nc), &absy, &absx);
     ncplane_erase(notcurses_stdplane(nc));
@@ -165,19 +345,32 @@ void taf_tui_update() {
                           test_state_to_str_map[hist->state]);
         ncplane_set_fg_default(test_progress_plane);
         ncplane_printf_yx(test_progress_plane, 3 - offset, 10, "[ %lums ] %s",
-                          hist->state == RUNNING ? millis_since_start()
-                                                 : hist->elapsed,
+                          hist->state == RUNNING
+                              ? millis_monotonic() - ui.current_test_started
+                              : hist->elapsed,
                           hist->name);
         if (hist->state == RUNNING) {
-            char *file_str = ui.current_file;
-            if (file_str) {
-                size_t len = strlen(ui.current_file);
+            const source_entry_t *source = ui.current_source;
+            if (source) {
+                const char *file_str = source->path;
+                size_t len = strlen(file_str);
                 if (len > 40) {
                     file_str += len - 40;
                 }
                 ncplane_printf(test_progress_plane, "...    [%s%s:%d]",
                                len > 40 ? "..." : "", file_str,
                                ui.current_line);
+                size_t text_len;
+                const char *text =
+                    source_cache_line(source, ui.current_line, &text_len);
+                while (text && text_len && (*text == ' ' || *text == '\t')) {
+                    text++;
+                    text_len--;
+                }
+                if (text && text_len) {
+                    ncplane_printf(test_progress_plane, " %.*s", (int)text_len,
+                                   text);
+                }
             }
         }
         offset++;
@@ -197,21 +390,87 @@ void taf_tui_update() {
     ncplane_printf_yx(ui_plane, project_info_dimy + 9, absx - 8, "%.2f%%",
                       total_progress * 100);
 
+    draw_log();
+
     notcurses_render(nc);
 }
 
 void taf_tui_set_test_amount(int amount) {
-    //
+    pthread_mutex_lock(&tui_mutex);
     ui.total_tests = amount;
+    pthread_mutex_unlock(&tui_mutex);
+}
+
+static void snapshot_begin_write() {
+    unsigned seq = atomic_load_explicit(&snapshot.seq, memory_order_relaxed);
+    atomic_store_explicit(&snapshot.seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void snapshot_end_write() {
+    unsigned seq = atomic_load_explicit(&snapshot.seq, memory_order_relaxed);
+    atomic_store_explicit(&snapshot.seq, seq + 1, memory_order_release);
 }
 
 void taf_tui_set_test_progress(double progress) {
-    //
-    ui.current_test_progress = progress;
+    snapshot_begin_write();
+    atomic_store_explicit(&snapshot.progress_ppm, (int)(progress * 1e6),
+                          memory_order_relaxed);
+    snapshot_end_write();
+}
+
+// Copies the snapshot published by the line hook into `ui`
+static void apply_snapshot() {
+    unsigned seq;
+    const source_entry_t *source;
+    int line;
+    int progress_ppm;
+    do {
+        seq = atomic_load_explicit(&snapshot.seq, memory_order_acquire);
+        source = atomic_load_explicit(&snapshot.source, memory_order_relaxed);
+        line = atomic_load_explicit(&snapshot.line, memory_order_relaxed);
+        progress_ppm =
+            atomic_load_explicit(&snapshot.progress_ppm, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) ||
+             seq != atomic_load_explicit(&snapshot.seq, memory_order_relaxed));
+
+    ui.current_source = source;
+    ui.current_line = line;
+    ui.current_test_progress = progress_ppm / 1e6;
+}
+
+static void *render_main(void *) {
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (atomic_load(&render_running)) {
+        pthread_mutex_lock(&tui_mutex);
+        apply_snapshot();
+        draw_ui();
+        pthread_mutex_unlock(&tui_mutex);
+
+        next.tv_nsec += 1000000000L / TUI_MAX_FPS;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    return NULL;
+}
+
+static void tui_atfork_child() {
+    // Render thread does not exist in the child
+    pthread_mutex_init(&tui_mutex, NULL);
+    atomic_store(&render_running, false);
 }
 
 void taf_tui_set_current_test(int index, const char *test) {
+    pthread_mutex_lock(&tui_mutex);
     ui.current_test_index = index;
+    ui.current_test_started = millis_monotonic();
     ui.test_history_size++;
     if (ui.test_history_size >= ui.test_history_cap) {
         ui.test_history_cap *= 2;
@@ -223,29 +482,18 @@ void taf_tui_set_current_test(int index, const char *test) {
     hist->state = RUNNING;
     hist->elapsed = 0;
 
-    ncplane_move_rel(ui_plane, 2, 0);
-    ncplane_erase(ui_plane);
-    notcurses_render(nc);
-    ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-    ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 2, absx);
     char ts[TS_LEN];
     get_date_time_now(ts);
-    ncplane_printf_yx(log_plane, ncplane_dim_y(log_plane) - 2, 0, "%s ", ts);
-    ncplane_set_fg_palindex(log_plane, 5);
-    ncplane_printf(log_plane, "Test '%s' STARTED...", hist->name);
-    ncplane_set_fg_default(log_plane);
-    for (uint i = 0; i < ncplane_dim_x(log_plane); i++) {
-        ncplane_putstr_yx(log_plane, ncplane_dim_y(log_plane) - 1, i, "─");
-    }
+    log_push_event(ts, 5, "Test '%s' STARTED...", hist->name);
+    log_push_separator();
+    pthread_mutex_unlock(&tui_mutex);
 }
 
-void taf_tui_set_current_line(const char *file, int line,
-                              const char *line_str) {
-    free(ui.current_file);
-    free(ui.current_line_str);
-    ui.current_file = strdup(file);
-    ui.current_line = line;
-    ui.current_line_str = string_strip(line_str);
+void taf_tui_set_current_line(const source_entry_t *source, int line) {
+    snapshot_begin_write();
+    atomic_store_explicit(&snapshot.source, source, memory_order_relaxed);
+    atomic_store_explicit(&snapshot.line, line, memory_order_relaxed);
+    snapshot_end_write();
 }
 
 static size_t sanitize_inplace(char *buf, size_t len) {
@@ -281,256 +529,122 @@ void taf_tui_log(char *time, taf_log_level log_level, const char *, int,
     if (log_level > ui.log_level) {
         return;
     }
-    // This is a total mess...
-    // I don't like it even one bit but it works for now...
     char *tmp = malloc(buffer_len + 1);
     memcpy(tmp, buffer, buffer_len);
     tmp[buffer_len] = '\0';
     sanitize_inplace(tmp, buffer_len);
-    size_t count;
-    size_t *indices = string_wrapped_lines(tmp, absx, &count);
-    ncplane_move_rel(ui_plane, 2, 0);
-    ncplane_erase(ui_plane);
-    notcurses_render(nc);
-    ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-    ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 2, absx);
-    ncplane_printf_yx(log_plane, ncplane_dim_y(log_plane) - 2, 0, "%s ", time);
-    ncplane_set_fg_palindex(log_plane, log_level_to_palindex_map[log_level]);
-    ncplane_printf(log_plane, "[%s]", taf_log_level_to_str(log_level));
-    ncplane_set_fg_default(log_plane);
-    ncplane_putstr(log_plane, ":");
-    for (size_t i = 0; i < count; i++) {
-        ncplane_move_rel(ui_plane, 1, 0);
-        ncplane_erase(ui_plane);
-        notcurses_render(nc);
-        ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-        ncplane_putstr_aligned(log_plane, ncplane_dim_y(log_plane) - 1,
-                               NCALIGN_LEFT, &tmp[indices[i]]);
-        ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 1, absx);
-    }
-    free(indices);
+
+    pthread_mutex_lock(&tui_mutex);
+    ui_log_line_t *line = log_line_new();
+    log_line_addf(line, -1, "%s ", time);
+    log_line_addf(line, log_level_to_palindex_map[log_level], "[%s]",
+                  taf_log_level_to_str(log_level));
+    log_line_addf(line, -1, ":");
+    log_push_text(-1, tmp);
+    log_push_separator();
+    pthread_mutex_unlock(&tui_mutex);
+
     free(tmp);
-    for (uint i = 0; i < ncplane_dim_x(log_plane); i++) {
-        ncplane_putstr_yx(log_plane, ncplane_dim_y(log_plane) - 1, i, "─");
-    }
-    taf_tui_update();
 }
 
 void taf_tui_defer_queue_started(char *time) {
+    pthread_mutex_lock(&tui_mutex);
     ui_test_history_t *hist = &ui.test_history[ui.test_history_size - 1];
-
-    ncplane_move_rel(ui_plane, 2, 0);
-    ncplane_erase(ui_plane);
-    notcurses_render(nc);
-    ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-    ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 2, absx);
-    ncplane_printf_yx(log_plane, ncplane_dim_y(log_plane) - 2, 0, "%s ", time);
-    ncplane_set_fg_palindex(log_plane, 5);
-    ncplane_printf(log_plane, "Defer Queue for Test '%s' STARTED...",
+    log_push_event(time, 5, "Defer Queue for Test '%s' STARTED...",
                    hist->name);
-    ncplane_set_fg_default(log_plane);
-    for (uint i = 0; i < ncplane_dim_x(log_plane); i++) {
-        ncplane_putstr_yx(log_plane, ncplane_dim_y(log_plane) - 1, i, "─");
-    }
+    log_push_separator();
+    pthread_mutex_unlock(&tui_mutex);
 }
 
 void taf_tui_defer_queue_finished(char *time) {
+    pthread_mutex_lock(&tui_mutex);
     ui_test_history_t *hist = &ui.test_history[ui.test_history_size - 1];
-
-    ncplane_move_rel(ui_plane, 2, 0);
-    ncplane_erase(ui_plane);
-    notcurses_render(nc);
-    ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-    ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 2, absx);
-    ncplane_printf_yx(log_plane, ncplane_dim_y(log_plane) - 2, 0, "%s ", time);
-    ncplane_set_fg_palindex(log_plane, 2);
-    ncplane_printf(log_plane, "Defer Queue for Test '%s' FINISHED...",
+    log_push_event(time, 2, "Defer Queue for Test '%s' FINISHED...",
                    hist->name);
-    ncplane_set_fg_default(log_plane);
-    for (uint i = 0; i < ncplane_dim_x(log_plane); i++) {
-        ncplane_putstr_yx(log_plane, ncplane_dim_y(log_plane) - 1, i, "─");
-    }
+    log_push_separator();
+    pthread_mutex_unlock(&tui_mutex);
 }
 
-void taf_tui_test_passed(char *time) {
+void taf_tui_test_passed(char *time, unsigned long elapsed_ms) {
+    pthread_mutex_lock(&tui_mutex);
     ui_test_history_t *hist = &ui.test_history[ui.test_history_size - 1];
     hist->state = PASSED;
-    hist->elapsed = millis_since_start();
+    hist->elapsed = elapsed_ms;
     hist->time = strdup(time);
     ui.passed_tests++;
 
-    ncplane_move_rel(ui_plane, 2, 0);
-    ncplane_erase(ui_plane);
-    notcurses_render(nc);
-    ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-    ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 2, absx);
-    ncplane_printf_yx(log_plane, ncplane_dim_y(log_plane) - 2, 0, "%s ", time);
-    ncplane_set_fg_palindex(log_plane, 2);
-    ncplane_printf(log_plane, "Test '%s' PASSED", hist->name);
-    ncplane_set_fg_default(log_plane);
-    for (uint i = 0; i < ncplane_dim_x(log_plane); i++) {
-        ncplane_putstr_yx(log_plane, ncplane_dim_y(log_plane) - 1, i, "─");
-    }
+    log_push_event(time, 2, "Test '%s' PASSED", hist->name);
+    log_push_separator();
 
     if (ui.passed_tests + ui.failed_tests == ui.total_tests) {
         ui.total_elapsed_ms = millis_since_taf_start();
     }
+    pthread_mutex_unlock(&tui_mutex);
 }
 
 void taf_tui_defer_failed(char *time, const char *trace, const char *file,
                           int line) {
-    size_t count;
-    size_t *indices = string_wrapped_lines(trace, absx, &count);
-    ncplane_move_rel(ui_plane, 2, 0);
-    ncplane_erase(ui_plane);
-    notcurses_render(nc);
-    ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-    ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 2, absx);
-    ncplane_printf_yx(log_plane, ncplane_dim_y(log_plane) - 2, 0, "%s ", time);
-    ncplane_set_fg_palindex(log_plane, 3);
-    ncplane_printf(log_plane, "Defer (%s:%d) failed. Traceback:", file, line);
-    for (size_t i = 0; i < count; i++) {
-        ncplane_move_rel(ui_plane, 1, 0);
-        ncplane_erase(ui_plane);
-        notcurses_render(nc);
-        ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-        ncplane_putstr_aligned(log_plane, ncplane_dim_y(log_plane) - 1,
-                               NCALIGN_LEFT, &trace[indices[i]]);
-        ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 1, absx);
-    }
-    ncplane_set_fg_default(log_plane);
-    free(indices);
-    for (uint i = 0; i < ncplane_dim_x(log_plane); i++) {
-        ncplane_putstr_yx(log_plane, ncplane_dim_y(log_plane) - 1, i, "─");
-    }
-    taf_tui_update();
+    pthread_mutex_lock(&tui_mutex);
+    log_push_event(time, 3, "Defer (%s:%d) failed. Traceback:", file, line);
+    log_push_text(3, trace);
+    log_push_separator();
+    pthread_mutex_unlock(&tui_mutex);
 }
 
-void taf_tui_test_failed(char *time, raw_log_test_output_t *failure_reasons,
+void taf_tui_test_failed(char *time, unsigned long elapsed_ms,
+                         raw_log_test_output_t *failure_reasons,
                          size_t failure_reasons_count) {
+    pthread_mutex_lock(&tui_mutex);
     ui_test_history_t *hist = &ui.test_history[ui.test_history_size - 1];
     hist->state = FAILED;
-    hist->elapsed = millis_since_start();
+    hist->elapsed = elapsed_ms;
     hist->time = strdup(time);
     ui.failed_tests++;
 
-    ncplane_move_rel(ui_plane, 2, 0);
-    ncplane_erase(ui_plane);
-    notcurses_render(nc);
-    ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-    ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 2, absx);
-    ncplane_printf_yx(log_plane, ncplane_dim_y(log_plane) - 2, 0, "%s ", time);
-    ncplane_set_fg_palindex(log_plane, 1);
-    ncplane_printf(log_plane, "Test '%s' FAILED:", hist->name);
+    log_push_event(time, 1, "Test '%s' FAILED:", hist->name);
 
     for (size_t j = 0; j < failure_reasons_count; j++) {
-        ncplane_move_rel(ui_plane, 1, 0);
-        ncplane_erase(ui_plane);
-        notcurses_render(nc);
-        ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-        ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 1, absx);
-
         char *tmp = strdup(failure_reasons[j].msg);
         sanitize_inplace(tmp, failure_reasons[j].msg_len);
 
-        ncplane_move_rel(ui_plane, 1, 0);
-        ncplane_erase(ui_plane);
-        notcurses_render(nc);
-        ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-        ncplane_set_fg_default(log_plane);
-        ncplane_printf_yx(log_plane, ncplane_dim_y(log_plane) - 1, 0,
-                          "Failure reason %zu: [", j + 1);
-        ncplane_set_fg_palindex(log_plane, 1);
-        ncplane_printf(log_plane, "%s",
-                       taf_log_level_to_str(failure_reasons[j].level));
-        ncplane_set_fg_default(log_plane);
-        ncplane_putstr(log_plane, "]:");
-        ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 1, absx);
-
-        ncplane_set_fg_palindex(log_plane, 1);
-
-        size_t count;
-        size_t *indices = string_wrapped_lines(tmp, absx, &count);
-        for (size_t i = 0; i < count; i++) {
-            ncplane_move_rel(ui_plane, 1, 0);
-            ncplane_erase(ui_plane);
-            notcurses_render(nc);
-            ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-            ncplane_putstr_aligned(log_plane, ncplane_dim_y(log_plane) - 1,
-                                   NCALIGN_LEFT, &tmp[indices[i]]);
-            ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 1,
-                                  absx);
-        }
-        free(indices);
-        free(tmp);
-    }
+        log_line_new();
+        ui_log_line_t *line = log_line_new();
+        log_line_addf(line, -1, "Failure reason %zu: [", j + 1);
+        log_line_addf(line, 1, "%s",
+                      taf_log_level_to_str(failure_reasons[j].level));
+        log_line_addf(line, -1, "]:");
+        log_push_text(1, tmp);
 
-    ncplane_set_fg_default(log_plane);
-    for (uint i = 0; i < ncplane_dim_x(log_plane); i++) {
-        ncplane_putstr_yx(log_plane, ncplane_dim_y(log_plane) - 1, i, "─");
+        free(tmp);
     }
+    log_push_separator();
 
     if (ui.passed_tests + ui.failed_tests == ui.total_tests) {
         ui.total_elapsed_ms = millis_since_taf_start();
     }
+    pthread_mutex_unlock(&tui_mutex);
 }
 
 void taf_tui_hooks_started(char *time) {
-    ncplane_move_rel(ui_plane, 2, 0);
-    ncplane_erase(ui_plane);
-    notcurses_render(nc);
-    ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-    ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 2, absx);
-    ncplane_printf_yx(log_plane, ncplane_dim_y(log_plane) - 2, 0, "%s ", time);
-    ncplane_set_fg_palindex(log_plane, 6);
-    ncplane_printf(log_plane, "Running TAF hooks...");
-    ncplane_set_fg_default(log_plane);
-    for (uint i = 0; i < ncplane_dim_x(log_plane); i++) {
-        ncplane_putstr_yx(log_plane, ncplane_dim_y(log_plane) - 1, i, "─");
-    }
+    pthread_mutex_lock(&tui_mutex);
+    log_push_event(time, 6, "Running TAF hooks...");
+    log_push_separator();
+    pthread_mutex_unlock(&tui_mutex);
 }
 
 void taf_tui_hooks_finished(char *time) {
-    ncplane_move_rel(ui_plane, 2, 0);
-    ncplane_erase(ui_plane);
-    notcurses_render(nc);
-    ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-    ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 2, absx);
-    ncplane_printf_yx(log_plane, ncplane_dim_y(log_plane) - 2, 0, "%s ", time);
-    ncplane_set_fg_palindex(log_plane, 2);
-    ncplane_printf(log_plane, "Finished running TAF hooks.");
-    ncplane_set_fg_default(log_plane);
-    for (uint i = 0; i < ncplane_dim_x(log_plane); i++) {
-        ncplane_putstr_yx(log_plane, ncplane_dim_y(log_plane) - 1, i, "─");
-    }
+    pthread_mutex_lock(&tui_mutex);
+    log_push_event(time, 2, "Finished running TAF hooks.");
+    log_push_separator();
+    pthread_mutex_unlock(&tui_mutex);
 }
 
 void taf_tui_hook_failed(char *time, const char *trace) {
-    size_t count;
-    size_t *indices = string_wrapped_lines(trace, absx, &count);
-    ncplane_move_rel(ui_plane, 2, 0);
-    ncplane_erase(ui_plane);
-    notcurses_render(nc);
-    ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-    ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 2, absx);
-    ncplane_printf_yx(log_plane, ncplane_dim_y(log_plane) - 2, 0, "%s ", time);
-    ncplane_set_fg_palindex(log_plane, 9);
-    ncplane_printf(log_plane, "TAF hook failed. Traceback:");
-    for (size_t i = 0; i < count; i++) {
-        ncplane_move_rel(ui_plane, 1, 0);
-        ncplane_erase(ui_plane);
-        notcurses_render(nc);
-        ncplane_scrollup_child(notcurses_stdplane(nc), ui_plane);
-        ncplane_putstr_aligned(log_plane, ncplane_dim_y(log_plane) - 1,
-                               NCALIGN_LEFT, &trace[indices[i]]);
-        ncplane_resize_simple(log_plane, ncplane_dim_y(log_plane) + 1, absx);
-    }
-    ncplane_set_fg_default(log_plane);
-    free(indices);
-    for (uint i = 0; i < ncplane_dim_x(log_plane); i++) {
-        ncplane_putstr_yx(log_plane, ncplane_dim_y(log_plane) - 1, i, "─");
-    }
-    taf_tui_update();
+    pthread_mutex_lock(&tui_mutex);
+    log_push_event(time, 9, "TAF hook failed. Traceback:");
+    log_push_text(9, trace);
+    log_push_separator();
+    pthread_mutex_unlock(&tui_mutex);
 }
 
 static void init_project_info() {
@@ -551,27 +665,31 @@ static void init_project_info() {
 
 static int stdplane_resize_cb(struct ncplane *) {
     notcurses_refresh(nc, NULL, NULL);
-    taf_tui_update();
     return 0;
 }
 
 static int progress_bar_resize_cb(struct ncplane *plane) {
     ncplane_dim_yx(notcurses_stdplane(nc), &absy, &absx);
     ncplane_resize_simple(plane, 1, absx - 18);
-    taf_tui_update();
     return 0;
 }
 
-static int log_plane_resize_cb(struct ncplane *) {
-    // ncplane_dim_yx(notcurses_stdplane(nc), &absy, &absx);
-    // ncplane_resize_simple(plane, absy - 13 - project_info_dimy, absx - 2);
+// Log plane fills the screen above the UI plane
+static uint log_plane_rows() {
+    uint ui_rows = 13 + project_info_dimy;
+    return absy > ui_rows ? absy - ui_rows : 1;
+}
+
+static int log_plane_resize_cb(struct ncplane *plane) {
+    ncplane_dim_yx(notcurses_stdplane(nc), &absy, &absx);
+    ncplane_resize_simple(plane, log_plane_rows(), absx);
+    log_dirty = true;
     return 0;
 }
 
 static int ui_plane_resize_cb(struct ncplane *plane) {
     ncplane_dim_yx(notcurses_stdplane(nc), &absy, &absx);
     ncplane_resize_simple(plane, 13 + project_info_dimy, absx);
-    taf_tui_update();
     return 0;
 }
 
@@ -579,7 +697,6 @@ static int test_progress_plane_resize_cb(struct ncplane *plane) {
     uint uiy, uix;
     ncplane_dim_yx(ui_plane, &uiy, &uix);
     ncplane_resize_simple(plane, 4, uix - 6);
-    taf_tui_update();
     return 0;
 }
 
@@ -659,21 +776,48 @@ int taf_tui_init() {
 
     ncplane_options log_plane_opts = {
         .x = 0,
-        .y = ncplane_abs_y(ui_plane) - 1,
+        .y = 0,
         .cols = absx,
-        .rows = 1,
+        .rows = log_plane_rows(),
         .resizecb = log_plane_resize_cb,
     };
     log_plane = ncplane_create(stdplane, &log_plane_opts);
 
-    taf_tui_update();
+    log_ring_cap = cmd_parser_get_test_options()->tui_scrollback;
+    log_ring = calloc(log_ring_cap, sizeof *log_ring);
+    if (!log_ring) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    draw_ui();
+
+    static bool atfork_registered = false;
+    if (!atfork_registered) {
+        pthread_atfork(NULL, NULL, tui_atfork_child);
+        atfork_registered = true;
+    }
+
+    // Line hook only publishes the current line, the UI is redrawn here
+    atomic_store(&render_running, true);
+    if (pthread_create(&render_thread, NULL, render_main, NULL)) {
+        atomic_store(&render_running, false);
+        notcurses_stop(nc);
+        fprintf(stderr, "Unable to start TUI render thread.\n");
+        return -1;
+    }
 
     return 0;
 }
 
 void taf_tui_deinit() {
 
-    taf_tui_update();
+    if (atomic_exchange(&render_running, false)) {
+        pthread_join(render_thread, NULL);
+    }
+
+    apply_snapshot();
+    draw_ui();
 
     notcurses_stop(nc);
 
@@ -690,8 +834,14 @@ void taf_tui_deinit() {
     }
     free(ui.test_history);
 
-    free(ui.current_line_str);
-    free(ui.current_file);
+    for (size_t i = 0; i < log_ring_len; i++) {
+        free(log_ring_at(i)->text);
+    }
+    free(log_ring);
+    log_ring = NULL;
+    log_ring_len = 0;
+    log_ring_start = 0;
+
     free(ui.project_name);
     free(ui.tags);
     free(ui.target);
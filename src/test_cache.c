@@ -0,0 +1,385 @@
+#include "test_cache.h"
+
+#include "internal_logging.h"
+
+#include "cmd_parser.h"
+#include "project_parser.h"
+#include "taf_state.h"
+#include "test_case.h"
+#include "test_each.h"
+#include "test_logs.h"
+#include "version.h"
+
+#include "util/files.h"
+
+#include <json.h>
+
+#include <lauxlib.h>
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_CACHE_VERSION 1
+
+// Registry table: source file -> { required file -> true }
+#define REQUIRES_KEY "taf.cache.requires"
+// Registry table: required file -> module name
+#define MODULES_KEY "taf.cache.modules"
+
+#define FNV_OFFSET 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+typedef struct {
+    char *name;
+    uint64_t hash;
+    bool hit;
+} cache_entry_t;
+
+static cache_entry_t *entries = NULL;
+static size_t entries_count = 0;
+
+typedef struct {
+    char **items;
+    size_t count;
+    size_t cap;
+} path_set_t;
+
+static void hash_bytes(uint64_t *hash, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        *hash ^= p[i];
+        *hash *= FNV_PRIME;
+    }
+}
+
+static void hash_string(uint64_t *hash, const char *str) {
+    // Terminator included, so that "ab" + "c" differs from "a" + "bc"
+    hash_bytes(hash, str ? str : "", str ? strlen(str) + 1 : 1);
+}
+
+static void hash_file(uint64_t *hash, const char *path) {
+    hash_string(hash, path);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        LOG("Unable to open '%s' for hashing.", path);
+        hash_string(hash, "(missing)");
+        return;
+    }
+    char buf[8192];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof buf, f)) > 0) {
+        hash_bytes(hash, buf, n);
+    }
+    fclose(f);
+}
+
+static int dump_writer(lua_State *L, const void *p, size_t sz, void *ud) {
+    hash_bytes(ud, p, sz);
+    return 0;
+}
+
+static int require_tracked(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+
+    lua_Debug ar;
+    if (lua_getstack(L, 1, &ar) && lua_getinfo(L, "S", &ar) &&
+        ar.source[0] == '@') {
+        lua_getglobal(L, "package");
+        lua_getfield(L, -1, "searchpath");
+        lua_pushstring(L, name);
+        lua_getfield(L, -3, "path");
+        if (lua_pcall(L, 2, 1, 0) == LUA_OK && lua_type(L, -1) == LUA_TSTRING) {
+            luaL_getsubtable(L, LUA_REGISTRYINDEX, REQUIRES_KEY);
+            luaL_getsubtable(L, -1, ar.source + 1);
+            lua_pushvalue(L, -3);
+            lua_pushboolean(L, 1);
+            lua_settable(L, -3);
+            lua_pop(L, 2); /* pop file table + requires table */
+
+            luaL_getsubtable(L, LUA_REGISTRYINDEX, MODULES_KEY);
+            lua_pushvalue(L, -2);
+            lua_pushstring(L, name);
+            lua_settable(L, -3);
+            lua_pop(L, 1); /* pop modules table */
+        }
+        lua_pop(L, 2); /* pop searchpath result + package */
+    }
+
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+void test_cache_track_requires(lua_State *L) {
+    LOG("Tracking required files...");
+    lua_getglobal(L, "require");
+    lua_pushcclosure(L, require_tracked, 1);
+    lua_setglobal(L, "require");
+}
+
+static bool path_set_add(path_set_t *set, const char *path) {
+    for (size_t i = 0; i < set->count; i++) {
+        if (!strcmp(set->items[i], path)) {
+            return false;
+        }
+    }
+    if (set->count == set->cap) {
+        set->cap = set->cap ? set->cap * 2 : 8;
+        set->items = realloc(set->items, set->cap * sizeof *set->items);
+    }
+    set->items[set->count++] = strdup(path);
+    return true;
+}
+
+static void path_set_free(path_set_t *set) {
+    for (size_t i = 0; i < set->count; i++) {
+        free(set->items[i]);
+    }
+    free(set->items);
+}
+
+static int path_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Adds source file of the function on top of the stack and pops it
+static void add_function_source(lua_State *L, path_set_t *set) {
+    lua_Debug ar;
+    if (lua_getinfo(L, ">S", &ar) && ar.source[0] == '@') {
+        path_set_add(set, ar.source + 1);
+    }
+}
+
+// Extends `set` with all the files its files require, transitively
+static void add_requires(lua_State *L, path_set_t *set) {
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, REQUIRES_KEY);
+    for (size_t i = 0; i < set->count; i++) {
+        if (lua_getfield(L, -1, set->items[i]) != LUA_TTABLE) {
+            lua_pop(L, 1);
+            continue;
+        }
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            lua_pop(L, 1);
+            path_set_add(set, lua_tostring(L, -1));
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+}
+
+str_array_t test_cache_get_dependents(lua_State *L, const char *path) {
+    path_set_t set = {0};
+    path_set_add(&set, path);
+
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, REQUIRES_KEY);
+    bool added = true;
+    while (added) {
+        added = false;
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            const char *from = lua_tostring(L, -2);
+            for (size_t i = 0; i < set.count; i++) {
+                if (lua_getfield(L, -1, set.items[i]) != LUA_TNIL) {
+                    added |= path_set_add(&set, from);
+                    lua_pop(L, 1);
+                    break;
+                }
+                lua_pop(L, 1);
+            }
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+
+    str_array_t result = {.items = set.items, .count = set.count};
+    return result;
+}
+
+void test_cache_unload(lua_State *L, const char *path) {
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, MODULES_KEY);
+    if (lua_getfield(L, -1, path) == LUA_TSTRING) {
+        LOG("Unloading module '%s'...", lua_tostring(L, -1));
+        luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+        lua_pushvalue(L, -2);
+        lua_pushnil(L);
+        lua_settable(L, -3);
+        lua_pop(L, 1); /* pop loaded table */
+    }
+    lua_pop(L, 2); /* pop module name + modules table */
+}
+
+static uint64_t hash_test(lua_State *L, test_case_t *test,
+                          path_set_t *hook_files) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+
+    uint64_t hash = FNV_OFFSET;
+    hash_string(&hash, TAF_VERSION);
+    hash_string(&hash, opts->target);
+    hash_string(&hash, test->name);
+
+    path_set_t files = {0};
+    for (size_t i = 0; i < hook_files->count; i++) {
+        path_set_add(&files, hook_files->items[i]);
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, test->ref);
+    lua_dump(L, dump_writer, &hash, 0);
+    add_function_source(L, &files);
+
+    const char *rows_file = test_each_rows_file(L, test);
+    if (rows_file) {
+        path_set_add(&files, rows_file);
+    }
+
+    add_requires(L, &files);
+    qsort(files.items, files.count, sizeof *files.items, path_cmp);
+    for (size_t i = 0; i < files.count; i++) {
+        hash_file(&hash, files.items[i]);
+    }
+    path_set_free(&files);
+
+    return hash;
+}
+
+static void get_results_path(char buf[PATH_MAX]) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    project_parsed_t *proj = get_parsed_project();
+
+    if (proj->multitarget) {
+        snprintf(buf, PATH_MAX, "%s/" TEST_CACHE_DIR "/results/%s.json",
+                 proj->project_path, opts->target);
+    } else {
+        snprintf(buf, PATH_MAX, "%s/" TEST_CACHE_DIR "/results.json",
+                 proj->project_path);
+    }
+}
+
+static json_object *load_results() {
+    char path[PATH_MAX];
+    get_results_path(path);
+
+    json_object *root = json_object_from_file(path);
+    json_object *o;
+    if (!root || !json_object_object_get_ex(root, "version", &o) ||
+        json_object_get_int(o) != TEST_CACHE_VERSION ||
+        !json_object_object_get_ex(root, "tests", &o) ||
+        !json_object_is_type(o, json_type_object)) {
+        LOG("No valid test results cache at '%s'.", path);
+        json_object_put(root);
+        return NULL;
+    }
+    return root;
+}
+
+void test_cache_load(lua_State *L) {
+    LOG("Loading test results cache...");
+
+    test_cache_free();
+
+    size_t amount;
+    test_case_t *tests = test_case_get_all(&amount);
+
+    // Hooks may affect every test
+    path_set_t hook_files = {0};
+    taf_state_t *state = taf_state_get();
+    for (size_t i = 0; i < TAF_HOOK_FN_COUNT; i++) {
+        for (size_t j = 0; j < state->hooks[i].count; j++) {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, state->hooks[i].hooks[j].ref);
+            add_function_source(L, &hook_files);
+        }
+    }
+
+    json_object *root = load_results();
+    json_object *results = NULL;
+    if (root) {
+        json_object_object_get_ex(root, "tests", &results);
+    }
+
+    entries = calloc(amount ? amount : 1, sizeof *entries);
+    entries_count = amount;
+    size_t hits = 0;
+    for (size_t i = 0; i < amount; i++) {
+        entries[i].name = strdup(tests[i].name);
+        entries[i].hash = hash_test(L, &tests[i], &hook_files);
+
+        json_object *o;
+        if (results && json_object_object_get_ex(results, tests[i].name, &o)) {
+            char hex[17];
+            snprintf(hex, sizeof hex, "%016" PRIx64, entries[i].hash);
+            entries[i].hit = !strcmp(json_object_get_string(o), hex);
+        }
+        if (entries[i].hit) {
+            LOG("Test '%s' is unchanged since it passed.", tests[i].name);
+            hits++;
+        }
+    }
+    path_set_free(&hook_files);
+    json_object_put(root);
+
+    LOG("%zu out of %zu tests are cached.", hits, amount);
+}
+
+bool test_cache_hit(size_t index) {
+    return index < entries_count && entries[index].hit;
+}
+
+void test_cache_save() {
+    LOG("Saving test results cache...");
+
+    char path[PATH_MAX];
+    get_results_path(path);
+
+    char dir[PATH_MAX];
+    snprintf(dir, PATH_MAX, "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash) {
+        *slash = '\0';
+    }
+    if (create_directory(dir, MKDIR_MODE)) {
+        LOG("Unable to create cache directory '%s'.", dir);
+        return;
+    }
+
+    // Results of tests not run this time (e.g. filtered by tags) are kept
+    json_object *root = load_results();
+    if (!root) {
+        root = json_object_new_object();
+        json_object_object_add(root, "version",
+                               json_object_new_int(TEST_CACHE_VERSION));
+        json_object_object_add(root, "tests", json_object_new_object());
+    }
+    json_object *results;
+    json_object_object_get_ex(root, "tests", &results);
+
+    for (size_t i = 0; i < entries_count; i++) {
+        raw_log_test_t *test = taf_log_get_test(i + 1);
+        if (test->status && !strcmp(test->status, "passed")) {
+            char hex[17];
+            snprintf(hex, sizeof hex, "%016" PRIx64, entries[i].hash);
+            json_object_object_add(results, entries[i].name,
+                                   json_object_new_string(hex));
+        } else {
+            json_object_object_del(results, entries[i].name);
+        }
+    }
+
+    if (json_object_to_file_ext(path, root, JSON_C_TO_STRING_PLAIN)) {
+        LOG("Unable to save test results cache '%s': %s", path,
+            json_util_get_last_err());
+    }
+    json_object_put(root);
+}
+
+void test_cache_free() {
+    for (size_t i = 0; i < entries_count; i++) {
+        free(entries[i].name);
+    }
+    free(entries);
+    entries = NULL;
+    entries_count = 0;
+}
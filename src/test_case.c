@@ -1,58 +1,110 @@
 #include "test_case.h"
 
 #include "internal_logging.h"
+#include "taf_state.h"
 
 #include <stdlib.h>
 #include <string.h>
 
-static test_case_t *tests = NULL;
-static size_t tests_len = 0;
-static size_t tests_cap = 0;
+// Releases references of `tc`, shared ones only with their last user
+static void test_case_unref(lua_State *L, test_case_t *tc) {
+    if (tc->users && --*tc->users > 0) {
+        return;
+    }
+    luaL_unref(L, LUA_REGISTRYINDEX, tc->ref);
+    if (tc->row != 0) {
+        luaL_unref(L, LUA_REGISTRYINDEX, tc->rows_ref);
+    }
+    free(tc->users);
+}
 
 void test_case_enqueue(test_case_t *tc) {
     if (!tc) {
         LOG("Test case is NULL");
         return;
     }
-    for (size_t i = 0; i < tests_len; i++) {
-        if (!strcmp(tc->name, tests[i].name)) {
+    taf_state_t *state = taf_state_get();
+    for (size_t i = 0; i < state->tests_len; i++) {
+        if (!strcmp(tc->name, state->tests[i].name)) {
             LOG("Overwriting test '%s'...", tc->name);
-            memcpy(&tests[i], tc, sizeof(test_case_t));
+            test_case_unref(state->L, &state->tests[i]);
+            memcpy(&state->tests[i], tc, sizeof(test_case_t));
             return;
         }
     }
     LOG("Adding test '%s' to the queue", tc->name);
-    if (tests_len == tests_cap) { /* grow 2× */
-        LOG("Reallocating: cap: %zu, len: %zu", tests_cap, tests_len);
-        tests_cap = tests_cap ? tests_cap * 2 : 8;
-        tests = realloc(tests, tests_cap * sizeof(test_case_t));
-        if (!tests) {
+    if (state->tests_len == state->tests_cap) { /* grow 2× */
+        LOG("Reallocating: cap: %zu, len: %zu", state->tests_cap,
+            state->tests_len);
+        state->tests_cap = state->tests_cap ? state->tests_cap * 2 : 8;
+        state->tests =
+            realloc(state->tests, state->tests_cap * sizeof(test_case_t));
+        if (!state->tests) {
             perror("realloc");
             exit(EXIT_FAILURE);
         }
     }
-    memcpy(&tests[tests_len], tc, sizeof(test_case_t));
-    tests_len++;
+    memcpy(&state->tests[state->tests_len], tc, sizeof(test_case_t));
+    state->tests_len++;
 }
 
 test_case_t *test_case_get_all(size_t *amount) {
+    taf_state_t *state = taf_state_get();
     if (amount) {
-        *amount = tests_len;
+        *amount = state->tests_len;
+    }
+    return state->tests;
+}
+
+void test_case_retain(lua_State *L, const bool *keep) {
+    taf_state_t *state = taf_state_get();
+    size_t len = 0;
+    for (size_t i = 0; i < state->tests_len; i++) {
+        if (!keep[i]) {
+            LOG("Dropping test '%s'", state->tests[i].name);
+            test_case_unref(L, &state->tests[i]);
+            continue;
+        }
+        if (len != i) {
+            memcpy(&state->tests[len], &state->tests[i], sizeof(test_case_t));
+        }
+        len++;
     }
-    return tests;
+    LOG("Retained %zu out of %zu tests.", len, state->tests_len);
+    state->tests_len = len;
+}
+
+void test_case_reorder(const size_t *order) {
+    taf_state_t *state = taf_state_get();
+    if (state->tests_len == 0) {
+        return;
+    }
+    test_case_t *tests = malloc(state->tests_cap * sizeof(test_case_t));
+    if (!tests) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < state->tests_len; i++) {
+        memcpy(&tests[i], &state->tests[order[i]], sizeof(test_case_t));
+    }
+    free(state->tests);
+    state->tests = tests;
 }
 
 void test_case_free_all(lua_State *L) {
     LOG("Freeing test cases...");
-    if (!tests) {
+    taf_state_t *state = taf_state_get();
+    if (!state->tests) {
         LOG("Tests are null.");
         return;
     }
-    for (size_t i = 0; i < tests_len; i++) {
-        LOG("Unrefing test '%s'", tests[i].name);
-        luaL_unref(L, LUA_REGISTRYINDEX, tests[i].ref);
+    for (size_t i = 0; i < state->tests_len; i++) {
+        LOG("Unrefing test '%s'", state->tests[i].name);
+        test_case_unref(L, &state->tests[i]);
     }
-    free(tests);
-    tests_len = 0;
+    free(state->tests);
+    state->tests = NULL;
+    state->tests_len = 0;
+    state->tests_cap = 0;
     LOG("Freeing tests OK.");
 }
@@ -0,0 +1,625 @@
+#include "test_each.h"
+
+#include "internal_logging.h"
+
+#include "util/lua.h"
+
+#include <json.h>
+
+#include <lauxlib.h>
+
+#include <errno.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROWS_METATABLE "taf-test-each-rows"
+
+typedef enum {
+    ROWS_CSV,
+    ROWS_JSON,       // top-level array
+    ROWS_JSON_LINES, // one value per line
+} rows_format_t;
+
+// Fields of a CSV record, each one terminated with '\0' inside `buf`
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+
+    size_t *starts;
+    size_t count;
+    size_t starts_cap;
+} csv_record_t;
+
+// Rows of a file, only their offsets are kept in memory
+typedef struct {
+    char *path;
+    FILE *fp; // open only while the cases are registered
+    rows_format_t format;
+    csv_record_t header; // CSV only
+
+    off_t *offsets;
+    size_t *lengths; // JSON only
+    size_t count;
+    size_t cap;
+} file_rows_t;
+
+static void *xrealloc(void *ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static void csv_push_char(csv_record_t *rec, char c) {
+    if (rec->len == rec->cap) {
+        rec->cap = rec->cap ? rec->cap * 2 : 256;
+        rec->buf = xrealloc(rec->buf, rec->cap);
+    }
+    rec->buf[rec->len++] = c;
+}
+
+static void csv_begin_field(csv_record_t *rec) {
+    if (rec->count == rec->starts_cap) {
+        rec->starts_cap = rec->starts_cap ? rec->starts_cap * 2 : 16;
+        rec->starts =
+            xrealloc(rec->starts, rec->starts_cap * sizeof *rec->starts);
+    }
+    rec->starts[rec->count++] = rec->len;
+}
+
+static const char *csv_field(csv_record_t *rec, size_t i) {
+    return rec->buf + rec->starts[i];
+}
+
+static void csv_record_free(csv_record_t *rec) {
+    free(rec->buf);
+    free(rec->starts);
+}
+
+// Reads one RFC 4180 record, quoted fields may contain commas, quotes
+// and newlines. Returns false at the end of file.
+static bool csv_read_record(FILE *fp, csv_record_t *rec) {
+    rec->len = 0;
+    rec->count = 0;
+
+    int c = getc_unlocked(fp);
+    if (c == EOF) {
+        return false;
+    }
+
+    bool quoted = false;
+    csv_begin_field(rec);
+    for (;; c = getc_unlocked(fp)) {
+        if (quoted) {
+            if (c == EOF) {
+                break;
+            }
+            if (c != '"') {
+                csv_push_char(rec, c);
+                continue;
+            }
+            c = getc_unlocked(fp);
+            if (c == '"') {
+                csv_push_char(rec, '"');
+                continue;
+            }
+            quoted = false;
+        }
+        if (c == EOF || c == '\n') {
+            break;
+        }
+        if (c == '\r') {
+            continue;
+        }
+        if (c == '"' && rec->len == rec->starts[rec->count - 1]) {
+            quoted = true;
+            continue;
+        }
+        if (c == ',') {
+            csv_push_char(rec, '\0');
+            csv_begin_field(rec);
+            continue;
+        }
+        csv_push_char(rec, c);
+    }
+    csv_push_char(rec, '\0');
+
+    return true;
+}
+
+static bool csv_record_is_blank(csv_record_t *rec) {
+    return rec->count == 1 && rec->buf[0] == '\0';
+}
+
+static void rows_add(file_rows_t *rows, off_t offset, size_t length) {
+    if (rows->count == rows->cap) {
+        rows->cap = rows->cap ? rows->cap * 2 : 64;
+        rows->offsets =
+            xrealloc(rows->offsets, rows->cap * sizeof *rows->offsets);
+        rows->lengths =
+            xrealloc(rows->lengths, rows->cap * sizeof *rows->lengths);
+    }
+    rows->offsets[rows->count] = offset;
+    rows->lengths[rows->count] = length;
+    rows->count++;
+}
+
+static int scan_csv(file_rows_t *rows, FILE *fp) {
+    if (!csv_read_record(fp, &rows->header)) {
+        LOG("CSV file '%s' has no header.", rows->path);
+        return -1;
+    }
+
+    csv_record_t rec = {0};
+    for (;;) {
+        off_t offset = ftello(fp);
+        if (!csv_read_record(fp, &rec)) {
+            break;
+        }
+        if (!csv_record_is_blank(&rec)) {
+            rows_add(rows, offset, 0);
+        }
+    }
+    csv_record_free(&rec);
+
+    return 0;
+}
+
+static int skip_space(FILE *fp) {
+    int c;
+    do {
+        c = getc_unlocked(fp);
+    } while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+    return c;
+}
+
+// Finds elements of the top-level JSON array without parsing them
+static int scan_json(file_rows_t *rows, FILE *fp) {
+    if (skip_space(fp) != '[') {
+        LOG("JSON file '%s' is not an array.", rows->path);
+        return -1;
+    }
+
+    for (;;) {
+        int c = skip_space(fp);
+        if (c == ']') {
+            // Empty array or trailing comma
+            return 0;
+        }
+        if (c == EOF) {
+            break;
+        }
+
+        off_t start = ftello(fp) - 1;
+        off_t end = start + 1;
+        int depth = 0;
+        bool in_string = false;
+        bool escaped = false;
+        for (off_t pos = start;; pos++, c = getc_unlocked(fp)) {
+            if (c == EOF) {
+                LOG("JSON file '%s' ended inside of an element.", rows->path);
+                return -1;
+            }
+            if (in_string) {
+                if (escaped) {
+                    escaped = false;
+                } else if (c == '\\') {
+                    escaped = true;
+                } else if (c == '"') {
+                    in_string = false;
+                }
+            } else if (c == '"') {
+                in_string = true;
+            } else if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (depth == 0) {
+                    break;
+                }
+                depth--;
+            } else if (c == ',' && depth == 0) {
+                break;
+            }
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                end = pos + 1;
+            }
+        }
+        rows_add(rows, start, end - start);
+
+        if (c == ']') {
+            return 0;
+        }
+    }
+
+    LOG("JSON file '%s' ended inside of the array.", rows->path);
+    return -1;
+}
+
+static int scan_json_lines(file_rows_t *rows, FILE *fp) {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+
+    for (;;) {
+        off_t offset = ftello(fp);
+        len = getline(&line, &cap, fp);
+        if (len < 0) {
+            break;
+        }
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            len--;
+        }
+        if (strspn(line, " \t") < (size_t)len) {
+            rows_add(rows, offset, len);
+        }
+    }
+    free(line);
+
+    return 0;
+}
+
+static int l_rows_gc(lua_State *L) {
+    file_rows_t *rows = luaL_checkudata(L, 1, ROWS_METATABLE);
+    if (rows->fp) {
+        fclose(rows->fp);
+    }
+    free(rows->path);
+    csv_record_free(&rows->header);
+    free(rows->offsets);
+    free(rows->lengths);
+    memset(rows, 0, sizeof *rows);
+    return 0;
+}
+
+// Resolves `path` relative to the directory of the test file `file`
+static void resolve_path(const char *file, const char *path,
+                         char buf[PATH_MAX]) {
+    if (path[0] != '/' && file) {
+        char *copy = strdup(file);
+        snprintf(buf, PATH_MAX, "%s/%s", dirname(copy), path);
+        free(copy);
+        return;
+    }
+    snprintf(buf, PATH_MAX, "%s", path);
+}
+
+static bool has_extension(const char *path, const char *ext) {
+    size_t len = strlen(path);
+    size_t ext_len = strlen(ext);
+    return len > ext_len && !strcasecmp(path + len - ext_len, ext);
+}
+
+// Pushes userdata with offsets of rows of file at `path` relative to the
+// test file `file`. The file is left open in `fp` of the rows.
+static file_rows_t *push_file_rows(lua_State *L, const char *file,
+                                   const char *path) {
+    file_rows_t *rows = lua_newuserdatauv(L, sizeof *rows, 0);
+    memset(rows, 0, sizeof *rows);
+    if (luaL_newmetatable(L, ROWS_METATABLE)) {
+        lua_pushcfunction(L, l_rows_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+
+    char resolved[PATH_MAX];
+    resolve_path(file, path, resolved);
+    rows->path = strdup(resolved);
+
+    if (has_extension(resolved, ".csv")) {
+        rows->format = ROWS_CSV;
+    } else if (has_extension(resolved, ".json")) {
+        rows->format = ROWS_JSON;
+    } else if (has_extension(resolved, ".jsonl") ||
+               has_extension(resolved, ".ndjson")) {
+        rows->format = ROWS_JSON_LINES;
+    } else {
+        luaL_error(L, "Unknown format of rows file '%s', expected .csv, "
+                      ".json, .jsonl or .ndjson", path);
+        return NULL;
+    }
+
+    LOG("Scanning rows of '%s'...", resolved);
+    FILE *fp = fopen(resolved, "r");
+    rows->fp = fp;
+    if (!fp) {
+        LOG("Unable to open '%s': %s", resolved, strerror(errno));
+        luaL_error(L, "Unable to open rows file '%s': %s", resolved,
+                   strerror(errno));
+        return NULL;
+    }
+
+    int rc;
+    switch (rows->format) {
+    case ROWS_CSV:
+        rc = scan_csv(rows, fp);
+        break;
+    case ROWS_JSON:
+        rc = scan_json(rows, fp);
+        break;
+    default:
+        rc = scan_json_lines(rows, fp);
+        break;
+    }
+
+    if (rc) {
+        luaL_error(L, "Malformed rows file '%s'", resolved);
+        return NULL;
+    }
+    LOG("Found %zu rows in '%s'", rows->count, resolved);
+
+    return rows;
+}
+
+// Pushes `row`-th (1-based) row of `rows` read from `fp`
+static void push_file_row(lua_State *L, file_rows_t *rows, FILE *fp,
+                          size_t row) {
+    if (fseeko(fp, rows->offsets[row - 1], SEEK_SET)) {
+        luaL_error(L, "Unable to read rows file '%s': %s", rows->path,
+                   strerror(errno));
+        return;
+    }
+
+    if (rows->format == ROWS_CSV) {
+        csv_record_t rec = {0};
+        csv_read_record(fp, &rec);
+        lua_createtable(L, 0, rows->header.count);
+        for (size_t i = 0; i < rows->header.count; i++) {
+            if (i < rec.count) {
+                lua_pushstring(L, csv_field(&rec, i));
+            } else {
+                lua_pushnil(L);
+            }
+            lua_setfield(L, -2, csv_field(&rows->header, i));
+        }
+        csv_record_free(&rec);
+        return;
+    }
+
+    size_t len = rows->lengths[row - 1];
+    char *buf = malloc(len + 1);
+    if (!buf || fread(buf, 1, len, fp) != len) {
+        free(buf);
+        luaL_error(L, "Unable to read rows file '%s'", rows->path);
+        return;
+    }
+    buf[len] = '\0';
+
+    json_object *obj = json_tokener_parse(buf);
+    free(buf);
+    if (!obj) {
+        luaL_error(L, "Malformed row #%d in '%s'", (int)row, rows->path);
+        return;
+    }
+    json_to_lua(L, obj);
+    json_object_put(obj);
+}
+
+// Pushes `row`-th (1-based) row of rows at `index`
+static void push_row(lua_State *L, int index, size_t row) {
+    if (lua_istable(L, index)) {
+        lua_geti(L, index, row);
+        return;
+    }
+
+    file_rows_t *rows = luaL_checkudata(L, index, ROWS_METATABLE);
+    FILE *fp = fopen(rows->path, "r");
+    if (!fp) {
+        luaL_error(L, "Unable to open rows file '%s': %s", rows->path,
+                   strerror(errno));
+        return;
+    }
+    push_file_row(L, rows, fp, row);
+    fclose(fp);
+}
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} name_buf_t;
+
+static void name_append(name_buf_t *name, const char *str, size_t len) {
+    if (name->len + len + 1 > name->cap) {
+        while (name->len + len + 1 > name->cap) {
+            name->cap = name->cap ? name->cap * 2 : 64;
+        }
+        name->buf = xrealloc(name->buf, name->cap);
+    }
+    memcpy(name->buf + name->len, str, len);
+    name->len += len;
+    name->buf[name->len] = '\0';
+}
+
+// Formats name of the case for `row`-th row on top of the stack
+static char *format_name(lua_State *L, const char *fmt, size_t row) {
+    int row_index = lua_gettop(L);
+    name_buf_t name = {0};
+    name_append(&name, "", 0);
+
+    const char *p = fmt;
+    while (*p) {
+        const char *open = strstr(p, "${");
+        const char *close = open ? strchr(open + 2, '}') : NULL;
+        if (!close) {
+            name_append(&name, p, strlen(p));
+            break;
+        }
+        name_append(&name, p, open - p);
+
+        const char *key = open + 2;
+        size_t key_len = close - key;
+        if (key_len == 1 && key[0] == '#') {
+            lua_pushinteger(L, row);
+        } else if (!lua_istable(L, row_index)) {
+            lua_pushvalue(L, row_index);
+        } else {
+            lua_pushlstring(L, key, key_len);
+            // Numeric keys address fields of array rows
+            if (lua_stringtonumber(L, lua_tostring(L, -1))) {
+                lua_remove(L, -2);
+            }
+            lua_gettable(L, row_index);
+        }
+
+        size_t len;
+        const char *str = luaL_tolstring(L, -1, &len);
+        name_append(&name, str, len);
+        lua_pop(L, 2);
+
+        p = close + 1;
+    }
+
+    return name.buf;
+}
+
+static int compare_names(const void *a, const void *b) {
+    //
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Returns a name which is in `names` more than once, NULL if there is none
+static const char *find_duplicate(char **names, size_t amount) {
+    if (amount < 2) {
+        return NULL;
+    }
+    char **sorted = xrealloc(NULL, amount * sizeof(char *));
+    memcpy(sorted, names, amount * sizeof(char *));
+    qsort(sorted, amount, sizeof(char *), compare_names);
+
+    const char *duplicate = NULL;
+    for (size_t i = 1; i < amount && !duplicate; i++) {
+        if (!strcmp(sorted[i - 1], sorted[i])) {
+            duplicate = sorted[i];
+        }
+    }
+    free(sorted);
+    return duplicate;
+}
+
+size_t test_each_register(lua_State *L, const char *name_fmt, int rows_index,
+                          int body_index, test_tags_t tags,
+                          unsigned long timeout) {
+    rows_index = lua_absindex(L, rows_index);
+    body_index = lua_absindex(L, body_index);
+
+    const char *file = NULL;
+    lua_Debug ar;
+    lua_pushvalue(L, body_index);
+    if (lua_getinfo(L, ">S", &ar) && ar.source[0] == '@') {
+        file = strdup(ar.source + 1);
+    }
+
+    size_t amount;
+    file_rows_t *rows = NULL;
+    if (lua_istable(L, rows_index)) {
+        amount = luaL_len(L, rows_index);
+        lua_pushvalue(L, rows_index);
+    } else {
+        rows = push_file_rows(L, file, lua_tostring(L, rows_index));
+        amount = rows->count;
+    }
+    int rows_value = lua_gettop(L);
+
+    // Rows are only visited to name the cases
+    char **names = amount ? xrealloc(NULL, amount * sizeof(char *)) : NULL;
+    for (size_t i = 1; i <= amount; i++) {
+        if (rows) {
+            push_file_row(L, rows, rows->fp, i);
+        } else {
+            lua_geti(L, rows_value, i);
+        }
+        names[i - 1] = format_name(L, name_fmt, i);
+        lua_pop(L, 1);
+    }
+
+    const char *duplicate = find_duplicate(names, amount);
+    if (duplicate) {
+        lua_pushfstring(L,
+                        "Test name '%s' of taf.test_each is not unique, "
+                        "use ${#} or row fields in the name",
+                        duplicate);
+        for (size_t i = 0; i < amount; i++) {
+            free(names[i]);
+        }
+        free(names);
+        if (rows) {
+            fclose(rows->fp);
+            rows->fp = NULL;
+        }
+        lua_error(L);
+        return 0;
+    }
+
+    // All the cases share the body & the rows
+    int ref = LUA_NOREF;
+    int rows_ref = LUA_NOREF;
+    size_t *users = NULL;
+    if (amount) {
+        lua_pushvalue(L, body_index);
+        ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        lua_pushvalue(L, rows_value);
+        rows_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        users = xrealloc(NULL, sizeof(size_t));
+        *users = amount;
+    }
+
+    for (size_t i = 1; i <= amount; i++) {
+        // Cases share tags & file of the parametrized test
+        test_case_t test_case = {.name = names[i - 1],
+                                 .tags = tags,
+                                 .ref = ref,
+                                 .file = file,
+                                 .timeout = timeout,
+                                 .row = i,
+                                 .rows_ref = rows_ref,
+                                 .users = users};
+        test_case_enqueue(&test_case);
+    }
+    free(names);
+
+    if (rows) {
+        fclose(rows->fp);
+        rows->fp = NULL;
+    }
+    lua_pop(L, 1); // pop rows
+
+    return amount;
+}
+
+static int call_with_row_k(lua_State *L, int status, lua_KContext ctx) {
+    return 0;
+}
+
+// Test body of taf.test_each case, the body, rows & row are upvalues
+static int call_with_row(lua_State *L) {
+    lua_pushvalue(L, lua_upvalueindex(1));
+    push_row(L, lua_upvalueindex(2), lua_tointeger(L, lua_upvalueindex(3)));
+    // May yield to the test scheduler
+    lua_callk(L, 1, 0, 0, call_with_row_k);
+    return 0;
+}
+
+void test_each_wrap_body(lua_State *L, test_case_t *tc) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, tc->rows_ref);
+    lua_pushinteger(L, tc->row);
+    lua_pushcclosure(L, call_with_row, 3);
+}
+
+const char *test_each_rows_file(lua_State *L, test_case_t *tc) {
+    if (tc->row == 0) {
+        return NULL;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, tc->rows_ref);
+    file_rows_t *rows = luaL_testudata(L, -1, ROWS_METATABLE);
+    lua_pop(L, 1);
+
+    // Userdata is kept alive by the reference
+    return rows ? rows->path : NULL;
+}
@@ -0,0 +1,394 @@
+#include "test_history.h"
+
+#include "internal_logging.h"
+
+#include "test_logs.h"
+
+#include "util/gzip.h"
+
+#include <json.h>
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define RAW_LOG_PREFIX "test_run_"
+#define RAW_LOG_LATEST_PREFIX "test_run_latest"
+
+// Summary of the raw logs, rebuilt whenever the set of the recent logs changes
+#define HISTORY_CACHE_FILE ".test_history.json"
+#define HISTORY_CACHE_VERSION 2
+
+typedef struct {
+    char *path;
+    time_t mtime;
+} raw_log_file_t;
+
+static int raw_log_file_cmp(const void *a, const void *b) {
+    const raw_log_file_t *fa = a;
+    const raw_log_file_t *fb = b;
+    // Most recent first
+    if (fa->mtime != fb->mtime) {
+        return fa->mtime < fb->mtime ? 1 : -1;
+    }
+    return strcmp(fb->path, fa->path);
+}
+
+static bool is_raw_log(const char *name) {
+    size_t len = strlen(name);
+    size_t prefix_len = strlen(RAW_LOG_PREFIX);
+    if (strncmp(name, RAW_LOG_PREFIX, prefix_len) ||
+        !strncmp(name, RAW_LOG_LATEST_PREFIX, strlen(RAW_LOG_LATEST_PREFIX))) {
+        return false;
+    }
+    // Compressed logs are read the same way
+    size_t gz_len = strlen(GZIP_SUFFIX);
+    if (len > gz_len && !strcmp(name + len - gz_len, GZIP_SUFFIX)) {
+        len -= gz_len;
+    }
+    const char *suffix;
+    for (int f = 0; (suffix = taf_raw_log_format_suffix(f)); f++) {
+        size_t suffix_len = strlen(suffix);
+        if (len > prefix_len + suffix_len &&
+            !strncmp(name + len - suffix_len, suffix, suffix_len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_date_time(const char *str, time_t *out) {
+    if (!str) {
+        return false;
+    }
+    // Format "%m.%d.%y-%H:%M:%S", strptime() isn't declared without
+    // _XOPEN_SOURCE
+    int month, day, year, hour, min, sec, end = 0;
+    if (sscanf(str, "%2d.%2d.%2d-%2d:%2d:%2d%n", &month, &day, &year, &hour,
+               &min, &sec, &end) != 6 ||
+        str[end] != '\0') {
+        return false;
+    }
+    struct tm tm = {0};
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    // Same century rule as strptime()
+    tm.tm_year = year < 69 ? year + 100 : year;
+    tm.tm_hour = hour;
+    tm.tm_min = min;
+    tm.tm_sec = sec;
+    tm.tm_isdst = -1;
+    *out = mktime(&tm);
+    return *out != (time_t)-1;
+}
+
+static size_t hash_name(const char *name) {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (; *name; name++) {
+        h ^= (unsigned char)*name;
+        h *= 1099511628211ULL;
+    }
+    return (size_t)h;
+}
+
+static void slots_insert(test_history_t *history, size_t index) {
+    size_t mask = history->slots_cap - 1;
+    size_t i = hash_name(history->entries[index].name) & mask;
+    while (history->slots[i]) {
+        i = (i + 1) & mask;
+    }
+    history->slots[i] = index + 1;
+}
+
+static void slots_grow(test_history_t *history) {
+    free(history->slots);
+    history->slots_cap = history->slots_cap ? history->slots_cap * 2 : 64;
+    history->slots = calloc(history->slots_cap, sizeof *history->slots);
+    if (!history->slots) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < history->count; i++) {
+        slots_insert(history, i);
+    }
+}
+
+static test_history_entry_t *history_get(test_history_t *history,
+                                         const char *name) {
+    test_history_entry_t *entry = test_history_find(history, name);
+    if (entry) {
+        return entry;
+    }
+    if (history->count == history->cap) {
+        history->cap = history->cap ? history->cap * 2 : 16;
+        history->entries =
+            realloc(history->entries, history->cap * sizeof *history->entries);
+    }
+    if ((history->count + 1) * 2 > history->slots_cap) {
+        slots_grow(history);
+    }
+    entry = &history->entries[history->count];
+    entry->name = strdup(name);
+    entry->duration = 0;
+    entry->runs = 0;
+    entry->last_failed = false;
+    slots_insert(history, history->count++);
+    return entry;
+}
+
+static void history_add_log(test_history_t *history, raw_log_t *log) {
+    for (size_t i = 0; i < log->tests_count; i++) {
+        raw_log_test_t *test = &log->tests[i];
+        if (!test->name || !test->status) {
+            continue;
+        }
+        double duration = test->duration_ms / 1000.0;
+        if (test->duration_ms == 0) {
+            // Logs older than duration_ms only have second precision
+            time_t started;
+            time_t finished;
+            if (!parse_date_time(test->started, &started) ||
+                !parse_date_time(test->finished, &finished)) {
+                continue;
+            }
+            duration = difftime(finished, started);
+            if (duration < 0) {
+                continue;
+            }
+        }
+
+        bool known = test_history_find(history, test->name) != NULL;
+        test_history_entry_t *entry = history_get(history, test->name);
+        entry->duration =
+            (entry->duration * entry->runs + duration) / (entry->runs + 1);
+        entry->runs++;
+        // Logs are processed starting from the most recent one
+        if (!known) {
+            entry->last_failed = strcmp(test->status, "passed") != 0;
+        }
+    }
+}
+
+static json_object *sources_to_json(raw_log_file_t *files, size_t count) {
+    json_object *sources = json_object_new_array();
+    for (size_t i = 0; i < count; i++) {
+        json_object *source = json_object_new_object();
+        const char *name = strrchr(files[i].path, '/');
+        json_object_object_add(source, "file",
+                               json_object_new_string(name ? name + 1
+                                                           : files[i].path));
+        json_object_object_add(source, "mtime",
+                               json_object_new_int64(files[i].mtime));
+        json_object_array_add(sources, source);
+    }
+    return sources;
+}
+
+static bool cache_load(const char *path, json_object *sources,
+                       test_history_t *history) {
+    json_object *root = json_object_from_file(path);
+    if (!root) {
+        LOG("No history cache found.");
+        return false;
+    }
+
+    json_object *o;
+    if (!json_object_object_get_ex(root, "version", &o) ||
+        json_object_get_int(o) != HISTORY_CACHE_VERSION ||
+        !json_object_object_get_ex(root, "sources", &o) ||
+        !json_object_equal(o, sources) ||
+        !json_object_object_get_ex(root, "tests", &o) ||
+        !json_object_is_type(o, json_type_array)) {
+        LOG("History cache is outdated.");
+        json_object_put(root);
+        return false;
+    }
+
+    size_t len = json_object_array_length(o);
+    for (size_t i = 0; i < len; i++) {
+        json_object *jt = json_object_array_get_idx(o, i);
+        json_object *name, *duration, *runs, *last_failed;
+        if (!json_object_object_get_ex(jt, "name", &name) ||
+            !json_object_object_get_ex(jt, "duration", &duration) ||
+            !json_object_object_get_ex(jt, "runs", &runs) ||
+            !json_object_object_get_ex(jt, "last_failed", &last_failed)) {
+            continue;
+        }
+        test_history_entry_t *entry =
+            history_get(history, json_object_get_string(name));
+        entry->duration = json_object_get_double(duration);
+        entry->runs = json_object_get_int64(runs);
+        entry->last_failed = json_object_get_boolean(last_failed);
+    }
+    json_object_put(root);
+
+    LOG("Loaded history cache '%s'.", path);
+    return true;
+}
+
+static void cache_save(const char *path, json_object *sources,
+                       test_history_t *history) {
+    json_object *root = json_object_new_object();
+    json_object_object_add(root, "version",
+                           json_object_new_int(HISTORY_CACHE_VERSION));
+    json_object_object_add(root, "sources", json_object_get(sources));
+
+    json_object *tests = json_object_new_array();
+    for (size_t i = 0; i < history->count; i++) {
+        test_history_entry_t *entry = &history->entries[i];
+        json_object *jt = json_object_new_object();
+        json_object_object_add(jt, "name", json_object_new_string(entry->name));
+        json_object_object_add(jt, "duration",
+                               json_object_new_double(entry->duration));
+        json_object_object_add(jt, "runs", json_object_new_int64(entry->runs));
+        json_object_object_add(jt, "last_failed",
+                               json_object_new_boolean(entry->last_failed));
+        json_object_array_add(tests, jt);
+    }
+    json_object_object_add(root, "tests", tests);
+
+    if (json_object_to_file_ext(path, root, JSON_C_TO_STRING_PLAIN)) {
+        LOG("Unable to save history cache '%s': %s", path,
+            json_util_get_last_err());
+    } else {
+        LOG("Saved history cache '%s'.", path);
+    }
+    json_object_put(root);
+}
+
+test_history_t *test_history_load() {
+    LOG("Loading test history...");
+
+    test_history_t *history = calloc(1, sizeof *history);
+
+    char logs_dir[PATH_MAX];
+    taf_log_get_logs_dir(logs_dir);
+
+    DIR *dir = opendir(logs_dir);
+    if (!dir) {
+        LOG("Unable to open logs directory '%s', history is empty.", logs_dir);
+        return history;
+    }
+
+    raw_log_file_t *files = NULL;
+    size_t files_count = 0;
+    size_t files_cap = 0;
+
+    struct dirent *ent;
+    while ((ent = readdir(dir))) {
+        if (!is_raw_log(ent->d_name)) {
+            continue;
+        }
+        char path[PATH_MAX];
+        snprintf(path, PATH_MAX, "%s/%s", logs_dir, ent->d_name);
+        struct stat sb;
+        if (stat(path, &sb) || !S_ISREG(sb.st_mode)) {
+            continue;
+        }
+        if (files_count == files_cap) {
+            files_cap = files_cap ? files_cap * 2 : 16;
+            files = realloc(files, files_cap * sizeof *files);
+        }
+        files[files_count].path = strdup(path);
+        files[files_count].mtime = sb.st_mtime;
+        files_count++;
+    }
+    closedir(dir);
+
+    qsort(files, files_count, sizeof *files, raw_log_file_cmp);
+
+    size_t recent = files_count;
+    if (recent > TEST_HISTORY_MAX_RUNS) {
+        recent = TEST_HISTORY_MAX_RUNS;
+    }
+    char cache_path[PATH_MAX];
+    snprintf(cache_path, PATH_MAX, "%s/%s", logs_dir, HISTORY_CACHE_FILE);
+    json_object *sources = sources_to_json(files, recent);
+
+    if (cache_load(cache_path, sources, history)) {
+        json_object_put(sources);
+        for (size_t i = 0; i < files_count; i++) {
+            free(files[i].path);
+        }
+        free(files);
+        LOG("Loaded history of %zu tests from cache.", history->count);
+        return history;
+    }
+
+    size_t runs = 0;
+    for (size_t i = 0; i < recent; i++) {
+        LOG("Reading test history from '%s'...", files[i].path);
+        raw_log_t *log = taf_raw_log_from_file(files[i].path);
+        if (!log) {
+            LOG("Unable to parse '%s', skipping.", files[i].path);
+            continue;
+        }
+        history_add_log(history, log);
+        taf_raw_log_free(log);
+        runs++;
+    }
+
+    if (recent > 0) {
+        cache_save(cache_path, sources, history);
+    }
+    json_object_put(sources);
+
+    for (size_t i = 0; i < files_count; i++) {
+        free(files[i].path);
+    }
+    free(files);
+
+    LOG("Loaded history of %zu tests from %zu runs.", history->count, runs);
+
+    return history;
+}
+
+test_history_t *test_history_from_file(const char *path) {
+    LOG("Loading test history from '%s'...", path);
+
+    raw_log_t *log = taf_raw_log_from_file(path);
+    if (!log) {
+        LOG("Unable to parse '%s'.", path);
+        return NULL;
+    }
+    test_history_t *history = calloc(1, sizeof *history);
+    history_add_log(history, log);
+    taf_raw_log_free(log);
+
+    LOG("Loaded history of %zu tests.", history->count);
+    return history;
+}
+
+test_history_entry_t *test_history_find(test_history_t *history,
+                                        const char *name) {
+    if (!history->slots_cap) {
+        return NULL;
+    }
+    size_t mask = history->slots_cap - 1;
+    size_t i = hash_name(name) & mask;
+    while (history->slots[i]) {
+        test_history_entry_t *entry = &history->entries[history->slots[i] - 1];
+        if (!strcmp(entry->name, name)) {
+            return entry;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+void test_history_free(test_history_t *history) {
+    if (!history) {
+        return;
+    }
+    for (size_t i = 0; i < history->count; i++) {
+        free(history->entries[i].name);
+    }
+    free(history->entries);
+    free(history->slots);
+    free(history);
+}
@@ -3,44 +3,79 @@
 #include "cmd_parser.h"
 #include "headless.h"
 #include "internal_logging.h"
+#include "output_log.h"
 #include "project_parser.h"
+#include "raw_log_bin.h"
+#include "taf_state.h"
 #include "taf_test.h"
 #include "taf_tui.h"
 #include "version.h"
 
+#include "util/arena.h"
 #include "util/files.h"
+#include "util/gzip.h"
 #include "util/os.h"
 #include "util/time.h"
 
 #include <json.h>
 #include <string.h>
-
-static test_case_t current = {0};
+#include <sys/stat.h>
 
 static bool no_logs = false;
 static taf_log_level log_level;
 
-static FILE *output_log_file;
-
 static char logs_dir[PATH_MAX];
 static char output_log_file_path[PATH_MAX];
 static char raw_log_file_path[PATH_MAX];
+// Logs directory & time of the run, e.g. "logs/test_run_<time>"
+static char run_path_prefix[PATH_MAX];
 
 static raw_log_t *raw_log = NULL;
-static size_t raw_log_test_output_cap;
-static size_t raw_log_test_teardown_output_cap;
-static size_t raw_log_test_teardown_errors_cap;
-static size_t raw_log_test_failure_cap;
-static int test_index = -1;
-static bool is_teardown = false;
+
+// JSON Lines raw log, records are appended to it during the run
+static FILE *raw_log_stream = NULL;
+
+// Set for the tests written to the raw log during the run, NULL if the raw
+// log is written at the end of the run
+static bool *tests_done = NULL;
+
+// Strings of the outputs of every test, freed at once with the outputs
+static arena_t *test_arenas = NULL;
 
 static bool headless = false;
 
-static json_object *raw_log_test_output_to_json(raw_log_test_output_t *output) {
-    LOG("Converting raw log test output to JSON %s %d %s %d %s %zu...",
-        output->file, output->line, output->date_time, output->level,
-        output->msg, output->msg_len);
-    json_object *output_obj = json_object_new_object();
+static raw_log_format_t raw_log_format = RAW_LOG_FORMAT_JSON;
+
+// Output log & raw log (except binary one) are gzip compressed
+static bool compress_logs = false;
+
+static const char *raw_log_format_str_map[] = {"json", "jsonl", "binary"};
+static const char *raw_log_format_suffix_map[] = {"_raw.json", "_raw.jsonl",
+                                                  "_raw.bin"};
+
+#define RAW_LOG_FORMATS_AMOUNT                                                 \
+    (sizeof raw_log_format_str_map / sizeof *raw_log_format_str_map)
+
+#define RAW_LOG_LATEST_PREFIX "test_run_latest"
+
+raw_log_format_t taf_raw_log_format_from_str(const char *str) {
+    for (size_t i = 0; i < RAW_LOG_FORMATS_AMOUNT; i++) {
+        if (!strcasecmp(str, raw_log_format_str_map[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *taf_raw_log_format_suffix(raw_log_format_t format) {
+    if (format < 0 || (size_t)format >= RAW_LOG_FORMATS_AMOUNT) {
+        return NULL;
+    }
+    return raw_log_format_suffix_map[format];
+}
+
+static void add_output_fields(json_object *output_obj,
+                              raw_log_test_output_t *output) {
     json_object_object_add(output_obj, "file",
                            json_object_new_string(output->file));
     json_object_object_add(output_obj, "line",
@@ -53,11 +88,19 @@ static json_object *raw_log_test_output_to_json(raw_log_test_output_t *output) {
     json_object_object_add(
         output_obj, "msg",
         json_object_new_string_len(output->msg, output->msg_len));
+}
+
+static json_object *raw_log_test_output_to_json(raw_log_test_output_t *output) {
+    LOG("Converting raw log test output to JSON %s %d %s %d %s %zu...",
+        output->file, output->line, output->date_time, output->level,
+        output->msg, output->msg_len);
+    json_object *output_obj = json_object_new_object();
+    add_output_fields(output_obj, output);
     LOG("Successfully converted raw log test output to JSON.");
     return output_obj;
 }
 
-static json_object *raw_log_test_to_json(raw_log_test_t *test) {
+json_object *taf_raw_log_test_to_json(raw_log_test_t *test) {
     LOG("Converting raw log test '%s' to JSON...", test->name);
     json_object *test_obj = json_object_new_object();
     json_object_object_add(test_obj, "name",
@@ -72,6 +115,8 @@ static json_object *raw_log_test_to_json(raw_log_test_t *test) {
     }
     json_object_object_add(test_obj, "status",
                            json_object_new_string(test->status));
+    json_object_object_add(test_obj, "duration_ms",
+                           json_object_new_int64(test->duration_ms));
     if (test->failure_reasons_count != 0) {
         json_object *fail_reasons_arr = json_object_new_array();
         for (size_t i = 0; i < test->failure_reasons_count; i++) {
@@ -110,11 +155,7 @@ static json_object *raw_log_test_to_json(raw_log_test_t *test) {
     return test_obj;
 }
 
-json_object *taf_raw_log_to_json(raw_log_t *log) {
-
-    LOG("Converting raw log object to JSON...");
-
-    json_object *root = json_object_new_object();
+static void add_run_fields(json_object *root, raw_log_t *log) {
     json_object_object_add(root, "project_name",
                            json_object_new_string(log->project_name));
     json_object_object_add(root, "taf_version",
@@ -124,8 +165,10 @@ json_object *taf_raw_log_to_json(raw_log_t *log) {
                            json_object_new_string(log->os_version));
     json_object_object_add(root, "started",
                            json_object_new_string(log->started));
-    json_object_object_add(root, "finished",
-                           json_object_new_string(log->finished));
+    if (log->finished) {
+        json_object_object_add(root, "finished",
+                               json_object_new_string(log->finished));
+    }
     if (log->target) {
         json_object_object_add(root, "target",
                                json_object_new_string(log->target));
@@ -136,10 +179,19 @@ json_object *taf_raw_log_to_json(raw_log_t *log) {
         json_object_array_add(tag_arr, json_object_new_string(log->tags[i]));
     }
     json_object_object_add(root, "tags", tag_arr);
+}
+
+json_object *taf_raw_log_to_json(raw_log_t *log) {
+
+    LOG("Converting raw log object to JSON...");
+
+    json_object *root = json_object_new_object();
+    add_run_fields(root, log);
 
     json_object *tests_arr = json_object_new_array();
     for (size_t i = 0; i < log->tests_count; i++) {
-        json_object_array_add(tests_arr, raw_log_test_to_json(&log->tests[i]));
+        json_object_array_add(tests_arr,
+                              taf_raw_log_test_to_json(&log->tests[i]));
     }
     json_object_object_add(root, "tests", tests_arr);
 
@@ -158,20 +210,114 @@ static inline size_t jarray_len(struct json_object *arr) {
                : 0;
 }
 
-raw_log_t *taf_json_to_raw_log(struct json_object *root) {
-    LOG("Converting JSON object into raw log object...");
+// Copies string `o` into `arena` interning it if `intern` is set, or onto the
+// heap if there is no arena
+static char *jdup_output_string(struct json_object *o, arena_t *arena,
+                                bool intern) {
+    if (!arena) {
+        return jdup_string(o);
+    }
+    if (intern) {
+        return arena_intern(arena, json_object_get_string(o));
+    }
+    return arena_strndup(arena, json_object_get_string(o),
+                         json_object_get_string_len(o));
+}
 
-    if (!root || !json_object_is_type(root, json_type_object)) {
-        LOG("JSON object is either nil or not an object");
-        return NULL;
+static void json_to_raw_log_output(struct json_object *jo,
+                                   raw_log_test_output_t *out,
+                                   arena_t *arena) {
+    struct json_object *jfield;
+    if (json_object_object_get_ex(jo, "file", &jfield))
+        out->file = jdup_output_string(jfield, arena, true);
+    if (json_object_object_get_ex(jo, "date_time", &jfield))
+        out->date_time = jdup_output_string(jfield, arena, true);
+    if (json_object_object_get_ex(jo, "msg", &jfield)) {
+        out->msg = jdup_output_string(jfield, arena, false);
+        out->msg_len = json_object_get_string_len(jfield);
     }
+    if (json_object_object_get_ex(jo, "level", &jfield))
+        out->level = taf_log_level_from_str(json_object_get_string(jfield));
+    if (json_object_object_get_ex(jo, "line", &jfield))
+        out->line = json_object_get_int(jfield);
+}
 
-    raw_log_t *log = calloc(1, sizeof *log);
-    if (!log) {
-        LOG("Cannot allocate raw log object: Out of memory.");
-        return NULL;
+static void json_to_raw_log_outputs(struct json_object *arr,
+                                    raw_log_test_output_t **outputs,
+                                    size_t *count, arena_t *arena) {
+    *count = jarray_len(arr);
+    *outputs = calloc(*count, sizeof **outputs);
+
+    for (size_t k = 0; k < *count; ++k) {
+        json_to_raw_log_output(json_object_array_get_idx(arr, (int)k),
+                               &(*outputs)[k], arena);
     }
+}
+
+// Strings of the outputs are allocated in `arena` if it is set
+static bool json_to_raw_log_test(struct json_object *jt, raw_log_test_t *t,
+                                 arena_t *arena) {
+    if (!jt || !json_object_is_type(jt, json_type_object)) {
+        LOG("JSON test object is either nil or not an object");
+        return false;
+    }
+
+    struct json_object *tmp;
+    if (json_object_object_get_ex(jt, "name", &tmp))
+        t->name = jdup_string(tmp);
+    if (json_object_object_get_ex(jt, "started", &tmp))
+        t->started = jdup_string(tmp);
+    if (json_object_object_get_ex(jt, "finished", &tmp))
+        t->finished = jdup_string(tmp);
+    if (json_object_object_get_ex(jt, "teardown_start", &tmp))
+        t->teardown_start = jdup_string(tmp);
+    if (json_object_object_get_ex(jt, "status", &tmp))
+        t->status = jdup_string(tmp);
+    if (json_object_object_get_ex(jt, "duration_ms", &tmp))
+        t->duration_ms = json_object_get_int64(tmp);
+    if (json_object_object_get_ex(jt, "failure_reasons", &tmp) &&
+        json_object_is_type(tmp, json_type_array)) {
+        json_to_raw_log_outputs(tmp, &t->failure_reasons,
+                                &t->failure_reasons_count, arena);
+    }
+
+    if (json_object_object_get_ex(jt, "tags", &tmp) &&
+        json_object_is_type(tmp, json_type_array)) {
+
+        t->tags_count = jarray_len(tmp);
+        t->tags = calloc(t->tags_count, sizeof *t->tags);
+        for (size_t k = 0; k < t->tags_count; ++k) {
+            struct json_object *jtag = json_object_array_get_idx(tmp, (int)k);
+            t->tags[k] = jdup_string(jtag);
+        }
+    }
+
+    if (json_object_object_get_ex(jt, "output", &tmp) &&
+        json_object_is_type(tmp, json_type_array)) {
+        json_to_raw_log_outputs(tmp, &t->outputs, &t->outputs_count, arena);
+    }
+
+    if (json_object_object_get_ex(jt, "teardown_output", &tmp) &&
+        json_object_is_type(tmp, json_type_array)) {
+        json_to_raw_log_outputs(tmp, &t->teardown_outputs,
+                                &t->teardown_outputs_count, arena);
+    }
+
+    if (json_object_object_get_ex(jt, "teardown_errors", &tmp) &&
+        json_object_is_type(tmp, json_type_array)) {
+        json_to_raw_log_outputs(tmp, &t->teardown_errors,
+                                &t->teardown_errors_count, arena);
+    }
+
+    return true;
+}
+
+bool taf_json_to_raw_log_test(struct json_object *jt, raw_log_test_t *t) {
+    //
+    return json_to_raw_log_test(jt, t, NULL);
+}
 
+static void json_to_raw_log_run(struct json_object *root, raw_log_t *log) {
     struct json_object *o = NULL;
 
     if (json_object_object_get_ex(root, "project_name", &o))
@@ -206,6 +352,164 @@ raw_log_t *taf_json_to_raw_log(struct json_object *root) {
             log->tags[i] = jdup_string(tag);
         }
     }
+}
+
+// State of reading JSON Lines records into `log`
+typedef struct {
+    raw_log_t *log;
+    size_t tests_cap;
+} raw_log_records_t;
+
+static void records_init(raw_log_records_t *records) {
+    records->log = calloc(1, sizeof *records->log);
+    records->tests_cap = 0;
+}
+
+// Appends a zeroed output to `*outputs`, capacity of which is the next
+// power of 2 of `*count`
+static raw_log_test_output_t *append_output(raw_log_test_output_t **outputs,
+                                            size_t *count) {
+    size_t n = *count;
+    if ((n & (n - 1)) == 0) {
+        *outputs = realloc(*outputs, (n ? n * 2 : 1) * sizeof **outputs);
+    }
+    raw_log_test_output_t *out = &(*outputs)[(*count)++];
+    memset(out, 0, sizeof *out);
+    return out;
+}
+
+static inline void replace_string(char **dst, struct json_object *o) {
+    free(*dst);
+    *dst = jdup_string(o);
+}
+
+// Test the record belongs to, NULL if it has no valid index
+static raw_log_test_t *records_get_test(raw_log_records_t *records,
+                                        struct json_object *record) {
+    struct json_object *o;
+    if (!json_object_object_get_ex(record, "index", &o)) {
+        return NULL;
+    }
+    int64_t index = json_object_get_int64(o);
+    if (index < 1 || index > INT32_MAX) {
+        return NULL;
+    }
+
+    raw_log_t *log = records->log;
+    if ((size_t)index > records->tests_cap) {
+        size_t cap = records->tests_cap ? records->tests_cap : 16;
+        while (cap < (size_t)index) {
+            cap *= 2;
+        }
+        log->tests = realloc(log->tests, cap * sizeof *log->tests);
+        memset(log->tests + records->tests_cap, 0,
+               (cap - records->tests_cap) * sizeof *log->tests);
+        records->tests_cap = cap;
+    }
+    // Tests after the last one started were not run, e.g. after a crash
+    if ((size_t)index > log->tests_count) {
+        log->tests_count = index;
+    }
+    return &log->tests[index - 1];
+}
+
+static void records_add(raw_log_records_t *records,
+                        struct json_object *record) {
+    struct json_object *o;
+    if (!json_object_is_type(record, json_type_object) ||
+        !json_object_object_get_ex(record, "type", &o)) {
+        LOG("Raw log record has no type, skipping.");
+        return;
+    }
+    const char *type = json_object_get_string(o);
+
+    if (!strcmp(type, "run_started")) {
+        json_to_raw_log_run(record, records->log);
+        return;
+    }
+    if (!strcmp(type, "run_finished")) {
+        if (json_object_object_get_ex(record, "finished", &o))
+            replace_string(&records->log->finished, o);
+        return;
+    }
+
+    raw_log_test_t *t = records_get_test(records, record);
+    if (!t) {
+        LOG("Raw log record '%s' has no valid test index, skipping.", type);
+        return;
+    }
+
+    raw_log_test_output_t *out = NULL;
+
+    if (!strcmp(type, "test_started")) {
+        if (json_object_object_get_ex(record, "name", &o))
+            replace_string(&t->name, o);
+        if (json_object_object_get_ex(record, "started", &o))
+            replace_string(&t->started, o);
+        if (json_object_object_get_ex(record, "tags", &o) &&
+            json_object_is_type(o, json_type_array) && !t->tags) {
+            t->tags_count = jarray_len(o);
+            t->tags = calloc(t->tags_count, sizeof *t->tags);
+            for (size_t k = 0; k < t->tags_count; ++k) {
+                t->tags[k] = jdup_string(json_object_array_get_idx(o, k));
+            }
+        }
+    } else if (!strcmp(type, "output")) {
+        out = append_output(&t->outputs, &t->outputs_count);
+    } else if (!strcmp(type, "failure_reason")) {
+        out = append_output(&t->failure_reasons, &t->failure_reasons_count);
+    } else if (!strcmp(type, "test_finished")) {
+        if (json_object_object_get_ex(record, "finished", &o))
+            replace_string(&t->finished, o);
+        if (json_object_object_get_ex(record, "status", &o))
+            replace_string(&t->status, o);
+        if (json_object_object_get_ex(record, "duration_ms", &o))
+            t->duration_ms = json_object_get_int64(o);
+    } else if (!strcmp(type, "teardown_started")) {
+        if (json_object_object_get_ex(record, "teardown_start", &o))
+            replace_string(&t->teardown_start, o);
+    } else if (!strcmp(type, "teardown_output")) {
+        out = append_output(&t->teardown_outputs, &t->teardown_outputs_count);
+    } else if (!strcmp(type, "teardown_error")) {
+        out = append_output(&t->teardown_errors, &t->teardown_errors_count);
+    } else {
+        LOG("Unknown raw log record '%s', skipping.", type);
+    }
+
+    if (out) {
+        json_to_raw_log_output(record, out, NULL);
+    }
+}
+
+raw_log_t *taf_json_to_raw_log(struct json_object *root) {
+    LOG("Converting JSON object into raw log object...");
+
+    if (json_object_is_type(root, json_type_array)) {
+        LOG("Reading JSON Lines records...");
+        raw_log_records_t records;
+        records_init(&records);
+        size_t len = jarray_len(root);
+        for (size_t i = 0; i < len; i++) {
+            records_add(&records, json_object_array_get_idx(root, i));
+        }
+        LOG("Successfully read %zu raw log records.", len);
+        return records.log;
+    }
+
+    if (!root || !json_object_is_type(root, json_type_object)) {
+        LOG("JSON object is either nil or not an object");
+        return NULL;
+    }
+
+    raw_log_t *log = calloc(1, sizeof *log);
+    if (!log) {
+        LOG("Cannot allocate raw log object: Out of memory.");
+        return NULL;
+    }
+
+    json_to_raw_log_run(root, log);
+
+    struct json_object *o = NULL;
 
     if (json_object_object_get_ex(root, "tests", &o) &&
         json_object_is_type(o, json_type_array)) {
@@ -215,142 +519,288 @@ raw_log_t *taf_json_to_raw_log(struct json_object *root) {
 
         for (size_t i = 0; i < log->tests_count; ++i) {
             struct json_object *jt = json_object_array_get_idx(o, (int)i);
-            raw_log_test_t *t = &log->tests[i];
-
-            struct json_object *tmp;
-            if (json_object_object_get_ex(jt, "name", &tmp))
-                t->name = jdup_string(tmp);
-            if (json_object_object_get_ex(jt, "started", &tmp))
-                t->started = jdup_string(tmp);
-            if (json_object_object_get_ex(jt, "finished", &tmp))
-                t->finished = jdup_string(tmp);
-            if (json_object_object_get_ex(jt, "teardown_start", &tmp))
-                t->teardown_start = jdup_string(tmp);
-            if (json_object_object_get_ex(jt, "status", &tmp))
-                t->status = jdup_string(tmp);
-            if (json_object_object_get_ex(jt, "failure_reasons", &tmp) &&
-                json_object_is_type(tmp, json_type_array)) {
-
-                t->failure_reasons_count = jarray_len(tmp);
-                t->failure_reasons = calloc(t->failure_reasons_count,
-                                            sizeof *t->failure_reasons);
-                for (size_t k = 0; k < t->failure_reasons_count; ++k) {
-                    struct json_object *jo =
-                        json_object_array_get_idx(tmp, (int)k);
-                    raw_log_test_output_t *out = &t->failure_reasons[k];
-
-                    struct json_object *jfield;
-                    if (json_object_object_get_ex(jo, "file", &jfield))
-                        out->file = jdup_string(jfield);
-                    if (json_object_object_get_ex(jo, "date_time", &jfield))
-                        out->date_time = jdup_string(jfield);
-                    if (json_object_object_get_ex(jo, "msg", &jfield))
-                        out->msg = jdup_string(jfield);
-                    if (json_object_object_get_ex(jo, "level", &jfield))
-                        out->level = taf_log_level_from_str(
-                            json_object_get_string(jfield));
-                    if (json_object_object_get_ex(jo, "line", &jfield))
-                        out->line = json_object_get_int(jfield);
-                }
-            }
+            taf_json_to_raw_log_test(jt, &log->tests[i]);
+        }
+    }
 
-            if (json_object_object_get_ex(jt, "tags", &tmp) &&
-                json_object_is_type(tmp, json_type_array)) {
+    LOG("Successfully converted JSON object into raw log object.");
 
-                t->tags_count = jarray_len(tmp);
-                t->tags = calloc(t->tags_count, sizeof *t->tags);
-                for (size_t k = 0; k < t->tags_count; ++k) {
-                    struct json_object *jtag =
-                        json_object_array_get_idx(tmp, (int)k);
-                    t->tags[k] = jdup_string(jtag);
-                }
-            }
+    return log;
+}
 
-            if (json_object_object_get_ex(jt, "output", &tmp) &&
-                json_object_is_type(tmp, json_type_array)) {
-
-                t->outputs_count = jarray_len(tmp);
-                t->outputs = calloc(t->outputs_count, sizeof *t->outputs);
-
-                for (size_t k = 0; k < t->outputs_count; ++k) {
-                    struct json_object *jo =
-                        json_object_array_get_idx(tmp, (int)k);
-                    raw_log_test_output_t *out = &t->outputs[k];
-
-                    struct json_object *jfield;
-                    if (json_object_object_get_ex(jo, "file", &jfield))
-                        out->file = jdup_string(jfield);
-                    if (json_object_object_get_ex(jo, "date_time", &jfield))
-                        out->date_time = jdup_string(jfield);
-                    if (json_object_object_get_ex(jo, "msg", &jfield))
-                        out->msg = jdup_string(jfield);
-                    if (json_object_object_get_ex(jo, "level", &jfield))
-                        out->level = taf_log_level_from_str(
-                            json_object_get_string(jfield));
-                    if (json_object_object_get_ex(jo, "line", &jfield))
-                        out->line = json_object_get_int(jfield);
-                }
-            }
+// Parses JSON document from `fp`, `start` is its beginning already read
+static json_object *json_from_stream(FILE *fp, const char *start,
+                                     size_t start_len) {
+    json_tokener *tok = json_tokener_new();
+    json_object *obj = json_tokener_parse_ex(tok, start, start_len);
+
+    char buf[64 * 1024];
+    size_t n;
+    while (!obj && json_tokener_get_error(tok) == json_tokener_continue &&
+           (n = fread(buf, 1, sizeof buf, fp)) > 0) {
+        obj = json_tokener_parse_ex(tok, buf, n);
+    }
+    json_tokener_free(tok);
 
-            if (json_object_object_get_ex(jt, "teardown_output", &tmp) &&
-                json_object_is_type(tmp, json_type_array)) {
-
-                t->teardown_outputs_count = jarray_len(tmp);
-                t->teardown_outputs = calloc(t->teardown_outputs_count,
-                                             sizeof *t->teardown_outputs);
-
-                for (size_t k = 0; k < t->teardown_outputs_count; ++k) {
-                    struct json_object *jo =
-                        json_object_array_get_idx(tmp, (int)k);
-                    raw_log_test_output_t *out = &t->teardown_outputs[k];
-
-                    struct json_object *jfield;
-                    if (json_object_object_get_ex(jo, "file", &jfield))
-                        out->file = jdup_string(jfield);
-                    if (json_object_object_get_ex(jo, "date_time", &jfield))
-                        out->date_time = jdup_string(jfield);
-                    if (json_object_object_get_ex(jo, "msg", &jfield))
-                        out->msg = jdup_string(jfield);
-                    if (json_object_object_get_ex(jo, "level", &jfield))
-                        out->level = taf_log_level_from_str(
-                            json_object_get_string(jfield));
-                    if (json_object_object_get_ex(jo, "line", &jfield))
-                        out->line = json_object_get_int(jfield);
-                }
-            }
+    return obj;
+}
 
-            if (json_object_object_get_ex(jt, "teardown_errors", &tmp) &&
-                json_object_is_type(tmp, json_type_array)) {
-
-                t->teardown_errors_count = jarray_len(tmp);
-                t->teardown_errors = calloc(t->teardown_errors_count,
-                                            sizeof *t->teardown_errors);
-
-                for (size_t k = 0; k < t->teardown_errors_count; ++k) {
-                    struct json_object *jo =
-                        json_object_array_get_idx(tmp, (int)k);
-                    raw_log_test_output_t *out = &t->teardown_errors[k];
-
-                    struct json_object *jfield;
-                    if (json_object_object_get_ex(jo, "file", &jfield))
-                        out->file = jdup_string(jfield);
-                    if (json_object_object_get_ex(jo, "date_time", &jfield))
-                        out->date_time = jdup_string(jfield);
-                    if (json_object_object_get_ex(jo, "msg", &jfield))
-                        out->msg = jdup_string(jfield);
-                    if (json_object_object_get_ex(jo, "level", &jfield))
-                        out->level = taf_log_level_from_str(
-                            json_object_get_string(jfield));
-                    if (json_object_object_get_ex(jo, "line", &jfield))
-                        out->line = json_object_get_int(jfield);
-                }
-            }
+raw_log_t *taf_raw_log_from_file(const char *path) {
+    LOG("Reading raw log '%s'...", path);
+
+    raw_log_bin_t *bin = raw_log_bin_open(path);
+    if (bin) {
+        raw_log_t *log = raw_log_bin_to_raw_log(bin);
+        raw_log_bin_close(bin);
+        return log;
+    }
+
+    FILE *fp = gzip_fopen_read(path);
+    if (!fp) {
+        LOG("Unable to open raw log '%s'", path);
+        return NULL;
+    }
+
+    // JSON Lines log starts with a complete record on its first line
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len = getline(&line, &cap, fp);
+    struct json_object *record = len > 0 ? json_tokener_parse(line) : NULL;
+    struct json_object *type;
+    if (!record || !json_object_is_type(record, json_type_object) ||
+        !json_object_object_get_ex(record, "type", &type)) {
+        // Compact document fits on the first line
+        json_object *root = record;
+        if (!root && len > 0) {
+            root = json_from_stream(fp, line, len);
         }
+        free(line);
+        fclose(fp);
+
+        raw_log_t *log = taf_json_to_raw_log(root);
+        json_object_put(root);
+        return log;
     }
 
-    LOG("Successfully converted JSON object into raw log object.");
+    raw_log_records_t records;
+    records_init(&records);
+    size_t count = 0;
+    do {
+        if (record) {
+            records_add(&records, record);
+            json_object_put(record);
+            count++;
+        } else {
+            // Last record of a run which crashed may be cut off
+            LOG("Unable to parse raw log record, skipping.");
+        }
+        len = getline(&line, &cap, fp);
+        record = len > 0 ? json_tokener_parse(line) : NULL;
+    } while (len > 0);
 
-    return log;
+    free(line);
+    fclose(fp);
+
+    LOG("Successfully read %zu raw log records.", count);
+
+    return records.log;
+}
+
+bool taf_raw_log_get_latest(const char *logs_dir, char buf[PATH_MAX]) {
+    bool found = false;
+    time_t latest = 0;
+    // Every format with & without compression
+    for (size_t i = 0; i < RAW_LOG_FORMATS_AMOUNT * 2; i++) {
+        char path[PATH_MAX];
+        snprintf(path, PATH_MAX, "%s/" RAW_LOG_LATEST_PREFIX "%s%s", logs_dir,
+                 raw_log_format_suffix_map[i / 2], i % 2 ? GZIP_SUFFIX : "");
+        struct stat sb;
+        // Symlinks are replaced at the end of every run
+        if (lstat(path, &sb) || (found && sb.st_mtime <= latest)) {
+            continue;
+        }
+        snprintf(buf, PATH_MAX, "%s", path);
+        latest = sb.st_mtime;
+        found = true;
+    }
+    return found;
+}
+
+void taf_log_get_logs_dir(char buf[PATH_MAX]) {
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    project_parsed_t *proj = get_parsed_project();
+
+    if (proj->multitarget) {
+        snprintf(buf, PATH_MAX, "%s/logs/%s", proj->project_path,
+                 opts->target);
+    } else {
+        snprintf(buf, PATH_MAX, "%s/logs", proj->project_path);
+    }
+}
+
+bool taf_log_get_run_file_path(char buf[PATH_MAX], const char *suffix) {
+    if (no_logs || !run_path_prefix[0]) {
+        return false;
+    }
+    snprintf(buf, PATH_MAX, "%s%s", run_path_prefix, suffix);
+    return true;
+}
+
+static json_object *new_record(const char *type, int index) {
+    json_object *record = json_object_new_object();
+    json_object_object_add(record, "type", json_object_new_string(type));
+    if (index > 0) {
+        json_object_object_add(record, "index", json_object_new_int(index));
+    }
+    return record;
+}
+
+// Appends `record` as a line to the JSON Lines raw log & frees it
+static void stream_record(json_object *record) {
+    size_t len;
+    const char *str = json_object_to_json_string_length(
+        record, JSON_C_TO_STRING_PLAIN | JSON_C_TO_STRING_NOSLASHESCAPE, &len);
+    fwrite(str, 1, len, raw_log_stream);
+    fputc('\n', raw_log_stream);
+    // Every record is kept if the process crashes later on, unless the log is
+    // compressed
+    fflush(raw_log_stream);
+    json_object_put(record);
+}
+
+static void stream_output(const char *type, int index,
+                          raw_log_test_output_t *output) {
+    if (!raw_log_stream) {
+        return;
+    }
+    json_object *record = new_record(type, index);
+    add_output_fields(record, output);
+    stream_record(record);
+}
+
+static void stream_test_started(int index, raw_log_test_t *test) {
+    if (!raw_log_stream) {
+        return;
+    }
+    json_object *record = new_record("test_started", index);
+    json_object_object_add(record, "name", json_object_new_string(test->name));
+    json_object_object_add(record, "started",
+                           json_object_new_string(test->started));
+    json_object *tag_arr = json_object_new_array();
+    for (size_t i = 0; i < test->tags_count; i++) {
+        json_object_array_add(tag_arr, json_object_new_string(test->tags[i]));
+    }
+    json_object_object_add(record, "tags", tag_arr);
+    stream_record(record);
+}
+
+static void stream_test_finished(int index, raw_log_test_t *test) {
+    if (!raw_log_stream) {
+        return;
+    }
+    json_object *record = new_record("test_finished", index);
+    json_object_object_add(record, "finished",
+                           json_object_new_string(test->finished));
+    json_object_object_add(record, "status",
+                           json_object_new_string(test->status));
+    json_object_object_add(record, "duration_ms",
+                           json_object_new_int64(test->duration_ms));
+    stream_record(record);
+}
+
+static void stream_teardown_started(int index, raw_log_test_t *test) {
+    if (!raw_log_stream) {
+        return;
+    }
+    json_object *record = new_record("teardown_started", index);
+    json_object_object_add(record, "teardown_start",
+                           json_object_new_string(test->teardown_start));
+    stream_record(record);
+}
+
+// Streams all records of a test which ran without logging, e.g. in a worker
+static void stream_test(int index, raw_log_test_t *test) {
+    if (!raw_log_stream) {
+        return;
+    }
+    stream_test_started(index, test);
+    for (size_t i = 0; i < test->outputs_count; i++) {
+        stream_output("output", index, &test->outputs[i]);
+    }
+    for (size_t i = 0; i < test->failure_reasons_count; i++) {
+        stream_output("failure_reason", index, &test->failure_reasons[i]);
+    }
+    stream_test_finished(index, test);
+
+    if (!test->teardown_start) {
+        return;
+    }
+    stream_teardown_started(index, test);
+    for (size_t i = 0; i < test->teardown_outputs_count; i++) {
+        stream_output("teardown_output", index, &test->teardown_outputs[i]);
+    }
+    for (size_t i = 0; i < test->teardown_errors_count; i++) {
+        stream_output("teardown_error", index, &test->teardown_errors[i]);
+    }
+}
+
+// Frees outputs of `test` with their strings in `arena`
+static void free_outputs(raw_log_test_t *test, arena_t *arena) {
+    free(test->outputs);
+    test->outputs = NULL;
+    test->outputs_count = 0;
+    free(test->failure_reasons);
+    test->failure_reasons = NULL;
+    test->failure_reasons_count = 0;
+    free(test->teardown_outputs);
+    test->teardown_outputs = NULL;
+    test->teardown_outputs_count = 0;
+    free(test->teardown_errors);
+    test->teardown_errors = NULL;
+    test->teardown_errors_count = 0;
+    arena_free(arena);
+}
+
+void taf_log_test_release(int index) {
+    LOG("Releasing outputs of test with index %d...", index);
+
+    // Name, times & status are kept for the summary of the run
+    free_outputs(&raw_log->tests[index - 1], &test_arenas[index - 1]);
+}
+
+// Test with `index` won't change anymore: writes it to the binary raw log &
+// frees its outputs if the raw log is written during the run
+static void test_done(int index) {
+    if (!tests_done || tests_done[index - 1]) {
+        return;
+    }
+    tests_done[index - 1] = true;
+
+    if (raw_log_format == RAW_LOG_FORMAT_BINARY) {
+        raw_log_bin_add_test(index, &raw_log->tests[index - 1]);
+    }
+    taf_log_test_release(index);
+}
+
+static FILE *open_log_file(const char *path) {
+    //
+    return compress_logs ? gzip_fopen_write(path) : fopen(path, "w");
+}
+
+// Writes compact JSON `root` into gzip file `path`
+static int json_to_gzip_file(const char *path, json_object *root) {
+    FILE *fp = gzip_fopen_write(path);
+    if (!fp) {
+        return -1;
+    }
+    size_t len;
+    const char *str = json_object_to_json_string_length(
+        root, JSON_C_TO_STRING_PLAIN | JSON_C_TO_STRING_NOSLASHESCAPE, &len);
+    bool written = fwrite(str, 1, len, fp) == len;
+    if (fclose(fp) || !written) {
+        return -1;
+    }
+    return 0;
 }
 
 void taf_log_tests_create(int amount) {
@@ -364,25 +814,31 @@ void taf_log_tests_create(int amount) {
     }
 
     headless = opts->headless;
-    if (!opts->headless) {
+    if (opts->headless) {
+        // Every run, e.g. with --watch, has its own header, summary & writer
+        taf_headless_init();
+    } else {
         taf_tui_set_test_amount(amount);
     }
 
     log_level = opts->log_level;
     LOG("Log level: %s", taf_log_level_to_str(log_level));
 
+    raw_log_format = opts->raw_log_format;
+    // Binary raw log is read through mmap, only the output log is compressed
+    compress_logs = opts->compress_logs;
+    const char *compress_suffix = compress_logs ? GZIP_SUFFIX : "";
+
+    // Index of a test of the previous run, e.g. with --watch
+    taf_state_get()->log_test_index = -1;
+
     char time_str[TS_LEN];
     get_date_time_now(time_str);
 
     project_parsed_t *proj = get_parsed_project();
 
     if (!no_logs) {
-        if (proj->multitarget) {
-            snprintf(logs_dir, PATH_MAX, "%s/logs/%s", proj->project_path,
-                     opts->target);
-        } else {
-            snprintf(logs_dir, PATH_MAX, "%s/logs", proj->project_path);
-        }
+        taf_log_get_logs_dir(logs_dir);
         LOG("Logs directory path: %s", logs_dir);
         if (!directory_exists(logs_dir)) {
             LOG("Logs directory doesn't exist, creating...");
@@ -393,8 +849,16 @@ void taf_log_tests_create(int amount) {
             }
         }
 
-        int n = snprintf(raw_log_file_path, PATH_MAX, "%s/test_run_%s_raw.json",
-                         logs_dir, time_str);
+        int n = snprintf(run_path_prefix, PATH_MAX, "%s/test_run_%s", logs_dir,
+                         time_str);
+        if (n < 1) {
+            LOG("snprintf error");
+            exit(EXIT_FAILURE);
+        }
+        n = snprintf(raw_log_file_path, PATH_MAX, "%s%s%s", run_path_prefix,
+                     taf_raw_log_format_suffix(raw_log_format),
+                     raw_log_format == RAW_LOG_FORMAT_BINARY ? ""
+                                                             : compress_suffix);
         if (n < 1) {
             LOG("snprintf error");
             exit(EXIT_FAILURE);
@@ -402,25 +866,46 @@ void taf_log_tests_create(int amount) {
 
         LOG("Raw log path: %s", raw_log_file_path);
         n = snprintf(output_log_file_path, PATH_MAX,
-                     "%s/test_run_%s_output.log", logs_dir, time_str);
+                     "%s/test_run_%s_output.log%s", logs_dir, time_str,
+                     compress_suffix);
         if (n < 1) {
             LOG("snprintf error");
             exit(EXIT_FAILURE);
         }
         LOG("Output log path: %s", output_log_file_path);
-        output_log_file = fopen(output_log_file_path, "w");
+        FILE *output_log_file = open_log_file(output_log_file_path);
         if (!output_log_file) {
             LOG("Unable to create output log file.");
             internal_logging_deinit();
             exit(EXIT_FAILURE);
         }
+        output_log_open(output_log_file, opts->output_log_drop);
         LOG("Created output log file.");
+
+        if (raw_log_format == RAW_LOG_FORMAT_JSONL) {
+            raw_log_stream = open_log_file(raw_log_file_path);
+            if (!raw_log_stream) {
+                LOG("Unable to create raw log file.");
+                internal_logging_deinit();
+                exit(EXIT_FAILURE);
+            }
+            LOG("Created JSON Lines raw log file.");
+        } else if (raw_log_format == RAW_LOG_FORMAT_BINARY &&
+                   raw_log_bin_create(raw_log_file_path)) {
+            LOG("Unable to create raw log file.");
+            internal_logging_deinit();
+            exit(EXIT_FAILURE);
+        }
+        if (raw_log_format != RAW_LOG_FORMAT_JSON) {
+            tests_done = calloc(amount ? amount : 1, sizeof *tests_done);
+        }
     }
 
     LOG("Initializing raw log...");
     raw_log = calloc(1, sizeof *raw_log);
     raw_log->project_name = strdup(proj->project_name);
     raw_log->tests = calloc(amount, sizeof(raw_log_test_t));
+    test_arenas = calloc(amount ? amount : 1, sizeof *test_arenas);
     raw_log->tests_count = amount;
     raw_log->tags_count = opts->tags_amount;
     raw_log->tags = opts->tags;
@@ -442,6 +927,12 @@ void taf_log_tests_create(int amount) {
 #endif
     raw_log->os_version = get_os_string();
 
+    if (raw_log_stream) {
+        json_object *record = new_record("run_started", 0);
+        add_run_fields(record, raw_log);
+        stream_record(record);
+    }
+
     LOG("Raw log initialized.");
 
     LOG("Successfully started TAF test logging.");
@@ -455,72 +946,78 @@ void taf_log_test(taf_log_level level, const char *file, int line,
         taf_log_level_to_str(log_level), file, line, (int)buffer_len, buffer,
         buffer_len);
 
+    taf_state_t *state = taf_state_get();
+
     char ts[TS_LEN];
     get_date_time_now(ts);
 
-    if (!headless) {
+    if (!state->log_silent && !headless) {
         taf_tui_log(ts, level, file, line, buffer, buffer_len);
     }
 
-    if (level <= log_level && !no_logs) {
-        LOG("Writing to output log file...");
+    raw_log_test_t *t = &raw_log->tests[state->log_test_index];
 
-        fprintf(output_log_file, "[%s][%s][%s][%s:%d]: ", ts,
-                taf_log_level_to_str(level), current.name, file, line);
+    if (level <= log_level && !no_logs && !state->log_silent) {
+        LOG("Writing to output log file...");
 
-        fwrite(buffer, 1, buffer_len, output_log_file);
-        fputs("\n\n", output_log_file);
+        output_log_message(buffer, buffer_len, "[%s][%s][%s][%s:%d]: ", ts,
+                           taf_log_level_to_str(level), t->name, file, line);
         LOG("Wrote to output log file.");
     }
 
     LOG("Adding raw log test output...");
-    raw_log_test_t *t = &raw_log->tests[test_index];
 
     raw_log_test_output_t *out;
-    if (is_teardown) {
-        if (t->teardown_outputs_count >= raw_log_test_teardown_output_cap) {
-            raw_log_test_teardown_output_cap *= 2;
+    if (state->log_is_teardown) {
+        if (t->teardown_outputs_count >= state->log_teardown_output_cap) {
+            state->log_teardown_output_cap *= 2;
             t->teardown_outputs =
-                realloc(t->teardown_outputs, raw_log_test_teardown_output_cap *
+                realloc(t->teardown_outputs, state->log_teardown_output_cap *
                                                  sizeof *t->teardown_outputs);
         }
 
         out = &t->teardown_outputs[t->teardown_outputs_count++];
     } else {
-        if (t->outputs_count >= raw_log_test_output_cap) {
-            raw_log_test_output_cap *= 2;
+        if (t->outputs_count >= state->log_output_cap) {
+            state->log_output_cap *= 2;
             t->outputs = realloc(t->outputs,
-                                 raw_log_test_output_cap * sizeof *t->outputs);
+                                 state->log_output_cap * sizeof *t->outputs);
         }
 
         out = &t->outputs[t->outputs_count++];
     }
+    arena_t *arena = &test_arenas[state->log_test_index];
     out->level = level;
-    out->msg = strndup(buffer, buffer_len);
+    out->msg = arena_strndup(arena, buffer, buffer_len);
     out->msg_len = buffer_len;
-    out->file = strdup(file);
+    out->file = arena_intern(arena, file);
     out->line = line;
-    out->date_time = strdup(ts);
+    out->date_time = arena_intern(arena, ts);
 
-    if (headless) {
+    if (!state->log_silent && headless) {
         taf_headless_log_test(out);
     }
+    if (!state->log_silent) {
+        stream_output(state->log_is_teardown ? "teardown_output" : "output",
+                      state->log_test_index + 1, out);
+    }
 
     if (level == TAF_LOG_LEVEL_ERROR) {
         LOG("Adding failure reason...");
-        if (t->failure_reasons_count >= raw_log_test_failure_cap) {
-            raw_log_test_failure_cap *= 2;
+        if (t->failure_reasons_count >= state->log_failure_cap) {
+            state->log_failure_cap *= 2;
             t->failure_reasons =
                 realloc(t->failure_reasons,
-                        raw_log_test_failure_cap * sizeof *t->failure_reasons);
+                        state->log_failure_cap * sizeof *t->failure_reasons);
         }
 
+        // Shares the strings of the output record
         raw_log_test_output_t *fail =
             &t->failure_reasons[t->failure_reasons_count++];
         *fail = *out;
-        fail->msg = strndup(buffer, buffer_len);
-        fail->file = strdup(file);
-        fail->date_time = strdup(ts);
+        if (!state->log_silent) {
+            stream_output("failure_reason", state->log_test_index + 1, fail);
+        }
 
         taf_mark_test_failed();
     }
@@ -533,19 +1030,25 @@ void taf_log_test_started(int index, test_case_t test_case) {
     LOG("TAF Logging test '%s' started with index %d...", test_case.name,
         index);
 
-    if (!headless) {
+    taf_state_t *state = taf_state_get();
+
+    if (!state->log_silent && !headless) {
         taf_tui_set_current_test(index, test_case.name);
     }
 
-    test_index = index - 1;
-    current = test_case;
+    if (!state->log_silent && state->log_test_index >= 0 &&
+        state->log_test_index != index - 1) {
+        test_done(state->log_test_index + 1);
+    }
+
+    state->log_test_index = index - 1;
 
     char time_str[TS_LEN];
     get_date_time_now(time_str);
 
-    if (!no_logs) {
-        fprintf(output_log_file, "[%s][%s]: Test %d Started.\n\n", time_str,
-                test_case.name, index);
+    if (!no_logs && !state->log_silent) {
+        output_log_printf("[%s][%s]: Test %d Started.\n\n", time_str,
+                          test_case.name, index);
         LOG("Wrote to output log file");
     }
 
@@ -560,47 +1063,65 @@ void taf_log_test_started(int index, test_case_t test_case) {
     test->tags_count = test_case.tags.amount;
 
     test->name = strdup(test_case.name);
-    raw_log_test_output_cap = 2;
+    state->log_output_cap = 2;
     test->outputs =
-        malloc(sizeof(raw_log_test_output_t) * raw_log_test_output_cap);
+        malloc(sizeof(raw_log_test_output_t) * state->log_output_cap);
     test->outputs_count = 0;
 
-    raw_log_test_failure_cap = 2;
+    state->log_failure_cap = 2;
     test->failure_reasons =
-        malloc(sizeof(*test->failure_reasons) * raw_log_test_failure_cap);
+        malloc(sizeof(*test->failure_reasons) * state->log_failure_cap);
     test->failure_reasons_count = 0;
 
-    if (headless) {
+    if (!state->log_silent && headless) {
         taf_headless_test_started(test);
     }
+    if (!state->log_silent) {
+        stream_test_started(index, test);
+    }
 
     LOG("Successfully TAF logged starting of a test.");
 }
 
+// Lost tests are logged by the parent of the workers, which never started
+// a test
+static unsigned long test_duration_ms(taf_state_t *state) {
+    if (!state->test_start_millis) {
+        return 0;
+    }
+    return millis_monotonic() - state->test_start_millis;
+}
+
 void taf_log_test_passed(int index, test_case_t test_case) {
 
     LOG("TAF logging test '%s' passed at index %d...", test_case.name, index);
 
+    taf_state_t *state = taf_state_get();
+
     char time_str[TS_LEN];
     get_date_time_now(time_str);
 
-    if (!headless) {
-        taf_tui_test_passed(time_str);
+    raw_log_test_t *test = &raw_log->tests[index - 1];
+    test->finished = strdup(time_str);
+    test->status = "passed";
+    test->duration_ms = test_duration_ms(state);
+
+    if (!state->log_silent && !headless) {
+        taf_tui_test_passed(time_str, test->duration_ms);
     }
 
-    if (!no_logs) {
-        fprintf(output_log_file, "[%s][%s]: Test %d Passed.\n\n", time_str,
-                test_case.name, index);
+    if (!no_logs && !state->log_silent) {
+        output_log_printf("[%s][%s]: Test %d Passed.\n\n", time_str,
+                          test_case.name, index);
         LOG("Wrote to output log file");
     }
 
-    raw_log_test_t *test = &raw_log->tests[index - 1];
-    test->finished = strdup(time_str);
-    test->status = "passed";
-
-    if (headless) {
+    if (!state->log_silent && headless) {
         taf_headless_test_passed(test);
     }
+    if (!state->log_silent) {
+        stream_test_finished(index, test);
+    }
 
     LOG("Successfully TAF logged passing of a test.");
 }
@@ -610,43 +1131,55 @@ void taf_log_test_failed(int index, test_case_t test_case, const char *msg,
 
     LOG("TAF logging test '%s' failed at index %d", test_case.name, index);
 
+    taf_state_t *state = taf_state_get();
+
     char time_str[TS_LEN];
     get_date_time_now(time_str);
 
     raw_log_test_t *test = &raw_log->tests[index - 1];
     test->finished = strdup(time_str);
     test->status = "failed";
+    test->duration_ms = test_duration_ms(state);
 
     if (msg && file) {
-        if (test->failure_reasons_count >= raw_log_test_failure_cap) {
-            raw_log_test_failure_cap *= 2;
+        if (test->failure_reasons_count >= state->log_failure_cap) {
+            state->log_failure_cap *= 2;
             test->failure_reasons =
                 realloc(test->failure_reasons, sizeof(*test->failure_reasons) *
-                                                   raw_log_test_failure_cap);
+                                                   state->log_failure_cap);
         }
 
+        arena_t *arena = &test_arenas[index - 1];
         raw_log_test_output_t *fail_reason =
             &test->failure_reasons[test->failure_reasons_count];
-        fail_reason->date_time = strdup(time_str);
-        fail_reason->msg = strdup(msg);
+        fail_reason->date_time = arena_intern(arena, time_str);
+        fail_reason->msg = arena_strdup(arena, msg);
         fail_reason->msg_len = strlen(msg);
         fail_reason->level = TAF_LOG_LEVEL_CRITICAL;
         fail_reason->line = line;
-        fail_reason->file = strdup(file);
+        fail_reason->file = arena_intern(arena, file);
         test->failure_reasons_count++;
+
+        if (!state->log_silent) {
+            stream_output("failure_reason", index, fail_reason);
+        }
+    }
+    if (!state->log_silent) {
+        stream_test_finished(index, test);
     }
 
-    if (!headless) {
-        taf_tui_test_failed(time_str, test->failure_reasons,
+    if (!state->log_silent && !headless) {
+        taf_tui_test_failed(time_str, test->duration_ms,
+                            test->failure_reasons,
                             test->failure_reasons_count);
     }
-    if (headless) {
+    if (!state->log_silent && headless) {
         taf_headless_test_failed(test);
     }
 
-    if (!no_logs) {
-        fprintf(output_log_file, "[%s][%s]: Test %d Failed.\n\n", time_str,
-                test_case.name, index);
+    if (!no_logs && !state->log_silent) {
+        output_log_printf("[%s][%s]: Test %d Failed.\n\n", time_str,
+                          test_case.name, index);
         LOG("Wrote to output log file");
     }
 
@@ -656,32 +1189,37 @@ void taf_log_test_failed(int index, test_case_t test_case, const char *msg,
 void taf_log_defer_queue_started() {
     LOG("TAF logging start of the defer queue...");
 
-    is_teardown = true;
-    raw_log_test_teardown_output_cap = 2;
-    raw_log_test_teardown_errors_cap = 2;
+    taf_state_t *state = taf_state_get();
+
+    state->log_is_teardown = true;
+    state->log_teardown_output_cap = 2;
+    state->log_teardown_errors_cap = 2;
 
     char time[TS_LEN];
     get_date_time_now(time);
 
-    raw_log_test_t *test = &raw_log->tests[test_index];
+    raw_log_test_t *test = &raw_log->tests[state->log_test_index];
     test->teardown_start = strdup(time);
     test->teardown_outputs_count = 0;
     test->teardown_outputs = malloc(sizeof(*test->teardown_outputs) *
-                                    raw_log_test_teardown_output_cap);
+                                    state->log_teardown_output_cap);
     test->teardown_errors_count = 0;
     test->teardown_errors = malloc(sizeof(*test->teardown_errors) *
-                                   raw_log_test_teardown_errors_cap);
+                                   state->log_teardown_errors_cap);
 
-    if (!headless) {
+    if (!state->log_silent && !headless) {
         taf_tui_defer_queue_started(time);
     }
-    if (headless) {
+    if (!state->log_silent && headless) {
         taf_headless_defer_queue_started(test);
     }
+    if (!state->log_silent) {
+        stream_teardown_started(state->log_test_index + 1, test);
+    }
 
-    if (!no_logs) {
-        fprintf(output_log_file, "[%s][%s]: Defer Queue Started.\n\n", time,
-                test->name);
+    if (!no_logs && !state->log_silent) {
+        output_log_printf("[%s][%s]: Defer Queue Started.\n\n", time,
+                          test->name);
         LOG("Wrote to output log file");
     }
 
@@ -691,23 +1229,25 @@ void taf_log_defer_queue_started() {
 void taf_log_defer_queue_finished() {
     LOG("TAF logging finish of the defer queue...");
 
-    is_teardown = false;
+    taf_state_t *state = taf_state_get();
+
+    state->log_is_teardown = false;
 
-    raw_log_test_t *test = &raw_log->tests[test_index];
+    raw_log_test_t *test = &raw_log->tests[state->log_test_index];
 
     char time[TS_LEN];
     get_date_time_now(time);
 
-    if (!headless) {
+    if (!state->log_silent && !headless) {
         taf_tui_defer_queue_finished(time);
     }
-    if (headless) {
+    if (!state->log_silent && headless) {
         taf_headless_defer_queue_finished(test);
     }
 
-    if (!no_logs) {
-        fprintf(output_log_file, "[%s][%s]: Defer Queue Finished.\n\n", time,
-                test->name);
+    if (!no_logs && !state->log_silent) {
+        output_log_printf("[%s][%s]: Defer Queue Finished.\n\n", time,
+                          test->name);
         LOG("Wrote to output log file");
     }
 
@@ -717,46 +1257,207 @@ void taf_log_defer_queue_finished() {
 void taf_log_defer_failed(const char *trace, const char *file, int line) {
     LOG("TAF logging defer failure...");
 
-    raw_log_test_t *test = &raw_log->tests[test_index];
+    taf_state_t *state = taf_state_get();
+
+    raw_log_test_t *test = &raw_log->tests[state->log_test_index];
 
     char time[TS_LEN];
     get_date_time_now(time);
 
-    if (!headless) {
+    if (!state->log_silent && !headless) {
         taf_tui_defer_failed(time, trace, file, line);
     }
 
-    if (!no_logs) {
-        fprintf(output_log_file,
-                "[%s][%s]: Defer failed (%s at %d), traceback: \n%s\n\n", time,
-                test->name, file, line, trace);
+    if (!no_logs && !state->log_silent) {
+        output_log_printf(
+            "[%s][%s]: Defer failed (%s at %d), traceback: \n%s\n\n", time,
+            test->name, file, line, trace);
         LOG("Wrote to output log file");
     }
 
-    if (test->teardown_errors_count >= raw_log_test_teardown_errors_cap) {
-        raw_log_test_teardown_errors_cap *= 2;
+    if (test->teardown_errors_count >= state->log_teardown_errors_cap) {
+        state->log_teardown_errors_cap *= 2;
         test->teardown_errors = realloc(test->teardown_errors,
                                         sizeof(*test->teardown_errors) *
-                                            raw_log_test_teardown_errors_cap);
+                                            state->log_teardown_errors_cap);
     }
 
+    arena_t *arena = &test_arenas[state->log_test_index];
     raw_log_test_output_t *teardown_err =
         &test->teardown_errors[test->teardown_errors_count];
-    teardown_err->date_time = strdup(time);
-    teardown_err->msg = strdup(trace);
+    teardown_err->date_time = arena_intern(arena, time);
+    teardown_err->msg = arena_strdup(arena, trace);
     teardown_err->msg_len = strlen(trace);
     teardown_err->level = TAF_LOG_LEVEL_CRITICAL;
     teardown_err->line = line;
-    teardown_err->file = strdup(file);
+    teardown_err->file = arena_intern(arena, file);
     test->teardown_errors_count++;
 
-    if (headless) {
+    if (!state->log_silent && headless) {
         taf_headless_defer_queue_failed(teardown_err);
     }
+    if (!state->log_silent) {
+        stream_output("teardown_error", state->log_test_index + 1,
+                      teardown_err);
+    }
 
     LOG("Successfully TAF logged defer failure.");
 }
 
+void taf_log_tests_set_silent(bool value) {
+    LOG("Setting silent TAF test logging: %d", value);
+
+    // Silent mode is used by the runners which don't own the UI (worker
+    // processes and threads): everything still goes into the raw log, but
+    // reporting is left to the main runner.
+    taf_state_get()->log_silent = value;
+}
+
+raw_log_test_t *taf_log_get_test(int index) {
+    //
+    return &raw_log->tests[index - 1];
+}
+
+static void report_output(raw_log_test_t *test, raw_log_test_output_t *out) {
+    if (!headless) {
+        taf_tui_log(out->date_time, out->level, out->file, out->line, out->msg,
+                    out->msg_len);
+    }
+
+    if (out->level <= log_level && !no_logs) {
+        output_log_message(out->msg, out->msg_len, "[%s][%s][%s][%s:%d]: ",
+                           out->date_time, taf_log_level_to_str(out->level),
+                           test->name, out->file, out->line);
+    }
+
+    if (headless) {
+        taf_headless_log_test(out);
+    }
+}
+
+static void report_test(int index) {
+    LOG("Reporting test with index %d...", index);
+
+    raw_log_test_t *test = &raw_log->tests[index - 1];
+    bool passed = !strcmp(test->status, "passed");
+
+    if (!headless) {
+        taf_tui_set_current_test(index, test->name);
+    }
+    if (!no_logs) {
+        output_log_printf("[%s][%s]: Test %d Started.\n\n", test->started,
+                          test->name, index);
+    }
+    if (headless) {
+        taf_headless_test_started(test);
+    }
+    stream_test(index, test);
+
+    for (size_t i = 0; i < test->outputs_count; i++) {
+        report_output(test, &test->outputs[i]);
+    }
+
+    if (!headless) {
+        if (passed) {
+            taf_tui_test_passed(test->finished, test->duration_ms);
+        } else {
+            taf_tui_test_failed(test->finished, test->duration_ms,
+                                test->failure_reasons,
+                                test->failure_reasons_count);
+        }
+    }
+    if (!no_logs) {
+        output_log_printf("[%s][%s]: Test %d %s.\n\n", test->finished,
+                          test->name, index, passed ? "Passed" : "Failed");
+    }
+    if (headless) {
+        if (passed) {
+            taf_headless_test_passed(test);
+        } else {
+            taf_headless_test_failed(test);
+        }
+    }
+
+    if (!test->teardown_start) {
+        LOG("Test has no defer queue.");
+        test_done(index);
+        return;
+    }
+
+    if (!headless) {
+        taf_tui_defer_queue_started(test->teardown_start);
+    }
+    if (!no_logs) {
+        output_log_printf("[%s][%s]: Defer Queue Started.\n\n",
+                          test->teardown_start, test->name);
+    }
+    if (headless) {
+        taf_headless_defer_queue_started(test);
+    }
+
+    for (size_t i = 0; i < test->teardown_outputs_count; i++) {
+        report_output(test, &test->teardown_outputs[i]);
+    }
+
+    for (size_t i = 0; i < test->teardown_errors_count; i++) {
+        raw_log_test_output_t *err = &test->teardown_errors[i];
+        if (!headless) {
+            taf_tui_defer_failed(err->date_time, err->msg, err->file,
+                                 err->line);
+        }
+        if (!no_logs) {
+            output_log_printf(
+                "[%s][%s]: Defer failed (%s at %d), traceback: \n%s\n\n",
+                err->date_time, test->name, err->file, err->line, err->msg);
+        }
+        if (headless) {
+            taf_headless_defer_queue_failed(err);
+        }
+    }
+
+    if (!headless) {
+        taf_tui_defer_queue_finished(test->teardown_start);
+    }
+    if (!no_logs) {
+        output_log_printf("[%s][%s]: Defer Queue Finished.\n\n",
+                          test->teardown_start, test->name);
+    }
+    if (headless) {
+        taf_headless_defer_queue_finished(test);
+    }
+
+    test_done(index);
+
+    LOG("Successfully reported test with index %d.", index);
+}
+
+void taf_log_test_report(int index) {
+    //
+    report_test(index);
+}
+
+bool taf_log_test_merge(int index, json_object *obj) {
+    LOG("Merging test at index %d...", index);
+
+    raw_log_test_t test = {0};
+    if (!json_to_raw_log_test(obj, &test, &test_arenas[index - 1])) {
+        return false;
+    }
+
+    raw_log_test_t *dst = &raw_log->tests[index - 1];
+    *dst = test;
+
+    // Status of the tests executed in this process is a static string:
+    char *status = dst->status;
+    dst->status = status && !strcmp(status, "passed") ? "passed" : "failed";
+    free(status);
+
+    taf_log_test_report(index);
+
+    LOG("Successfully merged test at index %d.", index);
+    return true;
+}
+
 static inline void push_string(lua_State *L, const char *key,
                                const char *value) {
     lua_pushstring(L, value);
@@ -801,8 +1502,9 @@ int hooks_context_push(lua_State *L) {
     lua_setfield(L, -2, "test_run"); // context.test_run = test_run
 
     // context.test
-    if (test_index != -1) {
-        raw_log_test_t *t = &raw_log->tests[test_index];
+    taf_state_t *state = taf_state_get();
+    if (state->log_test_index != -1) {
+        raw_log_test_t *t = &raw_log->tests[state->log_test_index];
 
         lua_newtable(L); // [ context, test ]
         push_string(L, "name", t->name);
@@ -875,6 +1577,7 @@ void taf_raw_log_free(raw_log_t *log) {
 
     free(log->project_name);
     free(log->taf_version);
+    free(log->os);
     free(log->os_version);
     free(log->started);
     free(log->finished);
@@ -924,6 +1627,7 @@ void taf_raw_log_free(raw_log_t *log) {
             free(o->date_time);
             free(o->msg);
         }
+        free(t->teardown_errors);
 
         free(t->teardown_start);
     }
@@ -947,14 +1651,40 @@ void taf_log_tests_finalize() {
         taf_headless_finalize();
     }
 
-    if (!no_logs) {
+    if (tests_done) {
+        for (size_t i = 0; i < raw_log->tests_count; i++) {
+            if (raw_log->tests[i].name) {
+                test_done(i + 1);
+            }
+        }
+        free(tests_done);
+        tests_done = NULL;
+    }
+
+    if (raw_log_format == RAW_LOG_FORMAT_BINARY && !no_logs) {
+        LOG("Saving binary raw log file...");
+        if (raw_log_bin_finish(raw_log)) {
+            LOG("Unable to save binary raw log file.");
+        }
+    } else if (raw_log_stream) {
+        json_object *record = new_record("run_finished", 0);
+        json_object_object_add(record, "finished",
+                               json_object_new_string(raw_log->finished));
+        stream_record(record);
+        fclose(raw_log_stream);
+        raw_log_stream = NULL;
+    } else if (!no_logs) {
         json_object *raw_log_root = taf_raw_log_to_json(raw_log);
 
         LOG("Saving raw log file...");
-        if (json_object_to_file_ext(raw_log_file_path, raw_log_root,
-                                    JSON_C_TO_STRING_SPACED |
-                                        JSON_C_TO_STRING_PRETTY |
-                                        JSON_C_TO_STRING_NOSLASHESCAPE) == -1) {
+        if (compress_logs) {
+            if (json_to_gzip_file(raw_log_file_path, raw_log_root)) {
+                LOG("Unable to save compressed raw log file.");
+            }
+        } else if (json_object_to_file_ext(
+                       raw_log_file_path, raw_log_root,
+                       JSON_C_TO_STRING_SPACED | JSON_C_TO_STRING_PRETTY |
+                           JSON_C_TO_STRING_NOSLASHESCAPE) == -1) {
             LOG("Unable to save raw log file: %s", json_util_get_last_err());
         }
         LOG("Freeing JSON object...");
@@ -978,56 +1708,41 @@ void taf_log_tests_finalize() {
         raw_log_test_t *test = &raw_log->tests[i];
         free(test->started);
         free(test->finished);
-        for (size_t j = 0; j < test->failure_reasons_count; j++) {
-            free(test->failure_reasons[j].msg);
-            free(test->failure_reasons[j].date_time);
-            free(test->failure_reasons[j].file);
-        }
-        free(test->failure_reasons);
         free(test->name);
         for (size_t j = 0; j < test->tags_count; j++) {
             free(test->tags[j]);
         }
         free(test->tags);
-        for (size_t j = 0; j < test->outputs_count; j++) {
-            free(test->outputs[j].msg);
-            free(test->outputs[j].date_time);
-            free(test->outputs[j].file);
-        }
-        free(test->outputs);
-        for (size_t j = 0; j < test->teardown_outputs_count; j++) {
-            free(test->teardown_outputs[j].msg);
-            free(test->teardown_outputs[j].date_time);
-            free(test->teardown_outputs[j].file);
-        }
-        free(test->teardown_outputs);
-        for (size_t j = 0; j < test->teardown_errors_count; j++) {
-            free(test->teardown_errors[j].msg);
-            free(test->teardown_errors[j].date_time);
-            free(test->teardown_errors[j].file);
-        }
-        free(test->teardown_errors);
+        free_outputs(test, &test_arenas[i]);
         free(test->teardown_start);
     }
     free(raw_log->tests);
     free(raw_log);
+    free(test_arenas);
+    test_arenas = NULL;
 
     if (!no_logs) {
         LOG("Flushing and closing output log file...");
-        fflush(output_log_file);
-        fclose(output_log_file);
+        output_log_close();
 
         // Create 'latest' symlinks:
+        // Names of the links end like the names of the files
+        const char *log_suffix = compress_logs ? GZIP_SUFFIX : "";
+        const char *raw_suffix = taf_raw_log_format_suffix(raw_log_format);
+        const char *raw_gz_suffix =
+            raw_log_format == RAW_LOG_FORMAT_BINARY ? "" : log_suffix;
+
         char latest_log[PATH_MAX];
-        int n = snprintf(latest_log, PATH_MAX, "%s/test_run_latest_output.log",
-                         logs_dir);
+        int n = snprintf(latest_log, PATH_MAX,
+                         "%s/test_run_latest_output.log%s", logs_dir,
+                         log_suffix);
         if (n < 0) {
             LOG("snprintf error");
             exit(EXIT_FAILURE);
         }
         char latest_raw[PATH_MAX];
-        n = snprintf(latest_raw, PATH_MAX, "%s/test_run_latest_raw.json",
-                     logs_dir);
+        n = snprintf(latest_raw, PATH_MAX, "%s/" RAW_LOG_LATEST_PREFIX "%s%s",
+                     logs_dir, raw_suffix, raw_gz_suffix);
         if (n < 0) {
             LOG("snprintf error");
             exit(EXIT_FAILURE);
@@ -1040,15 +1755,15 @@ void taf_log_tests_finalize() {
         project_parsed_t *proj = get_parsed_project();
         if (proj->multitarget) {
             n = snprintf(latest_log, PATH_MAX,
-                         "%s/logs/test_run_latest_output.log",
-                         proj->project_path);
+                         "%s/logs/test_run_latest_output.log%s",
+                         proj->project_path, log_suffix);
             if (n < 0) {
                 LOG("snprintf error");
                 exit(EXIT_FAILURE);
             }
             n = snprintf(latest_raw, PATH_MAX,
-                         "%s/logs/test_run_latest_raw.json",
-                         proj->project_path);
+                         "%s/logs/" RAW_LOG_LATEST_PREFIX "%s%s",
+                         proj->project_path, raw_suffix, raw_gz_suffix);
             if (n < 0) {
                 LOG("snprintf error");
                 exit(EXIT_FAILURE);
@@ -0,0 +1,89 @@
+#include "test_order.h"
+
+#include "internal_logging.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    size_t index;
+    int group;
+    double duration;
+} order_item_t;
+
+test_order_t test_order_from_str(const char *str) {
+    if (!strcmp(str, "default")) {
+        return TEST_ORDER_DEFAULT;
+    }
+    if (!strcmp(str, "failed-first")) {
+        return TEST_ORDER_FAILED_FIRST;
+    }
+    if (!strcmp(str, "longest-first")) {
+        return TEST_ORDER_LONGEST_FIRST;
+    }
+    return -1;
+}
+
+static int order_item_cmp(const void *a, const void *b) {
+    const order_item_t *ia = a;
+    const order_item_t *ib = b;
+    if (ia->group != ib->group) {
+        return ia->group < ib->group ? -1 : 1;
+    }
+    if (ia->duration != ib->duration) {
+        return ia->duration < ib->duration ? 1 : -1;
+    }
+    // Keep the load order otherwise
+    return ia->index < ib->index ? -1 : ia->index > ib->index;
+}
+
+void test_order_sort(test_history_t *history, test_case_t *tests,
+                     size_t amount, test_order_t test_order, size_t *order) {
+    LOG("Ordering %zu tests...", amount);
+
+    order_item_t *items = malloc(amount * sizeof *items);
+
+    double known_sum = 0;
+    size_t known = 0;
+    for (size_t i = 0; i < amount; i++) {
+        test_history_entry_t *entry = test_history_find(history, tests[i].name);
+        items[i].index = i;
+        items[i].group = 0;
+        items[i].duration = -1;
+        if (!entry) {
+            // Failed last time, then new tests, then the rest
+            items[i].group = test_order == TEST_ORDER_FAILED_FIRST ? 1 : 0;
+            continue;
+        }
+        known_sum += entry->duration;
+        known++;
+        switch (test_order) {
+        case TEST_ORDER_FAILED_FIRST:
+            items[i].group = entry->last_failed ? 0 : 2;
+            break;
+        case TEST_ORDER_LONGEST_FIRST:
+            items[i].duration = entry->duration;
+            break;
+        case TEST_ORDER_DEFAULT:
+            break;
+        }
+    }
+
+    // Tests without history are expected to take the average time
+    for (size_t i = 0; i < amount; i++) {
+        if (test_order == TEST_ORDER_LONGEST_FIRST && items[i].duration < 0) {
+            items[i].duration = known ? known_sum / known : 0;
+        }
+    }
+
+    if (test_order != TEST_ORDER_DEFAULT) {
+        qsort(items, amount, sizeof *items, order_item_cmp);
+    }
+
+    for (size_t i = 0; i < amount; i++) {
+        order[i] = items[i].index;
+    }
+    free(items);
+
+    LOG("Ordered tests using history of %zu/%zu tests.", known, amount);
+}
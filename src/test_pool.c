@@ -0,0 +1,523 @@
+#include "test_pool.h"
+
+#include "internal_logging.h"
+
+#include "taf_state.h"
+#include "test_case.h"
+#include "test_logs.h"
+
+#include "util/files.h"
+
+#include <json.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+typedef enum {
+    POOL_MSG_STARTED = 0,
+    POOL_MSG_FINISHED = 1,
+} pool_msg_kind;
+
+typedef struct {
+    uint32_t kind;
+    uint32_t index;
+    uint32_t len;
+} pool_msg_header_t;
+
+typedef struct {
+    pid_t pid;
+    int fd;
+    long current; // index of the test being run, -1 if none
+} pool_worker_t;
+
+static int send_msg(int fd, pool_msg_kind kind, size_t index,
+                    const char *payload, size_t len) {
+    pool_msg_header_t header = {
+        .kind = kind,
+        .index = index,
+        .len = len,
+    };
+    if (fd_write_full(fd, &header, sizeof header)) {
+        return -1;
+    }
+    if (len != 0 && fd_write_full(fd, payload, len)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Runs tests from the shared queue until it is empty, or just one test if
+// `once` is set
+static void worker_main(lua_State *L, int fd, _Atomic size_t *next,
+                        size_t amount, bool once, test_pool_run_fn run_test) {
+    LOG("Worker %d started.", getpid());
+
+    // Parent is responsible for all the reporting
+    taf_log_tests_set_silent(true);
+    lua_sethook(L, NULL, 0, 0);
+    signal(SIGINT, SIG_DFL);
+
+    for (;;) {
+        size_t i = atomic_fetch_add(next, 1);
+        if (i >= amount) {
+            break;
+        }
+
+        LOG("Worker %d picked test with index %zu", getpid(), i);
+        if (send_msg(fd, POOL_MSG_STARTED, i, NULL, 0)) {
+            LOG("Unable to notify parent: %s", strerror(errno));
+            break;
+        }
+
+        run_test(L, i);
+
+        json_object *obj = taf_raw_log_test_to_json(taf_log_get_test(i + 1));
+        size_t len;
+        const char *str = json_object_to_json_string_length(
+            obj, JSON_C_TO_STRING_PLAIN | JSON_C_TO_STRING_NOSLASHESCAPE,
+            &len);
+        int rc = send_msg(fd, POOL_MSG_FINISHED, i, str, len);
+        json_object_put(obj);
+        // Worker's copy of the outputs is not needed after it was sent
+        taf_log_test_release(i + 1);
+        if (rc) {
+            LOG("Unable to send test result to parent: %s", strerror(errno));
+            break;
+        }
+        if (once) {
+            break;
+        }
+    }
+
+    LOG("Worker %d finished.", getpid());
+    close(fd);
+
+    // Skip atexit handlers & stdio flushing, they belong to the parent
+    _exit(EXIT_SUCCESS);
+}
+
+static bool receive_msg(pool_worker_t *worker, size_t amount, bool *reported,
+                        size_t *passed) {
+    pool_msg_header_t header;
+    ssize_t n = fd_read_full(worker->fd, &header, sizeof header);
+    if (n != sizeof header) {
+        LOG("Worker %d closed its pipe.", worker->pid);
+        return false;
+    }
+    if (header.index >= amount) {
+        LOG("Worker %d sent incorrect test index %u", worker->pid,
+            header.index);
+        return false;
+    }
+
+    if (header.kind == POOL_MSG_STARTED) {
+        worker->current = header.index;
+        return true;
+    }
+
+    char *payload = malloc(header.len + 1);
+    if (!payload) {
+        LOG("Out of memory.");
+        return false;
+    }
+    if (fd_read_full(worker->fd, payload, header.len) != header.len) {
+        LOG("Worker %d closed its pipe in the middle of the message.",
+            worker->pid);
+        free(payload);
+        return false;
+    }
+    payload[header.len] = '\0';
+
+    json_object *obj = json_tokener_parse(payload);
+    free(payload);
+
+    bool merged = taf_log_test_merge(header.index + 1, obj);
+    json_object_put(obj);
+    if (!merged) {
+        LOG("Worker %d sent malformed test result.", worker->pid);
+        return false;
+    }
+    reported[header.index] = true;
+    if (!strcmp(taf_log_get_test(header.index + 1)->status, "passed")) {
+        (*passed)++;
+    }
+    worker->current = -1;
+
+    return true;
+}
+
+static void report_lost_test(size_t index, const char *msg) {
+    test_case_t *tests = test_case_get_all(NULL);
+
+    LOG("Test '%s' was lost: %s", tests[index].name, msg);
+
+    taf_log_test_started(index + 1, tests[index]);
+    taf_log_test_failed(index + 1, tests[index], msg, "(?)", 0);
+}
+
+static void report_lost_process_test(size_t index, int status) {
+    char msg[128];
+    if (WIFSIGNALED(status)) {
+        snprintf(msg, sizeof msg, "Worker process was killed by signal %d",
+                 WTERMSIG(status));
+    } else if (WIFEXITED(status) && WEXITSTATUS(status) != EXIT_SUCCESS) {
+        snprintf(msg, sizeof msg, "Worker process exited with status %d",
+                 WEXITSTATUS(status));
+    } else {
+        snprintf(msg, sizeof msg, "Worker process exited unexpectedly");
+    }
+    report_lost_test(index, msg);
+}
+
+// Forks worker into `worker`, returns false on failure
+static bool spawn_worker(lua_State *L, pool_worker_t *workers, size_t w,
+                         size_t spawned, _Atomic size_t *next, size_t amount,
+                         bool once, test_pool_run_fn run_test) {
+    int pipefd[2];
+    if (pipe(pipefd)) {
+        LOG("Unable to pipe(): %s", strerror(errno));
+        return false;
+    }
+
+    // Don't let children inherit unflushed buffers
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        LOG("Unable to fork(): %s", strerror(errno));
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(pipefd[0]);
+        for (size_t k = 0; k < spawned; k++) {
+            if (k != w && workers[k].fd >= 0) {
+                close(workers[k].fd);
+            }
+        }
+        worker_main(L, pipefd[1], next, amount, once, run_test);
+    }
+
+    close(pipefd[1]);
+    workers[w].pid = pid;
+    workers[w].fd = pipefd[0];
+    workers[w].current = -1;
+    LOG("Spawned worker %d", pid);
+
+    return true;
+}
+
+// Reaps worker whose pipe got closed & reports the test it did not finish
+static void reap_worker(pool_worker_t *worker, bool *reported) {
+    int status = 0;
+    close(worker->fd);
+    worker->fd = -1;
+    waitpid(worker->pid, &status, 0);
+    LOG("Worker %d exited with status %d", worker->pid, status);
+
+    if (worker->current >= 0 && !reported[worker->current]) {
+        report_lost_process_test(worker->current, status);
+        reported[worker->current] = true;
+    }
+    worker->current = -1;
+}
+
+size_t test_pool_run(lua_State *L, size_t jobs, bool isolate,
+                     test_pool_run_fn run_test) {
+    LOG("Starting test pool with %zu jobs, isolated: %d...", jobs, isolate);
+
+    size_t amount;
+    test_case_get_all(&amount);
+    if (jobs > amount) {
+        jobs = amount;
+    }
+
+    _Atomic size_t *next = mmap(NULL, sizeof *next, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (next == MAP_FAILED) {
+        LOG("Unable to mmap shared queue: %s", strerror(errno));
+        fprintf(stderr, "Unable to create shared test queue: %s\n",
+                strerror(errno));
+        internal_logging_deinit();
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(next, 0);
+
+    pool_worker_t *workers = calloc(jobs, sizeof *workers);
+    struct pollfd *fds = calloc(jobs, sizeof *fds);
+    bool *reported = calloc(amount, sizeof *reported);
+
+    size_t spawned = 0;
+    for (size_t w = 0; w < jobs; w++) {
+        if (!spawn_worker(L, workers, w, spawned, next, amount, isolate,
+                          run_test)) {
+            break;
+        }
+        spawned++;
+    }
+
+    if (spawned == 0) {
+        fprintf(stderr, "Unable to spawn any worker processes.\n");
+    }
+
+    size_t passed = 0;
+    size_t active = spawned;
+    while (active > 0) {
+        size_t nfds = 0;
+        for (size_t w = 0; w < spawned; w++) {
+            if (workers[w].fd < 0)
+                continue;
+            fds[nfds].fd = workers[w].fd;
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            nfds++;
+        }
+
+        int rc = poll(fds, nfds, -1);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            LOG("poll() failed: %s", strerror(errno));
+            break;
+        }
+
+        for (size_t k = 0; k < nfds; k++) {
+            if (!(fds[k].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            size_t w = 0;
+            while (workers[w].fd != fds[k].fd) {
+                w++;
+            }
+            if (receive_msg(&workers[w], amount, reported, &passed)) {
+                continue;
+            }
+            reap_worker(&workers[w], reported);
+            active--;
+
+            // Isolated workers run a single test, fork the next one from
+            // the loaded state while there are tests left
+            if (isolate && atomic_load(next) < amount &&
+                spawn_worker(L, workers, w, spawned, next, amount, isolate,
+                             run_test)) {
+                active++;
+            }
+        }
+    }
+
+    for (size_t w = 0; w < spawned; w++) {
+        if (workers[w].fd >= 0) {
+            reap_worker(&workers[w], reported);
+        }
+    }
+
+    // Tests which were never picked up if all the workers died
+    for (size_t i = 0; i < amount; i++) {
+        if (!reported[i]) {
+            report_lost_process_test(i, 0);
+        }
+    }
+
+    munmap((void *)next, sizeof *next);
+    free(reported);
+    free(fds);
+    free(workers);
+
+    LOG("Test pool finished, passed: %zu", passed);
+
+    return passed;
+}
+
+typedef struct thread_pool thread_pool_t;
+
+typedef struct {
+    thread_pool_t *pool;
+    pthread_t thread;
+    bool started;
+} thread_worker_t;
+
+struct thread_pool {
+    test_pool_run_fn run_test;
+    test_pool_state_new_fn state_new;
+    test_pool_state_free_fn state_free;
+
+    test_case_t *tests;
+    size_t amount;
+    _Atomic size_t next;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    // Indices of finished tests waiting to be reported, guarded by `lock`
+    size_t *finished;
+    size_t finished_count;
+    size_t active;
+};
+
+static bool thread_worker_tests_match(thread_pool_t *pool) {
+    size_t amount;
+    test_case_t *tests = test_case_get_all(&amount);
+    if (amount != pool->amount) {
+        LOG("Worker registered %zu tests instead of %zu", amount,
+            pool->amount);
+        return false;
+    }
+    for (size_t i = 0; i < amount; i++) {
+        if (strcmp(tests[i].name, pool->tests[i].name)) {
+            LOG("Worker test #%zu '%s' doesn't match '%s'", i, tests[i].name,
+                pool->tests[i].name);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *thread_worker_main(void *arg) {
+    thread_worker_t *worker = arg;
+    thread_pool_t *pool = worker->pool;
+
+    LOG("Worker thread started.");
+
+    taf_state_t *state = taf_state_new();
+    taf_state_set(state);
+    taf_log_tests_set_silent(true);
+
+    lua_State *L = pool->state_new();
+    if (!L) {
+        LOG("Unable to create Lua state for worker thread.");
+    } else if (!thread_worker_tests_match(pool)) {
+        LOG("Worker thread registered different tests, stopping.");
+    } else {
+        for (;;) {
+            size_t i = atomic_fetch_add(&pool->next, 1);
+            if (i >= pool->amount) {
+                break;
+            }
+
+            LOG("Worker thread picked test with index %zu", i);
+            pool->run_test(L, i);
+
+            pthread_mutex_lock(&pool->lock);
+            pool->finished[pool->finished_count++] = i;
+            pthread_cond_signal(&pool->cond);
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+
+    if (L) {
+        pool->state_free(L);
+    }
+    taf_state_free(state);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->active--;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    LOG("Worker thread finished.");
+
+    return NULL;
+}
+
+size_t test_pool_run_threads(size_t jobs, test_pool_run_fn run_test,
+                             test_pool_state_new_fn state_new,
+                             test_pool_state_free_fn state_free) {
+    LOG("Starting test pool with %zu threads...", jobs);
+
+    thread_pool_t pool = {
+        .run_test = run_test,
+        .state_new = state_new,
+        .state_free = state_free,
+        .active = 0,
+        .finished_count = 0,
+    };
+    pool.tests = test_case_get_all(&pool.amount);
+    atomic_init(&pool.next, 0);
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+
+    if (jobs > pool.amount) {
+        jobs = pool.amount;
+    }
+
+    pool.finished = calloc(pool.amount, sizeof *pool.finished);
+    bool *reported = calloc(pool.amount, sizeof *reported);
+    thread_worker_t *workers = calloc(jobs, sizeof *workers);
+
+    for (size_t w = 0; w < jobs; w++) {
+        workers[w].pool = &pool;
+        pthread_mutex_lock(&pool.lock);
+        pool.active++;
+        pthread_mutex_unlock(&pool.lock);
+        int rc = pthread_create(&workers[w].thread, NULL, thread_worker_main,
+                                &workers[w]);
+        if (rc) {
+            LOG("Unable to create worker thread: %s", strerror(rc));
+            pthread_mutex_lock(&pool.lock);
+            pool.active--;
+            pthread_mutex_unlock(&pool.lock);
+            break;
+        }
+        workers[w].started = true;
+    }
+
+    size_t passed = 0;
+    size_t head = 0;
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (head < pool.finished_count) {
+            size_t i = pool.finished[head++];
+            pthread_mutex_unlock(&pool.lock);
+
+            taf_log_test_report(i + 1);
+            reported[i] = true;
+            if (!strcmp(taf_log_get_test(i + 1)->status, "passed")) {
+                passed++;
+            }
+
+            pthread_mutex_lock(&pool.lock);
+        }
+        if (pool.active == 0) {
+            break;
+        }
+
+        pthread_cond_wait(&pool.cond, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    for (size_t w = 0; w < jobs; w++) {
+        if (workers[w].started) {
+            pthread_join(workers[w].thread, NULL);
+        }
+    }
+
+    // Tests which were never picked up if none of the workers could start
+    for (size_t i = 0; i < pool.amount; i++) {
+        if (!reported[i]) {
+            report_lost_test(i, "Unable to create Lua state for worker thread");
+        }
+    }
+
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.lock);
+    free(workers);
+    free(reported);
+    free(pool.finished);
+
+    LOG("Test pool finished, passed: %zu", passed);
+
+    return passed;
+}
@@ -0,0 +1,238 @@
+#include "test_scheduler.h"
+
+#include "internal_logging.h"
+
+#include "taf_state.h"
+#include "test_case.h"
+#include "test_logs.h"
+#include "test_timeout.h"
+
+#include "util/time.h"
+
+#include <lauxlib.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    lua_State *co; // NULL if slot is free
+    int ref;
+    taf_state_t *state;
+    size_t index;
+
+    // What the task is waiting for
+    unsigned long wake_at; // 0 if no timeout
+    int fd;                // -1 if no fd
+    short events;
+} sched_task_t;
+
+static sched_task_t *current_task = NULL;
+
+bool test_scheduler_can_yield(lua_State *L) {
+    // Nested coroutines created by tests themselves must not yield to the
+    // scheduler, they would yield to the test instead.
+    return current_task && current_task->co == L && lua_isyieldable(L);
+}
+
+int test_scheduler_sleep(lua_State *L, unsigned long ms, lua_KContext ctx,
+                         lua_KFunction k) {
+    // Wake up in time to fail the test once it is past its deadline
+    long left = test_timeout_remaining_ms();
+    if (left >= 0 && (unsigned long)left < ms) {
+        ms = left;
+    }
+    current_task->wake_at = millis_monotonic() + ms;
+    return lua_yieldk(L, 0, ctx, k);
+}
+
+int test_scheduler_wait_fd(lua_State *L, int fd, short events,
+                           long timeout_ms, lua_KContext ctx,
+                           lua_KFunction k) {
+    current_task->fd = fd;
+    current_task->events = events;
+    long left = test_timeout_remaining_ms();
+    if (left >= 0 && (timeout_ms < 0 || left < timeout_ms)) {
+        timeout_ms = left;
+    }
+    if (timeout_ms >= 0) {
+        current_task->wake_at = millis_monotonic() + timeout_ms;
+    }
+    return lua_yieldk(L, 0, ctx, k);
+}
+
+static void task_report_error(sched_task_t *task, const char *msg) {
+    test_case_t *tests = test_case_get_all(NULL);
+
+    LOG("Test '%s' coroutine failed: %s", tests[task->index].name, msg);
+
+    if (!taf_log_get_test(task->index + 1)->started) {
+        taf_log_test_started(task->index + 1, tests[task->index]);
+    }
+    taf_log_test_failed(task->index + 1, tests[task->index], msg, "(?)", 0);
+}
+
+// Returns true if the task has finished
+static bool task_resume(lua_State *L, sched_task_t *task, int nargs) {
+    task->wake_at = 0;
+    task->fd = -1;
+    task->events = 0;
+
+    taf_state_t *prev = taf_state_get();
+    taf_state_set(task->state);
+    current_task = task;
+
+    int nres = 0;
+    int rc = lua_resume(task->co, L, nargs, &nres);
+
+    if (rc == LUA_YIELD) {
+        lua_pop(task->co, nres);
+    } else if (rc != LUA_OK) {
+        const char *msg = lua_tostring(task->co, -1);
+        task_report_error(task, msg ? msg : "(non-string error)");
+    }
+
+    current_task = NULL;
+    taf_state_set(prev);
+
+    return rc != LUA_YIELD;
+}
+
+// Returns true if the task has finished right away
+static bool task_start(lua_State *L, sched_task_t *task, taf_state_t *parent,
+                       size_t index, lua_CFunction test_body) {
+    LOG("Starting coroutine for test with index %zu", index);
+
+    task->index = index;
+    task->state = taf_state_new_shared(parent);
+    task->state->log_silent = true;
+
+    task->co = lua_newthread(L);
+    task->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    // Only the main runner drives the UI
+    lua_sethook(task->co, NULL, 0, 0);
+
+    lua_pushcfunction(task->co, test_body);
+    lua_pushinteger(task->co, index);
+
+    return task_resume(L, task, 1);
+}
+
+// Reports finished task & frees its slot. Returns true if test passed.
+static bool task_finish(lua_State *L, sched_task_t *task) {
+    LOG("Test coroutine with index %zu finished.", task->index);
+
+    taf_log_test_report(task->index + 1);
+    bool passed = !strcmp(taf_log_get_test(task->index + 1)->status, "passed");
+
+    luaL_unref(L, LUA_REGISTRYINDEX, task->ref);
+    taf_state_free(task->state);
+    task->co = NULL;
+    task->state = NULL;
+
+    return passed;
+}
+
+static bool task_ready(sched_task_t *task, short revents, unsigned long now) {
+    if (task->fd < 0 && task->wake_at == 0) {
+        // Plain coroutine.yield() from the test
+        return true;
+    }
+    if (task->fd >= 0 && revents) {
+        return true;
+    }
+    return task->wake_at != 0 && now >= task->wake_at;
+}
+
+size_t test_scheduler_run(lua_State *L, size_t concurrency,
+                          lua_CFunction test_body) {
+    LOG("Starting test scheduler with concurrency %zu...", concurrency);
+
+    taf_state_t *parent = taf_state_get();
+
+    size_t amount;
+    test_case_get_all(&amount);
+    if (concurrency > amount) {
+        concurrency = amount;
+    }
+
+    sched_task_t *tasks = calloc(concurrency, sizeof *tasks);
+    struct pollfd *fds = calloc(concurrency, sizeof *fds);
+    int *task_fds = calloc(concurrency, sizeof *task_fds);
+
+    size_t next = 0;
+    size_t running = 0;
+    size_t passed = 0;
+
+    while (next < amount || running > 0) {
+        for (size_t t = 0; t < concurrency && next < amount; t++) {
+            if (tasks[t].co) {
+                continue;
+            }
+            running++;
+            if (task_start(L, &tasks[t], parent, next++, test_body)) {
+                passed += task_finish(L, &tasks[t]);
+                running--;
+            }
+        }
+        if (running == 0) {
+            continue;
+        }
+
+        unsigned long now = millis_monotonic();
+        long timeout = -1;
+        nfds_t nfds = 0;
+        for (size_t t = 0; t < concurrency; t++) {
+            sched_task_t *task = &tasks[t];
+            task_fds[t] = -1;
+            if (!task->co) {
+                continue;
+            }
+            if (task->fd >= 0) {
+                task_fds[t] = nfds;
+                fds[nfds].fd = task->fd;
+                fds[nfds].events = task->events;
+                fds[nfds].revents = 0;
+                nfds++;
+            }
+            if (task->fd < 0 && task->wake_at == 0) {
+                timeout = 0;
+            } else if (task->wake_at != 0) {
+                long left = task->wake_at > now ? task->wake_at - now : 0;
+                if (timeout < 0 || left < timeout) {
+                    timeout = left;
+                }
+            }
+        }
+
+        if (poll(fds, nfds, timeout) < 0 && errno != EINTR) {
+            LOG("poll() failed: %s", strerror(errno));
+        }
+
+        now = millis_monotonic();
+        for (size_t t = 0; t < concurrency; t++) {
+            sched_task_t *task = &tasks[t];
+            if (!task->co) {
+                continue;
+            }
+            short revents = task_fds[t] >= 0 ? fds[task_fds[t]].revents : 0;
+            if (!task_ready(task, revents, now)) {
+                continue;
+            }
+            if (task_resume(L, task, 0)) {
+                passed += task_finish(L, task);
+                running--;
+            }
+        }
+
+    }
+
+    free(task_fds);
+    free(fds);
+    free(tasks);
+
+    LOG("Test scheduler finished, passed: %zu", passed);
+
+    return passed;
+}
@@ -0,0 +1,105 @@
+#include "test_shard.h"
+
+#include "internal_logging.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Tests shorter than this are considered to take this long, so that a lot of
+// very quick tests don't end up in one shard
+#define SHARD_MIN_DURATION 0.1
+
+typedef struct {
+    size_t index;
+    const char *name;
+    double duration;
+} shard_item_t;
+
+static uint32_t fnv1a(const char *str) {
+    uint32_t hash = 2166136261u;
+    for (; *str; str++) {
+        hash ^= (unsigned char)*str;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int shard_item_cmp(const void *a, const void *b) {
+    const shard_item_t *ia = a;
+    const shard_item_t *ib = b;
+    // Longest first, ties are broken by name to keep the result stable
+    // between machines
+    if (ia->duration != ib->duration) {
+        return ia->duration < ib->duration ? 1 : -1;
+    }
+    return strcmp(ia->name, ib->name);
+}
+
+static void select_by_hash(test_case_t *tests, size_t amount, size_t index,
+                           size_t count, bool *keep) {
+    LOG("No shard history given, sharding by test name hash.");
+    for (size_t i = 0; i < amount; i++) {
+        keep[i] = fnv1a(tests[i].name) % count == index - 1;
+    }
+}
+
+void test_shard_select(test_history_t *history, test_case_t *tests,
+                       size_t amount, size_t index, size_t count, bool *keep) {
+    LOG("Selecting tests for shard %zu/%zu...", index, count);
+
+    if (!history || history->count == 0) {
+        select_by_hash(tests, amount, index, count, keep);
+        return;
+    }
+
+    shard_item_t *items = malloc(amount * sizeof *items);
+
+    // Tests without history are expected to take the average time
+    double known_sum = 0;
+    size_t known = 0;
+    for (size_t i = 0; i < amount; i++) {
+        test_history_entry_t *entry = test_history_find(history, tests[i].name);
+        items[i].index = i;
+        items[i].name = tests[i].name;
+        items[i].duration = -1;
+        if (entry) {
+            items[i].duration = entry->duration < SHARD_MIN_DURATION
+                                    ? SHARD_MIN_DURATION
+                                    : entry->duration;
+            known_sum += items[i].duration;
+            known++;
+        }
+    }
+    if (known == 0) {
+        free(items);
+        select_by_hash(tests, amount, index, count, keep);
+        return;
+    }
+    double average = known_sum / known;
+    for (size_t i = 0; i < amount; i++) {
+        if (items[i].duration < 0) {
+            items[i].duration = average;
+        }
+    }
+
+    // Longest processing time first: every test goes to the least loaded shard
+    qsort(items, amount, sizeof *items, shard_item_cmp);
+    double *loads = calloc(count, sizeof *loads);
+    for (size_t i = 0; i < amount; i++) {
+        size_t shard = 0;
+        for (size_t j = 1; j < count; j++) {
+            if (loads[j] < loads[shard]) {
+                shard = j;
+            }
+        }
+        loads[shard] += items[i].duration;
+        keep[items[i].index] = shard == index - 1;
+    }
+
+    LOG("Expected shard %zu/%zu duration: %.1fs (%zu/%zu tests with history)",
+        index, count, loads[index - 1], known, amount);
+
+    free(loads);
+    free(items);
+}
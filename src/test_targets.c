@@ -0,0 +1,275 @@
+#include "test_targets.h"
+
+#include "internal_logging.h"
+
+#include "cmd_parser.h"
+#include "project_parser.h"
+#include "version.h"
+
+#include "util/files.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TARGET_READ_CHUNK 4096
+
+typedef struct {
+    const char *name;
+    pid_t pid;
+    int out_fd;
+    int result_fd;
+
+    // Output which doesn't end with a newline yet
+    char *pending;
+    size_t pending_len;
+
+    test_run_result_t result;
+    bool has_result;
+    int status;
+} target_worker_t;
+
+static inline void print_delim(FILE *out) { fputs("-----------\n", out); }
+
+static void print_target_line(target_worker_t *worker, const char *line,
+                              size_t len) {
+    printf("[%s] %.*s\n", worker->name, (int)len, line);
+}
+
+static void target_output(target_worker_t *worker, const char *buf,
+                          size_t len) {
+    worker->pending = realloc(worker->pending, worker->pending_len + len);
+    memcpy(worker->pending + worker->pending_len, buf, len);
+    worker->pending_len += len;
+
+    size_t start = 0;
+    for (size_t i = 0; i < worker->pending_len; i++) {
+        if (worker->pending[i] == '\n') {
+            print_target_line(worker, worker->pending + start, i - start);
+            start = i + 1;
+        }
+    }
+    worker->pending_len -= start;
+    memmove(worker->pending, worker->pending + start, worker->pending_len);
+    fflush(stdout);
+}
+
+static void target_child(target_worker_t *worker, int out_fd, int result_fd,
+                         test_targets_run_fn run_target) {
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(out_fd, STDERR_FILENO);
+    close(out_fd);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    // TUI can't be shared between targets
+    cmd_test_options *opts = cmd_parser_get_test_options();
+    opts->target = (char *)worker->name;
+    opts->headless = true;
+    opts->targets = NULL;
+    opts->targets_amount = 0;
+
+    test_run_result_t result = {0};
+    int exitcode = run_target(&result);
+
+    fflush(stdout);
+    fflush(stderr);
+    fd_write_full(result_fd, &result, sizeof result);
+    close(result_fd);
+
+    _exit(exitcode);
+}
+
+static void print_summary(target_worker_t *workers, size_t amount) {
+    size_t total = 0;
+    size_t passed = 0;
+    size_t targets_passed = 0;
+
+    puts("\nTAF Targets Run Finished.\n");
+    for (size_t i = 0; i < amount; i++) {
+        target_worker_t *worker = &workers[i];
+        bool ok = WIFEXITED(worker->status) &&
+                  WEXITSTATUS(worker->status) == EXIT_SUCCESS;
+        if (ok) {
+            targets_passed++;
+        }
+        if (!worker->has_result) {
+            if (WIFSIGNALED(worker->status)) {
+                printf("Target '%s': FAILED (killed by signal %d)\n",
+                       worker->name, WTERMSIG(worker->status));
+            } else {
+                printf("Target '%s': FAILED (no tests were run)\n",
+                       worker->name);
+            }
+            continue;
+        }
+        total += worker->result.total;
+        passed += worker->result.passed;
+        printf("Target '%s': %s, Total: %zu, Passed: %zu, Failed: %zu\n",
+               worker->name, ok ? "PASSED" : "FAILED", worker->result.total,
+               worker->result.passed,
+               worker->result.total - worker->result.passed);
+    }
+    print_delim(stdout);
+    printf("Targets: %zu, Passed: %zu, Failed: %zu\n", amount, targets_passed,
+           amount - targets_passed);
+    printf("Total: %zu, Passed: %zu, Failed: %zu\n", total, passed,
+           total - passed);
+}
+
+int test_targets_run(char **targets, size_t amount,
+                     test_targets_run_fn run_target) {
+    LOG("Running %zu targets in parallel...", amount);
+
+    project_parsed_t *proj = get_parsed_project();
+
+    printf("TAF v" TAF_VERSION " started (targets mode).\n");
+    printf("Starting project '%s'.\n", proj->project_name);
+    printf("Test targets selected: '%s'", targets[0]);
+    for (size_t i = 1; i < amount; i++) {
+        printf(", '%s'", targets[i]);
+    }
+    printf("\n");
+    print_delim(stdout);
+
+    // Don't let children inherit unflushed buffers
+    fflush(stdout);
+    fflush(stderr);
+
+    target_worker_t *workers = calloc(amount, sizeof *workers);
+    struct pollfd *fds = calloc(amount, sizeof *fds);
+
+    size_t spawned = 0;
+    for (size_t i = 0; i < amount; i++) {
+        target_worker_t *worker = &workers[spawned];
+        worker->name = targets[i];
+
+        int out_pipe[2];
+        int result_pipe[2];
+        if (pipe(out_pipe)) {
+            LOG("Unable to pipe(): %s", strerror(errno));
+            break;
+        }
+        if (pipe(result_pipe)) {
+            LOG("Unable to pipe(): %s", strerror(errno));
+            close(out_pipe[0]);
+            close(out_pipe[1]);
+            break;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            LOG("Unable to fork(): %s", strerror(errno));
+            close(out_pipe[0]);
+            close(out_pipe[1]);
+            close(result_pipe[0]);
+            close(result_pipe[1]);
+            break;
+        }
+        if (pid == 0) {
+            close(out_pipe[0]);
+            close(result_pipe[0]);
+            for (size_t k = 0; k < spawned; k++) {
+                close(workers[k].out_fd);
+                close(workers[k].result_fd);
+            }
+            target_child(worker, out_pipe[1], result_pipe[1], run_target);
+        }
+
+        close(out_pipe[1]);
+        close(result_pipe[1]);
+        worker->pid = pid;
+        worker->out_fd = out_pipe[0];
+        worker->result_fd = result_pipe[0];
+        spawned++;
+        LOG("Spawned process %d for target '%s'", pid, worker->name);
+    }
+
+    if (spawned != amount) {
+        fprintf(stderr, "Unable to start all the targets: %s\n",
+                strerror(errno));
+    }
+
+    size_t active = spawned;
+    while (active > 0) {
+        size_t nfds = 0;
+        for (size_t i = 0; i < spawned; i++) {
+            if (workers[i].out_fd < 0)
+                continue;
+            fds[nfds].fd = workers[i].out_fd;
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            nfds++;
+        }
+
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            LOG("poll() failed: %s", strerror(errno));
+            break;
+        }
+
+        for (size_t k = 0; k < nfds; k++) {
+            if (!(fds[k].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            target_worker_t *worker = NULL;
+            for (size_t i = 0; i < spawned; i++) {
+                if (workers[i].out_fd == fds[k].fd) {
+                    worker = &workers[i];
+                    break;
+                }
+            }
+
+            char buf[TARGET_READ_CHUNK];
+            ssize_t n = read(worker->out_fd, buf, sizeof buf);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n > 0) {
+                target_output(worker, buf, n);
+                continue;
+            }
+
+            LOG("Target '%s' closed its output.", worker->name);
+            if (worker->pending_len != 0) {
+                print_target_line(worker, worker->pending,
+                                  worker->pending_len);
+            }
+            close(worker->out_fd);
+            worker->out_fd = -1;
+            active--;
+        }
+    }
+
+    int exitcode = spawned == amount ? EXIT_SUCCESS : EXIT_FAILURE;
+    for (size_t i = 0; i < spawned; i++) {
+        target_worker_t *worker = &workers[i];
+        if (worker->out_fd >= 0) {
+            close(worker->out_fd);
+        }
+        worker->has_result =
+            fd_read_full(worker->result_fd, &worker->result,
+                         sizeof worker->result) == sizeof worker->result;
+        close(worker->result_fd);
+        waitpid(worker->pid, &worker->status, 0);
+        LOG("Target '%s' exited with status %d", worker->name,
+            worker->status);
+        if (!WIFEXITED(worker->status) ||
+            WEXITSTATUS(worker->status) != EXIT_SUCCESS) {
+            exitcode = EXIT_FAILURE;
+        }
+    }
+
+    print_summary(workers, spawned);
+
+    for (size_t i = 0; i < spawned; i++) {
+        free(workers[i].pending);
+    }
+    free(fds);
+    free(workers);
+
+    return exitcode;
+}
@@ -0,0 +1,267 @@
+#include "test_timeout.h"
+
+#include "internal_logging.h"
+
+#include "taf_state.h"
+
+#include "util/time.h"
+
+#include <lauxlib.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Amount of VM instructions between deadline checks
+#define TEST_TIMEOUT_HOOK_COUNT 1000
+
+// Blocking calls may be restarted, so the thread is signalled again until
+// the test gets disarmed
+#define WATCHDOG_KICK_INTERVAL_MS 250
+
+#define WATCHDOG_SIGNAL SIGUSR1
+
+typedef struct {
+    taf_state_t *state;
+    pthread_t thread;
+    unsigned long next_kick;
+} watchdog_slot_t;
+
+static pthread_once_t watchdog_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t watchdog_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watchdog_cond;
+
+static watchdog_slot_t *slots = NULL;
+static size_t slots_len = 0;
+static size_t slots_cap = 0;
+
+static bool watchdog_running = false;
+
+static void watchdog_signal_handler(int) {
+    // Only there to interrupt blocking system calls with EINTR
+}
+
+static void watchdog_atfork_child() {
+    // Watchdog thread does not exist in the child
+    pthread_mutex_init(&watchdog_mutex, NULL);
+    watchdog_running = false;
+    slots_len = 0;
+}
+
+static void watchdog_init() {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&watchdog_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    // No SA_RESTART, blocking calls should fail instead of being restarted
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = watchdog_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(WATCHDOG_SIGNAL, &sa, NULL);
+
+    pthread_atfork(NULL, NULL, watchdog_atfork_child);
+}
+
+static void *watchdog_main(void *) {
+    LOG("Test timeout watchdog started.");
+
+    pthread_mutex_lock(&watchdog_mutex);
+    for (;;) {
+        unsigned long now = millis_monotonic();
+        unsigned long wake_at = 0;
+
+        for (size_t i = 0; i < slots_len; i++) {
+            watchdog_slot_t *slot = &slots[i];
+            if (now >= slot->next_kick) {
+                LOG("Interrupting thread running timed out test...");
+                pthread_kill(slot->thread, WATCHDOG_SIGNAL);
+                slot->next_kick = now + WATCHDOG_KICK_INTERVAL_MS;
+            }
+            if (wake_at == 0 || slot->next_kick < wake_at) {
+                wake_at = slot->next_kick;
+            }
+        }
+
+        if (wake_at == 0) {
+            pthread_cond_wait(&watchdog_cond, &watchdog_mutex);
+            continue;
+        }
+
+        struct timespec ts = {
+            .tv_sec = wake_at / 1000,
+            .tv_nsec = (wake_at % 1000) * 1000000L,
+        };
+        pthread_cond_timedwait(&watchdog_cond, &watchdog_mutex, &ts);
+    }
+
+    return NULL;
+}
+
+static void watchdog_add(taf_state_t *state) {
+    pthread_once(&watchdog_once, watchdog_init);
+
+    pthread_mutex_lock(&watchdog_mutex);
+
+    if (!watchdog_running) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, watchdog_main, NULL)) {
+            LOG("Unable to start test timeout watchdog: %s", strerror(errno));
+            pthread_mutex_unlock(&watchdog_mutex);
+            return;
+        }
+        pthread_detach(thread);
+        watchdog_running = true;
+    }
+
+    if (slots_len == slots_cap) {
+        slots_cap = slots_cap ? slots_cap * 2 : 4;
+        slots = realloc(slots, slots_cap * sizeof *slots);
+        if (!slots) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    slots[slots_len++] = (watchdog_slot_t){
+        .state = state,
+        .thread = pthread_self(),
+        .next_kick = state->test_deadline_millis,
+    };
+
+    pthread_cond_signal(&watchdog_cond);
+    pthread_mutex_unlock(&watchdog_mutex);
+}
+
+static void watchdog_remove(taf_state_t *state) {
+    pthread_mutex_lock(&watchdog_mutex);
+    for (size_t i = 0; i < slots_len; i++) {
+        if (slots[i].state == state) {
+            slots[i] = slots[--slots_len];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&watchdog_mutex);
+}
+
+static bool deadline_passed(taf_state_t *state) {
+    return state && state->test_deadline_millis != 0 &&
+           millis_monotonic() >= state->test_deadline_millis;
+}
+
+// Raises timeout error pointing at function at `level`
+static void raise_timeout(lua_State *L, taf_state_t *state, int level) {
+    state->test_timed_out = true;
+    LOG("Test timed out after %lu ms", state->test_timeout_ms);
+
+    luaL_where(L, level);
+    lua_pushfstring(L, "Test timed out after %I ms",
+                    (lua_Integer)state->test_timeout_ms);
+    lua_concat(L, 2);
+    lua_error(L);
+}
+
+static void timeout_hook(lua_State *L, lua_Debug *ar) {
+    taf_state_t *state = taf_state_get();
+    if (!state) {
+        return;
+    }
+
+    if (ar->event == LUA_HOOKCOUNT) {
+        if (deadline_passed(state)) {
+            // Level 0 is the running function itself inside a hook
+            raise_timeout(L, state, 0);
+        }
+        if (!(state->test_prev_hook_mask & LUA_MASKCOUNT)) {
+            return;
+        }
+    }
+
+    if (state->test_prev_hook) {
+        state->test_prev_hook(L, ar);
+    }
+}
+
+void test_timeout_arm(lua_State *L, unsigned long ms) {
+    taf_state_t *state = taf_state_get();
+
+    state->test_timeout_ms = ms;
+    state->test_deadline_millis = 0;
+    state->test_timed_out = false;
+    if (ms == 0) {
+        return;
+    }
+
+    LOG("Arming test timeout of %lu ms...", ms);
+    state->test_deadline_millis = millis_monotonic() + ms;
+
+    state->test_prev_hook = lua_gethook(L);
+    state->test_prev_hook_mask = lua_gethookmask(L);
+    state->test_prev_hook_count = lua_gethookcount(L);
+    lua_sethook(L, timeout_hook, state->test_prev_hook_mask | LUA_MASKCOUNT,
+                TEST_TIMEOUT_HOOK_COUNT);
+
+    watchdog_add(state);
+}
+
+bool test_timeout_disarm(lua_State *L) {
+    taf_state_t *state = taf_state_get();
+    if (state->test_timeout_ms == 0) {
+        return false;
+    }
+
+    LOG("Disarming test timeout...");
+    watchdog_remove(state);
+
+    // Test could have finished inside a blocking call past the deadline
+    if (deadline_passed(state)) {
+        state->test_timed_out = true;
+    }
+
+    lua_sethook(L, state->test_prev_hook, state->test_prev_hook_mask,
+                state->test_prev_hook_count);
+    state->test_prev_hook = NULL;
+    state->test_deadline_millis = 0;
+    state->test_timeout_ms = 0;
+
+    return state->test_timed_out;
+}
+
+void test_timeout_check(lua_State *L) {
+    taf_state_t *state = taf_state_get();
+    if (deadline_passed(state)) {
+        raise_timeout(L, state, 1);
+    }
+}
+
+long test_timeout_remaining_ms() {
+    taf_state_t *state = taf_state_get();
+    if (!state || state->test_deadline_millis == 0) {
+        return -1;
+    }
+
+    unsigned long now = millis_monotonic();
+    if (now >= state->test_deadline_millis) {
+        return 0;
+    }
+    return (long)(state->test_deadline_millis - now);
+}
+
+int test_timeout_clamp(int timeout_ms) {
+    long left = test_timeout_remaining_ms();
+    if (left < 0) {
+        return timeout_ms;
+    }
+    if (left == 0) {
+        left = 1;
+    }
+    if (timeout_ms <= 0 || timeout_ms > left) {
+        return (int)left;
+    }
+    return timeout_ms;
+}
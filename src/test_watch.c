@@ -0,0 +1,195 @@
+#include "test_watch.h"
+
+#include "internal_logging.h"
+
+#include <stdlib.h>
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Editors often write a file in several steps, changes are collected until
+// nothing happens for this long
+#define WATCH_DEBOUNCE_MS 100
+
+#define WATCH_EVENTS                                                           \
+    (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE)
+
+typedef struct {
+    int wd;
+    char *path;
+} watch_dir_t;
+
+struct test_watch {
+    int fd;
+    watch_dir_t *dirs;
+    size_t dirs_count;
+};
+
+test_watch_t *test_watch_new() {
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd == -1) {
+        LOG("inotify_init1 failed: %s", strerror(errno));
+        return NULL;
+    }
+    test_watch_t *watch = calloc(1, sizeof *watch);
+    watch->fd = fd;
+    return watch;
+}
+
+static const char *watch_dir_path(test_watch_t *watch, int wd) {
+    for (size_t i = 0; i < watch->dirs_count; i++) {
+        if (watch->dirs[i].wd == wd) {
+            return watch->dirs[i].path;
+        }
+    }
+    return NULL;
+}
+
+int test_watch_add(test_watch_t *watch, const char *dir) {
+    int wd = inotify_add_watch(watch->fd, dir, WATCH_EVENTS | IN_ONLYDIR);
+    if (wd == -1) {
+        LOG("Unable to watch '%s': %s", dir, strerror(errno));
+        return -1;
+    }
+    if (!watch_dir_path(watch, wd)) {
+        LOG("Watching '%s'...", dir);
+        watch->dirs =
+            realloc(watch->dirs, (watch->dirs_count + 1) * sizeof *watch->dirs);
+        watch->dirs[watch->dirs_count].wd = wd;
+        watch->dirs[watch->dirs_count].path = strdup(dir);
+        watch->dirs_count++;
+    }
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        return 0;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(d))) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        char path[PATH_MAX];
+        snprintf(path, PATH_MAX, "%s/%s", dir, ent->d_name);
+        struct stat st;
+        if (!stat(path, &st) && S_ISDIR(st.st_mode)) {
+            test_watch_add(watch, path);
+        }
+    }
+    closedir(d);
+
+    return 0;
+}
+
+static void add_changed(str_array_t *changed, const char *path) {
+    for (size_t i = 0; i < changed->count; i++) {
+        if (!strcmp(changed->items[i], path)) {
+            return;
+        }
+    }
+    str_array_push(changed, path);
+}
+
+static int read_events(test_watch_t *watch, str_array_t *changed) {
+    char buf[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len = read(watch->fd, buf, sizeof buf);
+    if (len <= 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (char *p = buf; p < buf + len;) {
+        struct inotify_event *event = (struct inotify_event *)p;
+        p += sizeof *event + event->len;
+
+        const char *dir = watch_dir_path(watch, event->wd);
+        if (!dir || event->len == 0 || event->name[0] == '.') {
+            continue;
+        }
+        char path[PATH_MAX];
+        snprintf(path, PATH_MAX, "%s/%s", dir, event->name);
+
+        if (event->mask & IN_ISDIR) {
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                test_watch_add(watch, path);
+            }
+            continue;
+        }
+        const char *dot = strrchr(event->name, '.');
+        if (!dot || strcmp(dot, ".lua")) {
+            continue;
+        }
+        // Files being written are reported on close
+        if (event->mask & IN_CREATE) {
+            continue;
+        }
+        LOG("File '%s' changed (mask 0x%x).", path, event->mask);
+        add_changed(changed, path);
+    }
+    return 0;
+}
+
+str_array_t test_watch_wait(test_watch_t *watch) {
+    str_array_t changed = {NULL, 0};
+
+    struct pollfd pfd = {.fd = watch->fd, .events = POLLIN};
+    while (true) {
+        int timeout = changed.count ? WATCH_DEBOUNCE_MS : -1;
+        int rc = poll(&pfd, 1, timeout);
+        if (rc == -1 && errno == EINTR) {
+            continue;
+        }
+        if (rc == -1) {
+            LOG("poll failed: %s", strerror(errno));
+            break;
+        }
+        if (rc == 0) {
+            break; /* quiet long enough */
+        }
+        if (read_events(watch, &changed)) {
+            LOG("Reading inotify events failed: %s", strerror(errno));
+            break;
+        }
+    }
+
+    return changed;
+}
+
+void test_watch_free(test_watch_t *watch) {
+    if (!watch) {
+        return;
+    }
+    close(watch->fd);
+    for (size_t i = 0; i < watch->dirs_count; i++) {
+        free(watch->dirs[i].path);
+    }
+    free(watch->dirs);
+    free(watch);
+}
+
+#else // __linux__
+
+test_watch_t *test_watch_new() {
+    LOG("Watching files is not supported on this platform.");
+    return NULL;
+}
+
+int test_watch_add(test_watch_t *, const char *) { return -1; }
+
+str_array_t test_watch_wait(test_watch_t *) {
+    str_array_t changed = {NULL, 0};
+    return changed;
+}
+
+void test_watch_free(test_watch_t *) {}
+
+#endif // __linux__
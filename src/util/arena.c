@@ -0,0 +1,157 @@
+#include "util/arena.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_CHUNK_MIN (4 * 1024)
+#define ARENA_CHUNK_MAX (1024 * 1024)
+
+#define ARENA_ALIGN (sizeof(void *))
+
+struct arena_chunk {
+    arena_chunk_t *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+static void *xmalloc(size_t size) {
+    void *p = malloc(size);
+    if (!p) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static arena_chunk_t *new_chunk(size_t size) {
+    arena_chunk_t *chunk = xmalloc(sizeof *chunk + size);
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+static void *alloc_aligned(arena_t *arena, size_t size, size_t align) {
+    arena_chunk_t *chunk = arena->chunks;
+    if (chunk) {
+        size_t start = (chunk->used + align - 1) & ~(align - 1);
+        if (start + size <= chunk->size) {
+            chunk->used = start + size;
+            return chunk->data + start;
+        }
+    }
+
+    // Chunks double in size, so a test with many outputs needs few of them
+    size_t chunk_size = arena->chunk_size;
+    if (chunk_size < ARENA_CHUNK_MIN) {
+        chunk_size = ARENA_CHUNK_MIN;
+    } else if (chunk_size < ARENA_CHUNK_MAX) {
+        chunk_size *= 2;
+    }
+
+    // Allocations larger than a quarter of the next chunk get their own one
+    // behind the current chunk, so its free space is still used
+    if (size > chunk_size / 4) {
+        arena_chunk_t *big = new_chunk(size);
+        big->used = size;
+        if (chunk) {
+            big->next = chunk->next;
+            chunk->next = big;
+        } else {
+            arena->chunks = big;
+        }
+        return big->data;
+    }
+
+    arena->chunk_size = chunk_size;
+    chunk = new_chunk(chunk_size);
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    chunk->used = size;
+    return chunk->data;
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    //
+    return alloc_aligned(arena, size, ARENA_ALIGN);
+}
+
+char *arena_strndup(arena_t *arena, const char *s, size_t len) {
+    char *copy = alloc_aligned(arena, len + 1, 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char *arena_strdup(arena_t *arena, const char *s) {
+    //
+    return arena_strndup(arena, s, strlen(s));
+}
+
+static size_t hash_string(const char *s) {
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ULL;
+    }
+    return (size_t)h;
+}
+
+static void interned_grow(arena_t *arena) {
+    size_t cap = arena->interned_cap ? arena->interned_cap * 2 : 64;
+    char **table = calloc(cap, sizeof *table);
+    if (!table) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < arena->interned_cap; i++) {
+        char *s = arena->interned[i];
+        if (!s) {
+            continue;
+        }
+        size_t j = hash_string(s) & (cap - 1);
+        while (table[j]) {
+            j = (j + 1) & (cap - 1);
+        }
+        table[j] = s;
+    }
+    free(arena->interned);
+    arena->interned = table;
+    arena->interned_cap = cap;
+}
+
+char *arena_intern(arena_t *arena, const char *s) {
+    if ((arena->interned_count + 1) * 2 > arena->interned_cap) {
+        interned_grow(arena);
+    }
+
+    size_t mask = arena->interned_cap - 1;
+    size_t i = hash_string(s) & mask;
+    while (arena->interned[i]) {
+        if (!strcmp(arena->interned[i], s)) {
+            return arena->interned[i];
+        }
+        i = (i + 1) & mask;
+    }
+
+    char *copy = arena_strdup(arena, s);
+    arena->interned[i] = copy;
+    arena->interned_count++;
+    return copy;
+}
+
+void arena_free(arena_t *arena) {
+    arena_chunk_t *chunk = arena->chunks;
+    while (chunk) {
+        arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena->interned);
+    memset(arena, 0, sizeof *arena);
+}
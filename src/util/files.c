@@ -104,7 +104,7 @@ static int ends_with_lua(const char *name) {
     return dot && strcmp(dot, ".lua") == 0;
 }
 
-static int push_string(str_array_t *a, const char *s) {
+int str_array_push(str_array_t *a, const char *s) {
     char **tmp = realloc(a->items, (a->count + 1) * sizeof *tmp);
     if (!tmp)
         return -1;
@@ -154,7 +154,7 @@ static int walk(const char *dirpath, str_array_t *out) {
         } else if ((S_ISREG(st.st_mode) || (S_ISLNK(st.st_mode))) &&
                    ends_with_lua(ent->d_name)) {
             /* Regular *.lua file */
-            if (push_string(out, full) == -1) {
+            if (str_array_push(out, full) == -1) {
                 free(full);
                 closedir(dir);
                 return -1;
@@ -193,3 +193,35 @@ void replace_symlink(const char *target, const char *linkname) {
 
     symlink(target, linkname);
 }
+
+int fd_write_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+ssize_t fd_read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, p + got, len - got);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (n == 0)
+            break;
+        got += n;
+    }
+    return got;
+}
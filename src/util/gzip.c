@@ -0,0 +1,265 @@
+// fopencookie()
+#define _GNU_SOURCE
+
+#include "util/gzip.h"
+
+#include <libdeflate.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define GZIP_MEMBER_SIZE (1024 * 1024)
+#define GZIP_LEVEL 6
+
+typedef struct {
+    FILE *file;
+    struct libdeflate_compressor *compressor;
+    char *buf;
+    size_t len;
+    char *out;
+    size_t out_cap;
+} gzip_writer_t;
+
+typedef struct {
+    struct libdeflate_decompressor *decompressor;
+    char *in;
+    size_t in_len;
+    size_t in_pos;
+    char *out;
+    size_t out_cap;
+    size_t out_len;
+    size_t out_pos;
+} gzip_reader_t;
+
+static void *xmalloc(size_t size) {
+    void *p = malloc(size);
+    if (!p) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+// Compresses the buffered data into the next gzip member
+static int write_member(gzip_writer_t *w) {
+    if (!w->len) {
+        return 0;
+    }
+    size_t n = libdeflate_gzip_compress(w->compressor, w->buf, w->len, w->out,
+                                        w->out_cap);
+    w->len = 0;
+    if (!n || fwrite(w->out, 1, n, w->file) != n) {
+        return -1;
+    }
+    return 0;
+}
+
+// Returns 0 on error, as fopencookie() expects
+static ssize_t writer_write(void *cookie, const char *data, size_t size) {
+    gzip_writer_t *w = cookie;
+    size_t left = size;
+    while (left) {
+        size_t n = GZIP_MEMBER_SIZE - w->len;
+        if (n > left) {
+            n = left;
+        }
+        memcpy(w->buf + w->len, data, n);
+        w->len += n;
+        data += n;
+        left -= n;
+        if (w->len == GZIP_MEMBER_SIZE && write_member(w)) {
+            return 0;
+        }
+    }
+    return size;
+}
+
+static int writer_close(void *cookie) {
+    gzip_writer_t *w = cookie;
+    int rc = write_member(w);
+    if (fclose(w->file)) {
+        rc = -1;
+    }
+    libdeflate_free_compressor(w->compressor);
+    free(w->buf);
+    free(w->out);
+    free(w);
+    return rc;
+}
+
+// Decompresses the next gzip member. Returns 0 at the end of the file & -1
+// if the data is corrupt.
+static int read_member(gzip_reader_t *r) {
+    if (r->in_pos >= r->in_len) {
+        return 0;
+    }
+    for (;;) {
+        size_t in_used;
+        enum libdeflate_result res = libdeflate_gzip_decompress_ex(
+            r->decompressor, r->in + r->in_pos, r->in_len - r->in_pos, r->out,
+            r->out_cap, &in_used, &r->out_len);
+        if (res == LIBDEFLATE_INSUFFICIENT_SPACE) {
+            r->out_cap *= 2;
+            free(r->out);
+            r->out = xmalloc(r->out_cap);
+            continue;
+        }
+        if (res != LIBDEFLATE_SUCCESS) {
+            return -1;
+        }
+        r->in_pos += in_used;
+        r->out_pos = 0;
+        return 1;
+    }
+}
+
+static ssize_t reader_read(void *cookie, char *buf, size_t size) {
+    gzip_reader_t *r = cookie;
+    while (r->out_pos == r->out_len) {
+        int rc = read_member(r);
+        if (rc <= 0) {
+            return rc;
+        }
+    }
+    size_t n = r->out_len - r->out_pos;
+    if (n > size) {
+        n = size;
+    }
+    memcpy(buf, r->out + r->out_pos, n);
+    r->out_pos += n;
+    return n;
+}
+
+static int reader_close(void *cookie) {
+    gzip_reader_t *r = cookie;
+    libdeflate_free_decompressor(r->decompressor);
+    free(r->in);
+    free(r->out);
+    free(r);
+    return 0;
+}
+
+#ifdef __APPLE__
+static int apple_write(void *cookie, const char *data, int size) {
+    ssize_t n = writer_write(cookie, data, size);
+    return n || !size ? (int)n : -1;
+}
+
+static int apple_read(void *cookie, char *buf, int size) {
+    //
+    return (int)reader_read(cookie, buf, size);
+}
+#endif // __APPLE__
+
+FILE *gzip_fopen_write(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return NULL;
+    }
+
+    gzip_writer_t *w = xmalloc(sizeof *w);
+    w->file = file;
+    w->compressor = libdeflate_alloc_compressor(GZIP_LEVEL);
+    if (!w->compressor) {
+        fclose(file);
+        free(w);
+        return NULL;
+    }
+    w->buf = xmalloc(GZIP_MEMBER_SIZE);
+    w->len = 0;
+    w->out_cap =
+        libdeflate_gzip_compress_bound(w->compressor, GZIP_MEMBER_SIZE);
+    w->out = xmalloc(w->out_cap);
+
+#ifdef __APPLE__
+    FILE *stream = funopen(w, NULL, apple_write, NULL, writer_close);
+#else
+    FILE *stream = fopencookie(w, "w",
+                               (cookie_io_functions_t){
+                                   .write = writer_write,
+                                   .close = writer_close,
+                               });
+#endif // __APPLE__
+    if (!stream) {
+        writer_close(w);
+    }
+    return stream;
+}
+
+static bool read_all(FILE *file, char **data, size_t *len) {
+    size_t cap = 64 * 1024;
+    *data = xmalloc(cap);
+    *len = 0;
+    size_t n;
+    while ((n = fread(*data + *len, 1, cap - *len, file)) > 0) {
+        *len += n;
+        if (*len == cap) {
+            cap *= 2;
+            char *tmp = realloc(*data, cap);
+            if (!tmp) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+            *data = tmp;
+        }
+    }
+    if (ferror(file)) {
+        free(*data);
+        return false;
+    }
+    return true;
+}
+
+FILE *gzip_fopen_read(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    unsigned char magic[2];
+    if (fread(magic, 1, 2, file) != 2 || magic[0] != 0x1f ||
+        magic[1] != 0x8b) {
+        // Not compressed
+        rewind(file);
+        return file;
+    }
+    rewind(file);
+
+    // Compressed data is small enough to be read at once, it is decompressed
+    // member by member while the stream is read
+    gzip_reader_t *r = xmalloc(sizeof *r);
+    if (!read_all(file, &r->in, &r->in_len)) {
+        fclose(file);
+        free(r);
+        return NULL;
+    }
+    fclose(file);
+    r->in_pos = 0;
+    r->decompressor = libdeflate_alloc_decompressor();
+    r->out_cap = GZIP_MEMBER_SIZE;
+    r->out = xmalloc(r->out_cap);
+    r->out_len = 0;
+    r->out_pos = 0;
+    if (!r->decompressor) {
+        free(r->out);
+        free(r->in);
+        free(r);
+        return NULL;
+    }
+
+#ifdef __APPLE__
+    FILE *stream = funopen(r, apple_read, NULL, NULL, reader_close);
+#else
+    FILE *stream = fopencookie(r, "r",
+                               (cookie_io_functions_t){
+                                   .read = reader_read,
+                                   .close = reader_close,
+                               });
+#endif // __APPLE__
+    if (!stream) {
+        reader_close(r);
+    }
+    return stream;
+}